@@ -38,6 +38,7 @@ limitations under the License.
 #include "sirf/Reg/NiftiImageData3DDisplacement.h"
 #include "sirf/Reg/AffineTransformation.h"
 #include "sirf/Reg/NiftyResample.h"
+#include "sirf/common/reductions.h"
 #include <iomanip>
 #include <cmath>
 
@@ -1200,9 +1201,7 @@ void NiftiImageData<dataType>::dot(const DataContainer& a_x, void* ptr) const
 {
     const NiftiImageData<dataType>& x = dynamic_cast<const NiftiImageData<dataType>&>(a_x);
     assert(_nifti_image->nvox == x._nifti_image->nvox);
-    double s = 0.0;
-    for (unsigned i=0; i<this->_nifti_image->nvox; ++i)
-        s += double(_data[i] * x._data[i]);
+    const double s = Reductions::dot(_data, x._data, _nifti_image->nvox);
     float* ptr_s = static_cast<float*>(ptr);
     *ptr_s = float(s);
 }
@@ -1226,9 +1225,7 @@ void NiftiImageData<dataType>::axpby(
 template<class dataType>
 float NiftiImageData<dataType>::norm() const
 {
-    double s = 0.0;
-    for (unsigned i=0; i<this->_nifti_image->nvox; ++i)
-        s += double(_data[i]*_data[i]);
+    const double s = Reductions::sum_sq(_data, _nifti_image->nvox);
     return float(sqrt(s));
 }
 
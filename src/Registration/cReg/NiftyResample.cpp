@@ -34,7 +34,11 @@ limitations under the License.
 #include <_reg_resampling.h>
 #include <_reg_globalTrans.h>
 #include <_reg_tools.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <memory>
+#include "sirf/common/thread_pool.h"
 
 using namespace sirf;
 
@@ -49,8 +53,25 @@ void NiftyResample<dataType>::process()
     // Get reference and floating images as NiftiImageData
     set_up_input_images();
 
+    // Use the precomputed weights if they are for this set-up
+    if (is_set_up() && plan_matches_floating_image(*this->_floating_image_nifti_sptr) &&
+            this->_floating_image_nifti_sptr->get_num_voxels() * (_plan_row_start.size() - 1) ==
+            _plan_reference_sptr->get_num_voxels() * (_plan_column_start.size() - 1)) {
+        // Overwrite the output of the previous call, unless it is still in use elsewhere
+        if (!this->_output_image_nifti_sptr || this->_output_image_nifti_sptr.use_count() > 1 ||
+                this->_output_image_nifti_sptr->get_num_voxels() != _plan_reference_sptr->get_num_voxels())
+            set_up_output_image();
+        forward(*this->_output_image_nifti_sptr, *this->_floating_image_nifti_sptr);
+        if (!this->_output_image_sptr || this->_output_image_sptr.use_count() > 1)
+            this->_output_image_sptr = this->_reference_image_sptr->clone();
+        this->_output_image_sptr->ImageData::fill(*this->_output_image_nifti_sptr);
+        std::cout << "\n\nResampling finished!\n\n";
+        return;
+    }
+
     // Setup output image
     set_up_output_image();
+
     // If no transformations, use identity.
     if (this->_transformations.size() == 0) {
         std::cout << "\nNo transformations set, using identity.\n";
@@ -81,8 +102,13 @@ void NiftyResample<dataType>::process()
 template<class dataType>
 void NiftyResample<dataType>::set_up_input_images()
 {
+    // The reference image the weights were computed for has been converted already
+    if (is_set_up())
+        this->_reference_image_nifti_sptr = _plan_reference_sptr;
+    else
+        this->_reference_image_nifti_sptr = std::dynamic_pointer_cast<const NiftiImageData<dataType> >(this->_reference_image_sptr);
+
     // Try to dynamic cast from ImageData to NiftiImageData. This will only succeed if original type was NiftiImageData
-    this->_reference_image_nifti_sptr = std::dynamic_pointer_cast<const NiftiImageData<dataType> >(this->_reference_image_sptr);
     this->_floating_image_nifti_sptr  = std::dynamic_pointer_cast<const NiftiImageData<dataType> >(this->_floating_image_sptr);
 
     // If either is a null pointer, it means that a different image type was supplied (e.g., STIRImageData).
@@ -125,6 +151,282 @@ void NiftyResample<dataType>::set_up_output_image()
     this->_output_image_nifti_sptr = std::make_shared<NiftiImageData<dataType> >(*output_ptr);
 }
 
+/// Interpolation kernels of NiftyReg: weights of the kernel_size voxels from floor(position) - kernel_offset
+/// given the position relative to floor(position)
+static void nearest_neighbour_kernel(double relative, double *basis)
+{
+    if (relative < 0.0) relative = 0.0;
+    basis[0] = relative < 0.5 ? 1.0 : 0.0;
+    basis[1] = relative < 0.5 ? 0.0 : 1.0;
+}
+
+static void linear_kernel(double relative, double *basis)
+{
+    if (relative < 0.0) relative = 0.0;
+    basis[0] = 1.0 - relative;
+    basis[1] = relative;
+}
+
+static void cubic_spline_kernel(double relative, double *basis)
+{
+    if (relative < 0.0) relative = 0.0;
+    const double FF = relative*relative;
+    basis[0] = (relative * ((2.0-relative)*relative - 1.0))/2.0;
+    basis[1] = (FF * (3.0*relative-5.0) + 2.0)/2.0;
+    basis[2] = (relative * ((4.0-3.0*relative)*relative + 1.0))/2.0;
+    basis[3] = (relative-1.0) * FF/2.0;
+}
+
+static const int SINC_RADIUS = 3;
+
+static void windowed_sinc_kernel(double relative, double *basis)
+{
+    if (relative < 0.0) relative = 0.0;
+    double sum = 0.0;
+    for (int i=-SINC_RADIUS, j=0; i<SINC_RADIUS; ++i, ++j) {
+        const double x = relative - double(i);
+        if (x == 0.0)
+            basis[j] = 1.0;
+        else if (std::fabs(x) >= double(SINC_RADIUS))
+            basis[j] = 0.0;
+        else {
+            const double pi_x = M_PI*x;
+            basis[j] = double(SINC_RADIUS) * std::sin(pi_x) * std::sin(pi_x/double(SINC_RADIUS)) / (pi_x*pi_x);
+        }
+        sum += basis[j];
+    }
+    for (int j=0; j<2*SINC_RADIUS; ++j)
+        basis[j] /= sum;
+}
+
+template<class dataType>
+void NiftyResample<dataType>::set_up()
+{
+    this->check_parameters();
+    set_up_input_images();
+
+    // If no transformations, use identity (as in process()).
+    if (this->_transformations.size() == 0)
+        this->_transformations.push_back(std::make_shared<AffineTransformation<float> >());
+
+    NiftiImageData3DDeformation<dataType> transformation =
+            NiftiImageData3DDeformation<dataType>::compose_single_deformation(this->_transformations, *this->_reference_image_nifti_sptr);
+
+    const nifti_image * const ref_ptr = this->_reference_image_nifti_sptr->get_raw_nifti_sptr().get();
+    const nifti_image * const flo_ptr = this->_floating_image_nifti_sptr->get_raw_nifti_sptr().get();
+    const size_t num_ref_voxels = size_t(ref_ptr->nx) * ref_ptr->ny * ref_ptr->nz;
+    const size_t num_flo_voxels = size_t(flo_ptr->nx) * flo_ptr->ny * flo_ptr->nz;
+    if (num_flo_voxels > size_t(std::numeric_limits<unsigned>::max()) ||
+            num_ref_voxels > size_t(std::numeric_limits<unsigned>::max()))
+        throw std::runtime_error("NiftyResample::set_up: images too large for precomputed weights.");
+
+    int kernel_size, kernel_offset;
+    void (*kernel)(double, double*);
+    switch (this->_interpolation_type) {
+    case Resample<dataType>::NEARESTNEIGHBOUR: kernel_size = 2;               kernel_offset = 0;           kernel = &nearest_neighbour_kernel; break;
+    case Resample<dataType>::LINEAR:           kernel_size = 2;               kernel_offset = 0;           kernel = &linear_kernel;            break;
+    case Resample<dataType>::SINC:             kernel_size = 2 * SINC_RADIUS; kernel_offset = SINC_RADIUS; kernel = &windowed_sinc_kernel;     break;
+    default:                                   kernel_size = 4;               kernel_offset = 1;           kernel = &cubic_spline_kernel;      break;
+    }
+
+    // Deformation field: real world positions in the floating image (x, then y, then z components).
+    // As in NiftyReg, these are mapped to voxels with sform if available, and 2D images are interpolated in 2D.
+    const float * const def_ptr = static_cast<const float*>(transformation.get_raw_nifti_sptr()->data);
+    const mat44 &ijk = flo_ptr->sform_code > 0 ? flo_ptr->sto_ijk : flo_ptr->qto_ijk;
+    const bool is_2d = flo_ptr->nz == 1 && ref_ptr->nz == 1;
+    const int flo_dims[3] = { flo_ptr->nx, flo_ptr->ny, flo_ptr->nz };
+
+    // Rows are computed in blocks in parallel, then concatenated
+    const size_t block_size = 1 << 14;
+    const size_t num_blocks = (num_ref_voxels + block_size - 1) / block_size;
+    std::vector<std::vector<unsigned> > block_columns(num_blocks);
+    std::vector<std::vector<float> >    block_weights(num_blocks);
+    std::vector<size_t> row_size(num_ref_voxels, 0);
+    sirf::parallel_for(num_blocks, [&](size_t b) {
+        const size_t end = std::min(num_ref_voxels, (b + 1) * block_size);
+        double basis[3][2 * SINC_RADIUS];
+        int first[3], size[3];
+        for (size_t r = b * block_size; r < end; ++r) {
+            const double world[3] = { def_ptr[r], def_ptr[r + num_ref_voxels], def_ptr[r + 2 * num_ref_voxels] };
+            if (!std::isfinite(world[0]) || !std::isfinite(world[1]) || !std::isfinite(world[2]))
+                continue;
+            for (int i=0; i<3; ++i) {
+                const double position = ijk.m[i][0]*world[0] + ijk.m[i][1]*world[1] + ijk.m[i][2]*world[2] + ijk.m[i][3];
+                if (i == 2 && is_2d) {
+                    first[i] = 0;
+                    size[i] = 1;
+                    basis[i][0] = 1.0;
+                    continue;
+                }
+                const int previous = int(std::floor(position));
+                kernel(position - double(previous), basis[i]);
+                first[i] = previous - kernel_offset;
+                size[i] = kernel_size;
+            }
+            for (int c=0; c<size[2]; ++c) {
+                const int z = first[2] + c;
+                if (z < 0 || z >= flo_dims[2] || basis[2][c] == 0.0)
+                    continue;
+                for (int b2=0; b2<size[1]; ++b2) {
+                    const int y = first[1] + b2;
+                    if (y < 0 || y >= flo_dims[1] || basis[1][b2] == 0.0)
+                        continue;
+                    for (int a=0; a<size[0]; ++a) {
+                        const int x = first[0] + a;
+                        if (x < 0 || x >= flo_dims[0] || basis[0][a] == 0.0)
+                            continue;
+                        block_columns[b].push_back(unsigned((size_t(z) * flo_dims[1] + y) * flo_dims[0] + x));
+                        block_weights[b].push_back(float(basis[0][a] * basis[1][b2] * basis[2][c]));
+                        ++row_size[r];
+                    }
+                }
+            }
+        }
+    });
+
+    _plan_row_start.assign(num_ref_voxels + 1, 0);
+    for (size_t r=0; r<num_ref_voxels; ++r)
+        _plan_row_start[r + 1] = _plan_row_start[r] + row_size[r];
+    const size_t num_weights = _plan_row_start[num_ref_voxels];
+    _plan_columns.resize(num_weights);
+    _plan_weights.resize(num_weights);
+    sirf::parallel_for(num_blocks, [&](size_t b) {
+        const size_t offset = _plan_row_start[b * block_size];
+        std::copy(block_columns[b].begin(), block_columns[b].end(), _plan_columns.begin() + offset);
+        std::copy(block_weights[b].begin(), block_weights[b].end(), _plan_weights.begin() + offset);
+        std::vector<unsigned>().swap(block_columns[b]);
+        std::vector<float>().swap(block_weights[b]);
+    });
+
+    // The transpose, with the weights of each floating voxel in the order of reference voxels
+    _plan_column_start.assign(num_flo_voxels + 1, 0);
+    for (size_t j=0; j<num_weights; ++j)
+        ++_plan_column_start[_plan_columns[j] + 1];
+    for (size_t c=0; c<num_flo_voxels; ++c)
+        _plan_column_start[c + 1] += _plan_column_start[c];
+    _plan_rows.resize(num_weights);
+    _plan_column_weights.resize(num_weights);
+    std::vector<size_t> next(_plan_column_start.begin(), _plan_column_start.end() - 1);
+    for (size_t r=0; r<num_ref_voxels; ++r)
+        for (size_t j=_plan_row_start[r]; j<_plan_row_start[r + 1]; ++j) {
+            const size_t k = next[_plan_columns[j]]++;
+            _plan_rows[k] = unsigned(r);
+            _plan_column_weights[k] = _plan_weights[j];
+        }
+
+    // Outputs kept for reuse by process() may be for another reference image
+    this->_output_image_sptr.reset();
+    this->_output_image_nifti_sptr.reset();
+
+    _plan_reference_image_sptr = this->_reference_image_sptr;
+    _plan_transformations      = this->_transformations;
+    _plan_interpolation_type   = this->_interpolation_type;
+    _plan_reference_sptr       = this->_reference_image_nifti_sptr;
+    _plan_floating_sptr        = this->_floating_image_nifti_sptr;
+}
+
+template<class dataType>
+bool NiftyResample<dataType>::is_set_up() const
+{
+    return _plan_floating_sptr &&
+            _plan_reference_image_sptr == this->_reference_image_sptr &&
+            _plan_transformations      == this->_transformations &&
+            _plan_interpolation_type   == this->_interpolation_type;
+}
+
+template<class dataType>
+bool NiftyResample<dataType>::plan_matches_floating_image(const NiftiImageData<dataType> &image) const
+{
+    const nifti_image * const plan_ptr = _plan_floating_sptr->get_raw_nifti_sptr().get();
+    const nifti_image * const im_ptr = image.get_raw_nifti_sptr().get();
+    if (im_ptr->nx != plan_ptr->nx || im_ptr->ny != plan_ptr->ny || im_ptr->nz != plan_ptr->nz)
+        return false;
+    if ((im_ptr->sform_code > 0) != (plan_ptr->sform_code > 0))
+        return false;
+    const mat44 &im_ijk   = im_ptr->sform_code   > 0 ? im_ptr->sto_ijk   : im_ptr->qto_ijk;
+    const mat44 &plan_ijk = plan_ptr->sform_code > 0 ? plan_ptr->sto_ijk : plan_ptr->qto_ijk;
+    for (int i=0; i<4; ++i)
+        for (int j=0; j<4; ++j)
+            if (im_ijk.m[i][j] != plan_ijk.m[i][j])
+                return false;
+    return true;
+}
+
+template<class dataType>
+void NiftyResample<dataType>::forward(NiftiImageData<dataType> &output, const NiftiImageData<dataType> &input) const
+{
+    if (!is_set_up())
+        throw std::runtime_error("NiftyResample::forward: set_up() has not been called for the current parameters.");
+    if (!plan_matches_floating_image(input))
+        throw std::runtime_error("NiftyResample::forward: input image does not have the geometry of the floating image.");
+    const size_t num_rows = _plan_row_start.size() - 1;
+    const size_t num_columns = _plan_column_start.size() - 1;
+    // volumes (nt, nu > 1) are resampled alike
+    const size_t num_volumes = input.get_num_voxels() / num_columns;
+    if (output.get_num_voxels() != num_volumes * num_rows)
+        throw std::runtime_error("NiftyResample::forward: output image does not have the size of the reference image.");
+    const float * const in = static_cast<const float*>(input.get_raw_nifti_sptr()->data);
+    float * const out = static_cast<float*>(output.get_raw_nifti_sptr()->data);
+    sirf::parallel_for_blocks(num_volumes * num_rows, 1 << 14, [&](size_t begin, size_t end) {
+        for (size_t i=begin; i<end; ++i) {
+            const size_t v = i / num_rows;
+            const size_t r = i % num_rows;
+            const float * const in_v = in + v * num_columns;
+            double value = 0.0;
+            for (size_t j=_plan_row_start[r]; j<_plan_row_start[r + 1]; ++j)
+                value += double(_plan_weights[j]) * in_v[_plan_columns[j]];
+            out[i] = float(value);
+        }
+    });
+}
+
+template<class dataType>
+std::shared_ptr<NiftiImageData<dataType> > NiftyResample<dataType>::forward(const NiftiImageData<dataType> &input) const
+{
+    if (!is_set_up())
+        throw std::runtime_error("NiftyResample::forward: set_up() has not been called for the current parameters.");
+    std::shared_ptr<NiftiImageData<dataType> > output_sptr = std::make_shared<NiftiImageData<dataType> >(*_plan_reference_sptr);
+    forward(*output_sptr, input);
+    return output_sptr;
+}
+
+template<class dataType>
+void NiftyResample<dataType>::adjoint(NiftiImageData<dataType> &output, const NiftiImageData<dataType> &input) const
+{
+    if (!is_set_up())
+        throw std::runtime_error("NiftyResample::adjoint: set_up() has not been called for the current parameters.");
+    if (!plan_matches_floating_image(output))
+        throw std::runtime_error("NiftyResample::adjoint: output image does not have the geometry of the floating image.");
+    const size_t num_rows = _plan_row_start.size() - 1;
+    const size_t num_columns = _plan_column_start.size() - 1;
+    const size_t num_volumes = output.get_num_voxels() / num_columns;
+    if (input.get_num_voxels() != num_volumes * num_rows)
+        throw std::runtime_error("NiftyResample::adjoint: input image does not have the size of the reference image.");
+    const float * const in = static_cast<const float*>(input.get_raw_nifti_sptr()->data);
+    float * const out = static_cast<float*>(output.get_raw_nifti_sptr()->data);
+    sirf::parallel_for_blocks(num_volumes * num_columns, 1 << 14, [&](size_t begin, size_t end) {
+        for (size_t i=begin; i<end; ++i) {
+            const size_t v = i / num_columns;
+            const size_t c = i % num_columns;
+            const float * const in_v = in + v * num_rows;
+            double value = 0.0;
+            for (size_t j=_plan_column_start[c]; j<_plan_column_start[c + 1]; ++j)
+                value += double(_plan_column_weights[j]) * in_v[_plan_rows[j]];
+            out[i] = float(value);
+        }
+    });
+}
+
+template<class dataType>
+std::shared_ptr<NiftiImageData<dataType> > NiftyResample<dataType>::adjoint(const NiftiImageData<dataType> &input) const
+{
+    if (!is_set_up())
+        throw std::runtime_error("NiftyResample::adjoint: set_up() has not been called for the current parameters.");
+    std::shared_ptr<NiftiImageData<dataType> > output_sptr = std::make_shared<NiftiImageData<dataType> >(*_plan_floating_sptr);
+    adjoint(*output_sptr, input);
+    return output_sptr;
+}
+
 namespace sirf {
 template class NiftyResample<float>;
 }
@@ -616,6 +616,36 @@ void* cReg_NiftyResample_process(void* ptr)
     }
     CATCH;
 }
+extern "C"
+void* cReg_NiftyResample_set_up(void* ptr)
+{
+    try {
+        NiftyResample<float>& res = objectFromHandle<NiftyResample<float> >(ptr);
+        res.set_up();
+        return new DataHandle;
+    }
+    CATCH;
+}
+extern "C"
+void* cReg_NiftyResample_forward(const void* ptr, const void* im)
+{
+    try {
+        const NiftyResample<float>& res = objectFromHandle<const NiftyResample<float> >(ptr);
+        const NiftiImageData<float>& input = objectFromHandle<const NiftiImageData<float> >(im);
+        return newObjectHandle(res.forward(input));
+    }
+    CATCH;
+}
+extern "C"
+void* cReg_NiftyResample_adjoint(const void* ptr, const void* im)
+{
+    try {
+        const NiftyResample<float>& res = objectFromHandle<const NiftyResample<float> >(ptr);
+        const NiftiImageData<float>& input = objectFromHandle<const NiftiImageData<float> >(im);
+        return newObjectHandle(res.adjoint(input));
+    }
+    CATCH;
+}
 
 // -------------------------------------------------------------------------------- //
 //      ImageWeightedMean
@@ -84,6 +84,9 @@ extern "C" {
     // NiftyResample
     void* cReg_NiftyResample_add_transformation(void* self, const void* trans, const char* type);
     void* cReg_NiftyResample_process(void* ptr);
+    void* cReg_NiftyResample_set_up(void* ptr);
+    void* cReg_NiftyResample_forward(const void* ptr, const void* im);
+    void* cReg_NiftyResample_adjoint(const void* ptr, const void* im);
 
     // ImageWeightedMean
     void* cReg_ImageWeightedMean_add_image(void* ptr, const void* obj, const float weight);
@@ -43,6 +43,22 @@ namespace sirf {
 
 The reference image and floating image can have nt and/or nu != 1.
 
+For repeated resampling with the same transformations, set_up() precomputes
+the resampling as a sparse matrix of interpolation weights (one row per
+reference voxel, with the weights of the floating voxels it is interpolated
+from, computed with the kernels NiftyReg uses). process() then applies the
+matrix instead of composing the transformations and calling NiftyReg, for
+as long as the floating image has the geometry it was set up with, and
+forward() and adjoint() apply the matrix and its transpose to other images.
+After a change of the reference image, transformations or interpolation
+type, set_up() has to be called again (until then, process() resamples with
+NiftyReg). The reference image and transformations are compared by pointer,
+so set_up() also has to be called again after modifying them in place.
+process() reuses its output images while the caller holds no other
+reference to them. Memory use is 16 bytes per weight (the transpose is
+also stored), i.e. about 8, 64 or 216 weights per voxel for linear, cubic
+spline and sinc interpolation.
+
 \author Richard Brown
 \author CCP PETMR
 */
@@ -52,7 +68,7 @@ class NiftyResample : public Resample<dataType>
 public:
 
     /// Constructor
-    NiftyResample() {}
+    NiftyResample() { _plan_interpolation_type = Resample<dataType>::NOTSET; }
 
     /// Destructor
     virtual ~NiftyResample() {}
@@ -60,11 +76,33 @@ public:
     /// Process
     virtual void process();
 
+    /// Precompute the interpolation weights for the current reference image, floating image geometry, transformations and interpolation type
+    void set_up();
+
+    /// Are there weights for the current reference image, transformations and interpolation type?
+    /// (The reference image and transformations are compared by pointer, not by contents.)
+    bool is_set_up() const;
+
+    /// Resample an image with the geometry of the floating image into output (with that of the reference image), using the precomputed weights
+    void forward(NiftiImageData<dataType> &output, const NiftiImageData<dataType> &input) const;
+
+    /// Resample an image with the geometry of the floating image, using the precomputed weights
+    std::shared_ptr<NiftiImageData<dataType> > forward(const NiftiImageData<dataType> &input) const;
+
+    /// Adjoint of forward(): from an image with the geometry of the reference image into output (with that of the floating image)
+    void adjoint(NiftiImageData<dataType> &output, const NiftiImageData<dataType> &input) const;
+
+    /// Adjoint of forward() applied to an image with the geometry of the reference image
+    std::shared_ptr<NiftiImageData<dataType> > adjoint(const NiftiImageData<dataType> &input) const;
+
     /// Get output (as NiftiImageData)
     const std::shared_ptr<const NiftiImageData<dataType> > get_output_sptr() const { return _output_image_nifti_sptr; }
 
 protected:
 
+    /// Does the image have the geometry of the floating image the weights were computed for?
+    bool plan_matches_floating_image(const NiftiImageData<dataType> &image) const;
+
     /// Set up the input images (convert from ImageData to NiftiImageData if necessary)
     void set_up_input_images();
 
@@ -77,5 +115,21 @@ protected:
     std::shared_ptr<const NiftiImageData<dataType> > _floating_image_nifti_sptr;
     /// Floating image as a NiftiImageData
     std::shared_ptr<NiftiImageData<dataType> >       _output_image_nifti_sptr;
+
+    /// Reference image, transformations and interpolation type the weights were computed for
+    std::shared_ptr<const ImageData> _plan_reference_image_sptr;
+    std::vector<std::shared_ptr<const Transformation<dataType> > > _plan_transformations;
+    typename Resample<dataType>::InterpolationType _plan_interpolation_type;
+    /// Reference and floating images (as NiftiImageData) the weights were computed for
+    std::shared_ptr<const NiftiImageData<dataType> > _plan_reference_sptr;
+    std::shared_ptr<const NiftiImageData<dataType> > _plan_floating_sptr;
+    /// Weights by reference voxel (compressed sparse rows): start of each row, floating voxels and weights
+    std::vector<size_t>   _plan_row_start;
+    std::vector<unsigned> _plan_columns;
+    std::vector<float>    _plan_weights;
+    /// Weights by floating voxel (the transpose, for the adjoint): start of each row, reference voxels and weights
+    std::vector<size_t>   _plan_column_start;
+    std::vector<unsigned> _plan_rows;
+    std::vector<float>    _plan_column_weights;
 };
 }
@@ -37,6 +37,7 @@ limitations under the License.
 #include "sirf/Reg/AffineTransformation.h"
 #include "sirf/Reg/Quaternion.h"
 #include <memory>
+#include <cmath>
 
 using namespace sirf;
 
@@ -805,6 +806,48 @@ int main(int argc, char* argv[])
         nr3.process();
         nr3.get_output_sptr()->write(nonrigid_resample_def);
 
+        std::cout << "Testing resampling with precomputed weights...\n";
+        const Resample<float>::InterpolationType interpolation_types[] = {
+            Resample<float>::NEARESTNEIGHBOUR, Resample<float>::LINEAR,
+            Resample<float>::CUBICSPLINE, Resample<float>::SINC };
+        for (int t=0; t<4; ++t) {
+            NiftyResample<float> nr4;
+            nr4.set_reference_image(ref_aladin);
+            nr4.set_floating_image(flo_aladin);
+            nr4.set_interpolation_type(interpolation_types[t]);
+            nr4.add_transformation(tm);
+            nr4.process();
+            const NiftiImageData<float> niftyreg_output = *nr4.get_output_sptr();
+            nr4.set_up();
+            if (!nr4.is_set_up())
+                throw std::runtime_error("NiftyResample set_up() failed.");
+            nr4.process();
+            std::shared_ptr<const NiftiImageData<float> > output = nr4.get_output_sptr();
+            if (!NiftiImageData<float>::are_equal_to_given_accuracy(niftyreg_output, *output, 1.e-3F))
+                throw std::runtime_error("NiftyResample with precomputed weights differs from NiftyReg.");
+            // the output held here must not be overwritten by the next call
+            nr4.process();
+            if (nr4.get_output_sptr() == output)
+                throw std::runtime_error("NiftyResample overwrote an output still in use.");
+            // <A x, y> = <x, A^T y>
+            std::shared_ptr<NiftiImageData<float> > Ax  = nr4.forward(*flo_aladin);
+            std::shared_ptr<NiftiImageData<float> > ATy = nr4.adjoint(*ref_aladin);
+            const float * const x = static_cast<const float*>(flo_aladin->get_raw_nifti_sptr()->data);
+            const float * const y = static_cast<const float*>(ref_aladin->get_raw_nifti_sptr()->data);
+            const float * const Ax_ptr  = static_cast<const float*>(Ax->get_raw_nifti_sptr()->data);
+            const float * const ATy_ptr = static_cast<const float*>(ATy->get_raw_nifti_sptr()->data);
+            double Ax_y = 0., x_ATy = 0.;
+            for (size_t i=0; i<Ax->get_num_voxels(); ++i)
+                Ax_y += double(Ax_ptr[i]) * y[i];
+            for (size_t i=0; i<ATy->get_num_voxels(); ++i)
+                x_ATy += double(x[i]) * ATy_ptr[i];
+            if (std::abs(Ax_y - x_ATy) > 1.e-4 * std::abs(Ax_y))
+                throw std::runtime_error("NiftyResample adjoint() is not the adjoint of forward().");
+            nr4.set_interpolation_type(interpolation_types[(t + 1) % 4]);
+            if (nr4.is_set_up())
+                throw std::runtime_error("NiftyResample precomputed weights not invalidated.");
+        }
+
         // TODO this doesn't work. For some reason (even with NiftyReg directly), resampling with the TM from the registration
         // doesn't give the same result as the output from the registration itself (even with same interpolations). Even though
         // ref and flo images are positive, the output of the registration can be negative. This implies that linear interpolation
@@ -97,5 +97,29 @@ classdef NiftyResample < handle
             output.handle_ = calllib('mreg', 'mReg_parameter', self.handle_, self.name, 'output');
             sirf.Utilities.check_status([self.name ':get_output'], output.handle_)
         end
+        function set_up(self)
+            %Precompute the interpolation weights for process(), forward() and adjoint().
+            %Has to be called again after any change of the reference image,
+            %transformations or interpolation type.
+            h = calllib('mreg', 'mReg_NiftyResample_set_up', self.handle_);
+            sirf.Utilities.check_status([self.name ':set_up'], h);
+            sirf.Utilities.delete(h)
+        end
+        function output = forward(self, image)
+            %Resample an image with the geometry of the floating image, using the precomputed weights.
+            assert(isa(image, 'sirf.Reg.NiftiImageData'))
+            output = sirf.Reg.NiftiImageData();
+            sirf.Utilities.delete(output.handle_)
+            output.handle_ = calllib('mreg', 'mReg_NiftyResample_forward', self.handle_, image.handle_);
+            sirf.Utilities.check_status([self.name ':forward'], output.handle_)
+        end
+        function output = adjoint(self, image)
+            %Adjoint of forward(), applied to an image with the geometry of the reference image.
+            assert(isa(image, 'sirf.Reg.NiftiImageData'))
+            output = sirf.Reg.NiftiImageData();
+            sirf.Utilities.delete(output.handle_)
+            output.handle_ = calllib('mreg', 'mReg_NiftyResample_adjoint', self.handle_, image.handle_);
+            sirf.Utilities.check_status([self.name ':adjoint'], output.handle_)
+        end
     end
 end
@@ -138,6 +138,15 @@ EXPORTED_FUNCTION     void* mReg_NiftyResample_add_transformation(void* self, co
 EXPORTED_FUNCTION     void* mReg_NiftyResample_process(void* ptr) {
 	return cReg_NiftyResample_process(ptr);
 }
+EXPORTED_FUNCTION     void* mReg_NiftyResample_set_up(void* ptr) {
+	return cReg_NiftyResample_set_up(ptr);
+}
+EXPORTED_FUNCTION     void* mReg_NiftyResample_forward(const void* ptr, const void* im) {
+	return cReg_NiftyResample_forward(ptr, im);
+}
+EXPORTED_FUNCTION     void* mReg_NiftyResample_adjoint(const void* ptr, const void* im) {
+	return cReg_NiftyResample_adjoint(ptr, im);
+}
 EXPORTED_FUNCTION     void* mReg_ImageWeightedMean_add_image(void* ptr, const void* obj, const float weight) {
 	return cReg_ImageWeightedMean_add_image(ptr, obj, weight);
 }
@@ -777,6 +777,33 @@ class NiftyResample:
         """Process."""
         try_calling(pyreg.cReg_NiftyResample_process(self.handle))
 
+    def set_up(self):
+        """Precompute the interpolation weights, so that process(), forward()
+        and adjoint() do not call NiftyReg. Has to be called again after any
+        change of the reference image, transformations or interpolation
+        type (these are compared by object, not by contents)."""
+        try_calling(pyreg.cReg_NiftyResample_set_up(self.handle))
+
+    def forward(self, image):
+        """Resample an image with the geometry of the floating image,
+        using the weights precomputed by set_up()."""
+        if not isinstance(image, NiftiImageData):
+            raise AssertionError()
+        output = NiftiImageData()
+        output.handle = pyreg.cReg_NiftyResample_forward(self.handle, image.handle)
+        check_status(output.handle)
+        return output
+
+    def adjoint(self, image):
+        """Adjoint of forward(), applied to an image with the geometry of
+        the reference image."""
+        if not isinstance(image, NiftiImageData):
+            raise AssertionError()
+        output = NiftiImageData()
+        output.handle = pyreg.cReg_NiftyResample_adjoint(self.handle, image.handle)
+        check_status(output.handle)
+        return output
+
     def get_output(self):
         """Get output."""
         image = self.reference_image.same_object()
@@ -0,0 +1,25 @@
+function n = num_threads()
+% Returns the maximal number of threads used by SIRF parallel loops.
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2020 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+    handle = calllib('msirf', 'mSIRF_numThreads');
+    sirf.Utilities.check_status('num_threads', handle);
+    n = calllib('miutilities', 'mIntDataFromHandle', handle);
+    sirf.Utilities.delete(handle)
+end
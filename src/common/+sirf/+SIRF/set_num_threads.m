@@ -0,0 +1,32 @@
+function set_num_threads(num_threads)
+% Sets the maximal number of threads used by SIRF parallel loops.
+% Usage:
+%     sirf.SIRF.set_num_threads(num_threads);
+% num_threads < 1 (or no argument) restores the default, which is defined
+% by environment variables SIRF_NUM_THREADS or OMP_NUM_THREADS, or else by
+% the number of hardware threads.
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2020 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+    if nargin < 1
+        num_threads = 0;
+    end
+    handle = calllib('msirf', 'mSIRF_setNumThreads', num_threads);
+    sirf.Utilities.check_status('set_num_threads', handle);
+    sirf.Utilities.delete(handle)
+end
@@ -21,6 +21,7 @@ Object-Oriented wrap for the cSIRF-to-Python interface pysirf.py
 ##   limitations under the License.
 
 import abc
+import json
 import numpy
 try:
     import pylab
@@ -43,6 +44,60 @@ if sys.version_info[0] >= 3 and sys.version_info[1] >= 4:
 else:
     ABC = abc.ABCMeta('ABC', (), {})
 
+
+def set_num_threads(num_threads=0):
+    '''
+    Sets the maximal number of threads used by SIRF parallel loops.
+    num_threads < 1 restores the default, which is defined by environment
+    variables SIRF_NUM_THREADS or OMP_NUM_THREADS, or else by the number of
+    hardware threads.
+    '''
+    try_calling(pysirf.cSIRF_setNumThreads(int(num_threads)))
+
+
+def num_threads():
+    '''
+    Returns the maximal number of threads used by SIRF parallel loops.
+    '''
+    handle = pysirf.cSIRF_numThreads()
+    check_status(handle)
+    n = pyiutil.intDataFromHandle(handle)
+    pyiutil.deleteDataHandle(handle)
+    return n
+
+
+def instrumentation():
+    '''
+    Returns SIRF timers and counters statistics as a dictionary with
+    items 'counters' and 'timers'.
+    '''
+    handle = pysirf.cSIRF_instrumentation()
+    check_status(handle)
+    report = pyiutil.charDataFromHandle(handle)
+    pyiutil.deleteDataHandle(handle)
+    return json.loads(report)
+
+
+def reset_instrumentation():
+    '''
+    Zeroes SIRF counters and discards timers statistics and trace events.
+    '''
+    try_calling(pysirf.cSIRF_resetInstrumentation())
+
+
+def set_tracing(on=True):
+    '''
+    Switches recording of trace events on or off.
+    '''
+    try_calling(pysirf.cSIRF_setTracing(1 if on else 0))
+
+
+def write_trace(filename):
+    '''
+    Writes recorded trace events to a file in Chrome trace format.
+    '''
+    try_calling(pysirf.cSIRF_writeTrace(filename))
+
 class DataContainer(ABC):
     '''
     Abstract base class for an abstract data container.
@@ -24,6 +24,8 @@ limitations under the License.
 
 #include "sirf/iUtilities/DataHandle.h"
 #include "sirf/common/DataContainer.h"
+#include "sirf/common/instrumentation.h"
+#include "sirf/common/thread_pool.h"
 
 //using std::shared_ptr;
 //#include "sirf/common/object_handle.inl"
@@ -201,3 +203,68 @@ cSIRF_DataHandleVector_push_back(void* self, void* to_append)
     vec.push_back(to_append);
     return new DataHandle;
 }
+
+extern "C"
+void*
+cSIRF_setNumThreads(int num_threads)
+{
+	try {
+		ThreadPool::instance().set_num_threads(num_threads);
+		return new DataHandle;
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSIRF_numThreads()
+{
+	try {
+		return dataHandle(ThreadPool::instance().num_threads());
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSIRF_instrumentation()
+{
+	try {
+		std::string report = Instrumentation::instance().json();
+		return charDataHandleFromCharData(report.c_str());
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSIRF_resetInstrumentation()
+{
+	try {
+		Instrumentation::instance().reset();
+		return new DataHandle;
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSIRF_setTracing(int on)
+{
+	try {
+		Instrumentation::instance().set_tracing(on != 0);
+		return new DataHandle;
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSIRF_writeTrace(const char* filename)
+{
+	try {
+		Instrumentation::instance().write_trace(filename);
+		return new DataHandle;
+	}
+	CATCH;
+}
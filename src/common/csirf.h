@@ -49,6 +49,16 @@ void* cSIRF_clone(void* ptr_x);
 // DataHandleVector methods
 void* cSIRF_DataHandleVector_push_back(void* self, void* to_append);
 
+// Thread pool control
+void* cSIRF_setNumThreads(int num_threads);
+void* cSIRF_numThreads();
+
+// Instrumentation
+void* cSIRF_instrumentation();
+void* cSIRF_resetInstrumentation();
+void* cSIRF_setTracing(int on);
+void* cSIRF_writeTrace(const char* filename);
+
 #ifndef CSIRF_FOR_MATLAB
 }
 #endif
@@ -3,8 +3,11 @@
 #ifndef SIRF_GETENV
 #define SIRF_GETENV
 
+#include <cstdlib>
+#include <string>
+
 namespace sirf {
-	std::string getenv(const char* name)
+	inline std::string getenv(const char* name)
 	{
 		const char* value = std::getenv(name);
 		std::string s;
@@ -14,4 +17,4 @@ namespace sirf {
 	}
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,176 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#ifndef SIRF_INSTRUMENTATION_TYPES
+#define SIRF_INSTRUMENTATION_TYPES
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*!
+\ingroup Common
+\brief Timers and counters for the hot paths of SIRF.
+
+Code is instrumented with the macros SIRF_TIMER(name), which times the rest
+of the enclosing scope (name must be a string literal), and
+SIRF_COUNT(counter, n), which adds n to one of the counters listed in
+Instrumentation::Counter. Both expand to nothing unless SIRF is configured
+with SIRF_INSTRUMENTATION=ON (the default).
+
+Each timer call site is given a number on first execution, and timings are
+accumulated per thread, so that timed scopes in parallel loops do not
+contend for a common lock; the per-thread statistics are merged when
+reported. Accumulated statistics (number of calls and total, minimal and
+maximal time per timer name, counter values) are reported as JSON by
+Instrumentation::json() (C interface: cSIRF_instrumentation). If tracing is
+on, each timed scope is also recorded as an event, and the events can be
+written as a Chrome trace file (viewable at chrome://tracing or in Perfetto).
+Tracing is off by default; setting the environment variable SIRF_TRACE_FILE
+switches it on and writes the trace to the specified file at exit.
+*/
+
+#ifdef SIRF_INSTRUMENTATION
+#define SIRF_CONCAT_(A, B) A##B
+#define SIRF_CONCAT(A, B) SIRF_CONCAT_(A, B)
+#define SIRF_TIMER(NAME) \
+	static const int SIRF_CONCAT(sirf_timer_id_, __LINE__) = \
+		sirf::Instrumentation::instance().timer_id(NAME); \
+	sirf::ScopedTimer SIRF_CONCAT(sirf_scoped_timer_, __LINE__) \
+		(SIRF_CONCAT(sirf_timer_id_, __LINE__))
+#define SIRF_COUNT(COUNTER, N) sirf::Instrumentation::instance().add\
+	(sirf::Instrumentation::COUNTER, (unsigned long long)(N))
+#else
+#define SIRF_TIMER(NAME)
+#define SIRF_COUNT(COUNTER, N)
+#endif
+
+namespace sirf {
+
+	class Instrumentation {
+	public:
+		enum Counter {
+			BYTES_MOVED, // copied between SIRF and client arrays or files
+			FFTS,
+			FORWARD_PROJECTIONS,
+			BACK_PROJECTIONS,
+			HDF5_READS,
+			SCRATCH_FILES,
+			LISTMODE_RECORDS,
+			NUM_COUNTERS
+		};
+		typedef std::chrono::steady_clock Clock;
+
+		static Instrumentation& instance();
+
+		void add(Counter c, unsigned long long n = 1)
+		{
+			counters_[c].fetch_add(n, std::memory_order_relaxed);
+		}
+		unsigned long long count(Counter c) const
+		{
+			return counters_[c].load(std::memory_order_relaxed);
+		}
+		static const char* counter_name(Counter c);
+
+		/// number of the timer called name (a string literal)
+		int timer_id(const char* name);
+		/// accounts for one execution of the scope timed by timer id
+		void record(int id, Clock::time_point start, Clock::time_point stop);
+
+		bool tracing() const
+		{
+			return tracing_.load(std::memory_order_relaxed);
+		}
+		void set_tracing(bool on)
+		{
+			tracing_ = on;
+		}
+
+		/// statistics collected so far, as a JSON object
+		std::string json() const;
+		/// writes trace events recorded so far in Chrome trace format
+		void write_trace(const std::string& filename) const;
+		/// zeroes counters and discards timer statistics and trace events
+		void reset();
+
+		~Instrumentation();
+
+	private:
+		struct TimerStats {
+			TimerStats() : calls(0), total(0), min(0), max(0) {}
+			unsigned long long calls;
+			double total, min, max; // seconds
+		};
+		// statistics of the timers run by one thread
+		struct ThreadTimers {
+			// only contended while statistics are reported or reset
+			std::mutex mutex;
+			std::vector<TimerStats> stats;
+		};
+		struct TraceEvent {
+			const char* name;
+			double start, duration; // microseconds since epoch_
+			int thread;
+		};
+		// limits the memory taken by trace events
+		enum { MAX_TRACE_EVENTS = 1 << 20 };
+
+		Instrumentation();
+		Instrumentation(const Instrumentation&);
+		Instrumentation& operator=(const Instrumentation&);
+
+		ThreadTimers& thread_timers_();
+
+		std::atomic<unsigned long long> counters_[NUM_COUNTERS];
+		std::atomic<bool> tracing_;
+		std::string trace_file_;
+		Clock::time_point epoch_;
+		// guards the members below
+		mutable std::mutex mutex_;
+		std::map<std::string, int> timer_ids_;
+		std::vector<const char*> timer_names_;
+		std::vector<std::unique_ptr<ThreadTimers> > threads_;
+		std::vector<TraceEvent> events_;
+	};
+
+	/// Times the scope it is created in (use via SIRF_TIMER).
+	class ScopedTimer {
+	public:
+		explicit ScopedTimer(int id) :
+			id_(id), start_(Instrumentation::Clock::now())
+		{}
+		~ScopedTimer()
+		{
+			Instrumentation::instance().record
+				(id_, start_, Instrumentation::Clock::now());
+		}
+	private:
+		int id_;
+		Instrumentation::Clock::time_point start_;
+	};
+
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#ifndef SIRF_PROCESS_POOL
+#define SIRF_PROCESS_POOL
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/*!
+\ingroup Common
+\brief Worker processes forked from the calling process.
+
+For computations to be spread over the cores of one host by processes
+rather than threads (e.g. when the multi-threading of the libraries used
+covers only part of the computation). No MPI or other services are needed.
+
+The workers are created by fork(), and hence start with a copy of the whole
+state of the calling process, which they can read without any transfer.
+Data that changes between commands (e.g. the current image estimate and
+the partial results) is exchanged via a block of POSIX shared memory mapped
+by all processes. The calling process sends commands (integers) to the
+workers, each of which then calls task(worker, command, shared) and reports
+back; run() returns when all workers have done so. The task is given the
+address of the shared memory, as the pool is not yet constructed when the
+workers are forked.
+
+In the workers, the SIRF thread pool runs loops serially (threads are not
+inherited by fork()); if STIR is built with OpenMP, OMP_NUM_THREADS=1 is
+advisable, as the GNU OpenMP runtime may hang in a child of a process that
+has used it. The threads of the SIRF thread pool are stopped while the
+workers are forked (see ThreadPool::without_threads), so that no lock can be
+inherited held by them; other threads of the calling process must not hold
+locks the workers need. Available on POSIX systems only.
+*/
+
+namespace sirf {
+
+	class ProcessPool {
+	public:
+		typedef std::function<void(int worker, int command, void* shared)> Task;
+
+		/*!
+		\brief Forks num_workers workers and maps shared_size bytes of
+		zero-initialised shared memory.
+
+		Throws if the processes or shared memory cannot be created.
+		*/
+		ProcessPool(int num_workers, size_t shared_size, const Task& task);
+		/// stops the workers and releases the shared memory
+		~ProcessPool();
+
+		/// true if worker processes are supported on this platform
+		static bool available();
+
+		int num_workers() const
+		{
+			return (int)pids_.size();
+		}
+		/// the memory shared with the workers
+		void* shared_memory()
+		{
+			return shared_;
+		}
+		size_t shared_size() const
+		{
+			return shared_size_;
+		}
+		/*!
+		\brief Has all workers run the task for command (>= 0).
+
+		Returns when all have finished. If the task threw in a worker, or a
+		worker has terminated, throws an exception with the worker's
+		message, after all other workers have finished.
+		*/
+		void run(int command);
+
+	private:
+		ProcessPool(const ProcessPool&);
+		ProcessPool& operator=(const ProcessPool&);
+
+		void stop_();
+		static void worker_(int worker, int channel, void* shared,
+			const Task& task);
+
+		std::vector<int> pids_;
+		// socket connected to each worker
+		std::vector<int> channels_;
+		void* shared_;
+		size_t shared_size_;
+	};
+
+}
+
+#endif
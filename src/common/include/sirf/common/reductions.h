@@ -0,0 +1,231 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#ifndef SIRF_REDUCTIONS
+#define SIRF_REDUCTIONS
+
+#include <algorithm>
+#include <complex>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/*!
+\ingroup Data Container
+\brief Accurate and reproducible sums used by DataContainer::dot and norm.
+
+Sums are computed in double precision by pairwise summation: the range
+is split into blocks of fixed size, each block is summed recursively
+(with several independent accumulators at the bottom level, which the
+compiler can vectorise), and the block sums are then summed pairwise.
+Blocks are processed by the threads of ThreadPool, but since the splitting does not
+depend on the number of threads and block sums are combined in a fixed
+order, the result is the same for any number of threads.
+*/
+
+namespace sirf {
+
+	class Reductions {
+	public:
+		/// number of terms in a block processed by one task
+		static const size_t BLOCK_SIZE = 1 << 14;
+		/// total work (in terms) below which sums are computed serially
+		static const size_t MIN_PARALLEL_WORK = 1 << 17;
+
+		/*!
+		\brief Calls task(i) for i = 0, ..., n - 1, possibly concurrently.
+
+		Tasks are run on the SIRF thread pool (see ThreadPool) and have all
+		completed on return. An exception thrown by a task is re-thrown in
+		the calling thread.
+		*/
+		static void run(size_t n, const std::function<void(size_t)>& task);
+		/// maximal number of threads used by run()
+		static int num_threads();
+
+		/*!
+		\brief Serial pairwise sum of term(i), i = begin, ..., end - 1.
+
+		R is the accumulator type (double or std::complex<double>).
+		*/
+		template<typename R, class Term>
+		static R pairwise_sum(size_t begin, size_t end, const Term& term)
+		{
+			const size_t BASE = 64;
+			size_t n = end - begin;
+			if (n > BASE) {
+				size_t m = begin + n / 2;
+				return pairwise_sum<R>(begin, m, term)
+					+ pairwise_sum<R>(m, end, term);
+			}
+			R s[4] = { R(0), R(0), R(0), R(0) };
+			size_t i = begin;
+			for (; i + 4 <= end; i += 4) {
+				s[0] += term(i);
+				s[1] += term(i + 1);
+				s[2] += term(i + 2);
+				s[3] += term(i + 3);
+			}
+			for (; i < end; i++)
+				s[0] += term(i);
+			return (s[0] + s[1]) + (s[2] + s[3]);
+		}
+
+		/// Serial pairwise sum of the items of a vector.
+		template<typename R>
+		static R pairwise_sum(const std::vector<R>& v)
+		{
+			const R* p = v.data();
+			return pairwise_sum<R>(0, v.size(), [p](size_t i) { return p[i]; });
+		}
+
+		/*!
+		\brief Sum of term(i), i = 0, ..., n - 1, computed blockwise in parallel.
+
+		term must be safe to call concurrently.
+		*/
+		template<typename R, class Term>
+		static R blocked_sum(size_t n, const Term& term)
+		{
+			if (n <= BLOCK_SIZE)
+				return pairwise_sum<R>(0, n, term);
+			size_t nb = (n - 1) / BLOCK_SIZE + 1;
+			std::vector<R> partial(nb);
+			R* p = partial.data();
+			task_(n >= MIN_PARALLEL_WORK, nb,
+				[n, p, &term](size_t b) {
+				size_t begin = b*BLOCK_SIZE;
+				size_t end = std::min(n, begin + BLOCK_SIZE);
+				p[b] = pairwise_sum<R>(begin, end, term);
+			});
+			return pairwise_sum(partial);
+		}
+
+		/*!
+		\brief Sum of item_sum(k), k = 0, ..., n - 1, computed in parallel.
+
+		For data stored as a collection of separate arrays (rows of a STIR
+		array, images in a container): item_sum(k) is expected to return
+		the (serial pairwise) sum over k-th array. work is the total number
+		of terms, used to decide whether threads are worth starting.
+		*/
+		template<typename R, class ItemSum>
+		static R sum_of_items(size_t n, size_t work, const ItemSum& item_sum)
+		{
+			std::vector<R> partial(n);
+			R* p = partial.data();
+			task_(work >= MIN_PARALLEL_WORK, n,
+				[p, &item_sum](size_t k) { p[k] = item_sum(k); });
+			return pairwise_sum(partial);
+		}
+
+		/// Sum of x[i]*y[i].
+		template<typename T>
+		static double dot(const T* x, const T* y, size_t n)
+		{
+			return blocked_sum<double>(n,
+				[x, y](size_t i) { return double(x[i])*double(y[i]); });
+		}
+		/// Sum of x[i]*x[i].
+		template<typename T>
+		static double sum_sq(const T* x, size_t n)
+		{
+			return blocked_sum<double>(n,
+				[x](size_t i) { double t = x[i]; return t*t; });
+		}
+		/// Serial versions of the above for use inside item sums.
+		template<typename T>
+		static double serial_dot(const T* x, const T* y, size_t n)
+		{
+			return pairwise_sum<double>(0, n,
+				[x, y](size_t i) { return double(x[i])*double(y[i]); });
+		}
+		template<typename T>
+		static double serial_sum_sq(const T* x, size_t n)
+		{
+			return pairwise_sum<double>(0, n,
+				[x](size_t i) { double t = x[i]; return t*t; });
+		}
+
+		/// Sum of conj(y[i])*x[i] (SIRF convention for complex dot product).
+		template<typename T>
+		static std::complex<double>
+			cdot(const std::complex<T>* x, const std::complex<T>* y, size_t n)
+		{
+			return blocked_sum< std::complex<double> >(n,
+				[x, y](size_t i) { return conj_mult(x[i], y[i]); });
+		}
+		/// Sum of |x[i]|^2.
+		template<typename T>
+		static double csum_sq(const std::complex<T>* x, size_t n)
+		{
+			return blocked_sum<double>(n,
+				[x](size_t i) { return abs_sq(x[i]); });
+		}
+		template<typename T>
+		static std::complex<double>
+			serial_cdot(const std::complex<T>* x, const std::complex<T>* y, size_t n)
+		{
+			return pairwise_sum< std::complex<double> >(0, n,
+				[x, y](size_t i) { return conj_mult(x[i], y[i]); });
+		}
+		template<typename T>
+		static double serial_csum_sq(const std::complex<T>* x, size_t n)
+		{
+			return pairwise_sum<double>(0, n,
+				[x](size_t i) { return abs_sq(x[i]); });
+		}
+
+		/// conj(v)*u in double precision (avoids slow complex multiply)
+		template<typename T>
+		static std::complex<double>
+			conj_mult(const std::complex<T>& u, const std::complex<T>& v)
+		{
+			double ur = u.real();
+			double ui = u.imag();
+			double vr = v.real();
+			double vi = v.imag();
+			return std::complex<double>(vr*ur + vi*ui, vr*ui - vi*ur);
+		}
+		template<typename T>
+		static double abs_sq(const std::complex<T>& u)
+		{
+			double ur = u.real();
+			double ui = u.imag();
+			return ur*ur + ui*ui;
+		}
+
+	private:
+		// runs task(i), i = 0, ..., n - 1, serially unless parallel is true
+		static void task_(bool parallel, size_t n,
+			const std::function<void(size_t)>& task)
+		{
+			if (!parallel || n < 2) {
+				for (size_t i = 0; i < n; i++)
+					task(i);
+				return;
+			}
+			run(n, task);
+		}
+	};
+
+}
+
+#endif
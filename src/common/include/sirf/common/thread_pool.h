@@ -0,0 +1,154 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#ifndef SIRF_THREAD_POOL
+#define SIRF_THREAD_POOL
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+\ingroup Common
+\brief Process-wide pool of threads running SIRF parallel loops.
+
+All loops that SIRF itself parallelises are scheduled on this pool, so that
+the total number of threads SIRF uses never exceeds num_threads().
+The default number of threads is taken from the environment variable
+SIRF_NUM_THREADS, or, if it is not set, from OMP_NUM_THREADS (so that SIRF
+and the OpenMP-parallel parts of STIR and NiftyReg are sized consistently),
+or else is the number of hardware threads. It can be changed at run time via
+set_num_threads() or the C interface (cSIRF_setNumThreads); if SIRF is built
+with OpenMP, this also sets the number of OpenMP threads of parallel regions
+subsequently started by the calling thread.
+
+parallel_for() splits the index range evenly between the participating
+threads (the calling thread included); a thread that has finished its part
+takes remaining indices from the end of the other threads' parts.
+A parallel_for() called from inside a task, or while the pool is busy with
+a loop started by another thread, runs serially in the calling thread.
+*/
+
+namespace sirf {
+
+	class ThreadPool {
+	public:
+		static ThreadPool& instance();
+
+		/// maximal number of threads (the calling one included) used by a loop
+		int num_threads() const
+		{
+			return num_threads_.load();
+		}
+		/*!
+		\brief Changes the maximal number of threads.
+
+		n < 1 restores the default (see above).
+		*/
+		void set_num_threads(int n);
+		/// default number of threads as defined by the environment
+		static int default_num_threads();
+
+		/*!
+		\brief Calls task(i) for i = 0, ..., n - 1, possibly concurrently.
+
+		All calls have completed on return. If a task throws, remaining
+		indices are skipped and the exception is re-thrown in the calling
+		thread.
+		*/
+		void parallel_for(size_t n, const std::function<void(size_t)>& task);
+
+		/// true if the calling thread is executing a task of a parallel loop
+		static bool in_parallel_region();
+		/*!
+		\brief Calls f while the pool has no threads but the calling one.
+
+		The worker threads are joined before f is called and restarted
+		after it returns (or throws), so that a process created by fork()
+		in f inherits no thread that may hold a lock. Waits for a loop
+		running in another thread to finish.
+		*/
+		void without_threads(const std::function<void()>& f);
+		/*!
+		\brief To be called in a process created by fork().
+
+		The worker threads of the parent do not exist in the child, whose
+		loops are hence run serially from then on; the number of threads
+		must not be changed in the child.
+		*/
+		void after_fork_in_child();
+
+		~ThreadPool();
+
+	private:
+		struct Job;
+
+		ThreadPool();
+		ThreadPool(const ThreadPool&);
+		ThreadPool& operator=(const ThreadPool&);
+
+		void start_(int n);
+		void stop_();
+		void worker_(int id);
+		static void participate_(Job& job, int id);
+
+		// read by parallel_for() without holding run_mutex_
+		std::atomic<int> num_threads_;
+		std::vector<std::thread> workers_;
+		std::mutex mutex_;
+		std::mutex run_mutex_;
+		std::condition_variable wake_;
+		std::condition_variable done_;
+		Job* job_;
+		unsigned long generation_;
+		int active_;
+		bool stop_requested_;
+	};
+
+	/// shorthand for ThreadPool::instance().parallel_for(n, task)
+	inline void parallel_for(size_t n, const std::function<void(size_t)>& task)
+	{
+		ThreadPool::instance().parallel_for(n, task);
+	}
+
+	/*!
+	\brief Calls task(begin, end) for consecutive blocks of [0, n).
+
+	Blocks have block_size elements (the last one possibly fewer) and are
+	processed by the thread pool.
+	*/
+	inline void parallel_for_blocks(size_t n, size_t block_size,
+		const std::function<void(size_t, size_t)>& task)
+	{
+		size_t nb = (n + block_size - 1) / block_size;
+		parallel_for(nb, [n, block_size, &task](size_t b) {
+			size_t begin = b*block_size;
+			task(begin, std::min(n, begin + block_size));
+		});
+	}
+
+}
+
+#endif
@@ -0,0 +1,246 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "sirf/iUtilities/DataHandle.h"
+#include "sirf/common/getenv.h"
+#include "sirf/common/instrumentation.h"
+
+using namespace sirf;
+
+namespace {
+
+	// small consecutive thread numbers for trace events
+	int thread_number()
+	{
+		static std::atomic<int> threads(0);
+		static thread_local int number = threads++;
+		return number;
+	}
+
+	std::string json_string(const std::string& s)
+	{
+		std::string js = "\"";
+		for (size_t i = 0; i < s.length(); i++) {
+			char c = s[i];
+			if (c == '"' || c == '\\')
+				js += '\\';
+			js += c;
+		}
+		return js + "\"";
+	}
+
+}
+
+Instrumentation&
+Instrumentation::instance()
+{
+	static Instrumentation instrumentation;
+	return instrumentation;
+}
+
+Instrumentation::Instrumentation() : tracing_(false), epoch_(Clock::now())
+{
+	for (int c = 0; c < NUM_COUNTERS; c++)
+		counters_[c] = 0;
+	trace_file_ = sirf::getenv("SIRF_TRACE_FILE");
+	if (trace_file_.length() > 0)
+		tracing_ = true;
+}
+
+Instrumentation::~Instrumentation()
+{
+	if (trace_file_.length() < 1)
+		return;
+	try {
+		write_trace(trace_file_);
+	}
+	catch (...) {
+	}
+}
+
+const char*
+Instrumentation::counter_name(Counter c)
+{
+	switch (c) {
+	case BYTES_MOVED:
+		return "bytes moved";
+	case FFTS:
+		return "FFTs";
+	case FORWARD_PROJECTIONS:
+		return "forward projections";
+	case BACK_PROJECTIONS:
+		return "back projections";
+	case HDF5_READS:
+		return "HDF5 reads";
+	case SCRATCH_FILES:
+		return "scratch files";
+	case LISTMODE_RECORDS:
+		return "listmode records";
+	default:
+		return "unknown";
+	}
+}
+
+int
+Instrumentation::timer_id(const char* name)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::map<std::string, int>::iterator i = timer_ids_.find(name);
+	if (i != timer_ids_.end())
+		return i->second;
+	int id = (int)timer_names_.size();
+	timer_ids_[name] = id;
+	timer_names_.push_back(name);
+	return id;
+}
+
+Instrumentation::ThreadTimers&
+Instrumentation::thread_timers_()
+{
+	// kept by the instance after the thread has finished, so that its
+	// statistics are still reported
+	static thread_local ThreadTimers* timers = 0;
+	if (!timers) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		threads_.push_back(std::unique_ptr<ThreadTimers>(new ThreadTimers));
+		timers = threads_.back().get();
+	}
+	return *timers;
+}
+
+void
+Instrumentation::record(int id, Clock::time_point start,
+	Clock::time_point stop)
+{
+	double t = std::chrono::duration<double>(stop - start).count();
+	{
+		ThreadTimers& timers = thread_timers_();
+		std::lock_guard<std::mutex> lock(timers.mutex);
+		if (timers.stats.size() <= (size_t)id)
+			timers.stats.resize(id + 1);
+		TimerStats& stats = timers.stats[id];
+		if (stats.calls == 0 || t < stats.min)
+			stats.min = t;
+		if (t > stats.max)
+			stats.max = t;
+		stats.total += t;
+		stats.calls++;
+	}
+	if (!tracing())
+		return;
+	int thread = thread_number();
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (events_.size() < MAX_TRACE_EVENTS) {
+		TraceEvent event;
+		event.name = timer_names_[id];
+		event.start = std::chrono::duration<double, std::micro>
+			(start - epoch_).count();
+		event.duration = t*1e6;
+		event.thread = thread;
+		events_.push_back(event);
+	}
+}
+
+std::string
+Instrumentation::json() const
+{
+	std::ostringstream s;
+	s << std::setprecision(9);
+	s << "{\"counters\": {";
+	for (int c = 0; c < NUM_COUNTERS; c++) {
+		if (c)
+			s << ", ";
+		s << json_string(counter_name((Counter)c)) << ": " << count((Counter)c);
+	}
+	s << "}, \"timers\": {";
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::vector<TimerStats> timers(timer_names_.size());
+	for (size_t k = 0; k < threads_.size(); k++) {
+		ThreadTimers& thread = *threads_[k];
+		std::lock_guard<std::mutex> thread_lock(thread.mutex);
+		for (size_t id = 0; id < thread.stats.size(); id++) {
+			const TimerStats& ts = thread.stats[id];
+			if (ts.calls == 0)
+				continue;
+			TimerStats& t = timers[id];
+			if (t.calls == 0 || ts.min < t.min)
+				t.min = ts.min;
+			if (ts.max > t.max)
+				t.max = ts.max;
+			t.total += ts.total;
+			t.calls += ts.calls;
+		}
+	}
+	bool first = true;
+	std::map<std::string, int>::const_iterator i;
+	for (i = timer_ids_.begin(); i != timer_ids_.end(); ++i) {
+		const TimerStats& t = timers[i->second];
+		if (t.calls == 0)
+			continue;
+		if (!first)
+			s << ", ";
+		first = false;
+		s << json_string(i->first) << ": {\"calls\": " << t.calls
+			<< ", \"total\": " << t.total
+			<< ", \"min\": " << t.min
+			<< ", \"max\": " << t.max << "}";
+	}
+	s << "}}";
+	return s.str();
+}
+
+void
+Instrumentation::write_trace(const std::string& filename) const
+{
+	std::ofstream out(filename.c_str());
+	if (!out) {
+		std::string msg = "cannot open trace file " + filename;
+		THROW(msg.c_str());
+	}
+	out << std::fixed << std::setprecision(3);
+	out << "{\"traceEvents\": [\n";
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (size_t i = 0; i < events_.size(); i++) {
+		const TraceEvent& e = events_[i];
+		out << (i ? ",\n" : "") << "{\"name\": " << json_string(e.name)
+			<< ", \"cat\": \"sirf\", \"ph\": \"X\", \"ts\": " << e.start
+			<< ", \"dur\": " << e.duration
+			<< ", \"pid\": 0, \"tid\": " << e.thread << "}";
+	}
+	out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+void
+Instrumentation::reset()
+{
+	for (int c = 0; c < NUM_COUNTERS; c++)
+		counters_[c] = 0;
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (size_t k = 0; k < threads_.size(); k++) {
+		ThreadTimers& thread = *threads_[k];
+		std::lock_guard<std::mutex> thread_lock(thread.mutex);
+		thread.stats.assign(thread.stats.size(), TimerStats());
+	}
+	events_.clear();
+}
@@ -66,6 +66,12 @@ EXPORTED_FUNCTION void* mSIRF_clone(void* ptr_x) {
 EXPORTED_FUNCTION void* mSIRF_DataHandleVector_push_back(void* self, void* to_append) {
 	return cSIRF_DataHandleVector_push_back(self, to_append);
 }
+EXPORTED_FUNCTION void* mSIRF_setNumThreads(int num_threads) {
+	return cSIRF_setNumThreads(num_threads);
+}
+EXPORTED_FUNCTION void* mSIRF_numThreads() {
+	return cSIRF_numThreads();
+}
 #ifndef CSIRF_FOR_MATLAB
 }
 #endif
@@ -45,6 +45,8 @@ EXPORTED_FUNCTION void* mSIRF_divide(const void* ptr_x, const void* ptr_y);
 EXPORTED_FUNCTION void* mSIRF_write(const void* ptr, const char* filename);
 EXPORTED_FUNCTION void* mSIRF_clone(void* ptr_x);
 EXPORTED_FUNCTION void* mSIRF_DataHandleVector_push_back(void* self, void* to_append);
+EXPORTED_FUNCTION void* mSIRF_setNumThreads(int num_threads);
+EXPORTED_FUNCTION void* mSIRF_numThreads();
 #ifndef CSIRF_FOR_MATLAB
 }
 #endif
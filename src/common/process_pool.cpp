@@ -0,0 +1,275 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SIRF_POSIX_PROCESSES
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "sirf/iUtilities/DataHandle.h"
+#include "sirf/common/process_pool.h"
+#include "sirf/common/thread_pool.h"
+
+using namespace sirf;
+
+#ifdef SIRF_POSIX_PROCESSES
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace {
+
+	const int STOP = -1;
+
+	// worker's report on a command
+	struct Reply {
+		int status;
+		char message[512];
+	};
+
+	// Workers are connected by socket pairs rather than pipes, so that
+	// sending to a worker that has terminated fails rather than raising
+	// SIGPIPE in the calling process.
+	bool send_all(int fd, const void* data, size_t size)
+	{
+		const char* p = (const char*)data;
+		while (size > 0) {
+			ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			p += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	bool receive_all(int fd, void* data, size_t size)
+	{
+		char* p = (char*)data;
+		while (size > 0) {
+			ssize_t n = recv(fd, p, size, 0);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			p += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	void* map_shared_memory(size_t size)
+	{
+		// the name is removed once mapped: the memory is released when
+		// the last process unmaps it, even if the processes are killed
+		static std::atomic<int> count(0);
+		std::ostringstream name;
+		name << "/sirf_" << getpid() << '_' << count++;
+		int fd = shm_open(name.str().c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd < 0)
+			THROW("cannot create shared memory");
+		void* ptr = MAP_FAILED;
+		if (ftruncate(fd, size) == 0)
+			ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		shm_unlink(name.str().c_str());
+		if (ptr == MAP_FAILED)
+			THROW("cannot map shared memory");
+		return ptr;
+	}
+
+}
+
+bool
+ProcessPool::available()
+{
+	return true;
+}
+
+ProcessPool::ProcessPool(int num_workers, size_t shared_size,
+	const Task& task) : shared_(0), shared_size_(shared_size)
+{
+	if (num_workers < 1)
+		THROW("at least one worker process is needed");
+	if (ThreadPool::in_parallel_region())
+		THROW("cannot start worker processes inside a parallel loop");
+	shared_ = map_shared_memory(std::max(shared_size, (size_t)1));
+	// no thread of the pool runs while the workers are forked
+	ThreadPool::instance().without_threads([&]() {
+		for (int w = 0; w < num_workers; w++) {
+			int fds[2];
+			if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+				stop_();
+				THROW("cannot create a channel to a worker process");
+			}
+			pid_t pid = fork();
+			if (pid == 0) {
+				// close the channels of the other workers
+				for (size_t i = 0; i < channels_.size(); i++)
+					close(channels_[i]);
+				close(fds[0]);
+				worker_(w, fds[1], shared_, task);
+			}
+			close(fds[1]);
+#ifdef SO_NOSIGPIPE
+			int on = 1;
+			setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+			if (pid < 0) {
+				close(fds[0]);
+				stop_();
+				THROW("cannot create a worker process");
+			}
+			pids_.push_back(pid);
+			channels_.push_back(fds[0]);
+		}
+	});
+}
+
+ProcessPool::~ProcessPool()
+{
+	stop_();
+}
+
+void
+ProcessPool::worker_(int worker, int channel, void* shared,
+	const Task& task)
+{
+	ThreadPool::instance().after_fork_in_child();
+	int command;
+	while (receive_all(channel, &command, sizeof(command)) && command != STOP) {
+		Reply reply;
+		reply.status = 0;
+		reply.message[0] = 0;
+		try {
+			task(worker, command, shared);
+		}
+		catch (const std::exception& e) {
+			reply.status = 1;
+			strncpy(reply.message, e.what(), sizeof(reply.message) - 1);
+			reply.message[sizeof(reply.message) - 1] = 0;
+		}
+		catch (...) {
+			reply.status = 1;
+			strcpy(reply.message, "unknown exception");
+		}
+		if (!send_all(channel, &reply, sizeof(reply)))
+			break;
+	}
+	// no destructors or exit handlers of the calling process' objects
+	_exit(0);
+}
+
+void
+ProcessPool::run(int command)
+{
+	if (command < 0)
+		THROW("negative commands are reserved");
+	std::vector<bool> sent(channels_.size());
+	for (size_t w = 0; w < channels_.size(); w++)
+		sent[w] = send_all(channels_[w], &command, sizeof(command));
+	std::string error;
+	for (size_t w = 0; w < channels_.size(); w++) {
+		Reply reply;
+		if (!sent[w] || !receive_all(channels_[w], &reply, sizeof(reply))) {
+			if (error.length() < 1) {
+				std::ostringstream msg;
+				msg << "worker process " << pids_[w] << " terminated";
+				error = msg.str();
+			}
+			continue;
+		}
+		if (reply.status != 0 && error.length() < 1)
+			error = std::string("worker process failed: ") + reply.message;
+	}
+	if (error.length() > 0)
+		THROW(error.c_str());
+}
+
+void
+ProcessPool::stop_()
+{
+	const int stop = STOP;
+	for (size_t w = 0; w < channels_.size(); w++) {
+		send_all(channels_[w], &stop, sizeof(stop));
+		close(channels_[w]);
+	}
+	for (size_t w = 0; w < pids_.size(); w++)
+		while (waitpid(pids_[w], 0, 0) < 0 && errno == EINTR)
+			;
+	channels_.clear();
+	pids_.clear();
+	if (shared_)
+		munmap(shared_, std::max(shared_size_, (size_t)1));
+	shared_ = 0;
+}
+
+#else
+
+bool
+ProcessPool::available()
+{
+	return false;
+}
+
+ProcessPool::ProcessPool(int num_workers, size_t shared_size,
+	const Task& task) : shared_(0), shared_size_(shared_size)
+{
+	THROW("worker processes are not supported on this platform");
+}
+
+ProcessPool::~ProcessPool()
+{
+}
+
+void
+ProcessPool::run(int command)
+{
+}
+
+void
+ProcessPool::stop_()
+{
+}
+
+void
+ProcessPool::worker_(int worker, int channel, void* shared,
+	const Task& task)
+{
+}
+
+#endif
@@ -0,0 +1,36 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "sirf/common/reductions.h"
+#include "sirf/common/thread_pool.h"
+
+using namespace sirf;
+
+int
+Reductions::num_threads()
+{
+	return ThreadPool::instance().num_threads();
+}
+
+void
+Reductions::run(size_t n, const std::function<void(size_t)>& task)
+{
+	ThreadPool::instance().parallel_for(n, task);
+}
@@ -0,0 +1,278 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <cstdlib>
+#include <exception>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "sirf/iUtilities/DataHandle.h"
+#include "sirf/common/getenv.h"
+#include "sirf/common/thread_pool.h"
+
+using namespace sirf;
+
+namespace {
+
+	thread_local bool in_task = false;
+
+	// index range owned by one participant of a loop
+	struct Range {
+		Range() : begin(0), end(0) {}
+		std::mutex mutex;
+		size_t begin;
+		size_t end;
+	};
+
+	int num_threads_from_env(const char* name)
+	{
+		std::string value = sirf::getenv(name);
+		if (value.length() < 1)
+			return 0;
+		// OMP_NUM_THREADS may be a list for nested levels: use the first item
+		int n = std::atoi(value.c_str());
+		return n > 0 ? n : 0;
+	}
+
+}
+
+struct ThreadPool::Job {
+	Job(size_t n, int np, const std::function<void(size_t)>& t) :
+		task(t), ranges(np)
+	{
+		for (int i = 0; i < np; i++) {
+			ranges[i].begin = n*i / np;
+			ranges[i].end = n*(i + 1) / np;
+		}
+	}
+	// claims the next index of range r from the front (own range)
+	// or from the back (stealing); returns false if r is exhausted
+	bool claim(int r, bool steal, size_t& i)
+	{
+		Range& range = ranges[r];
+		std::lock_guard<std::mutex> lock(range.mutex);
+		if (range.begin >= range.end)
+			return false;
+		i = steal ? --range.end : range.begin++;
+		return true;
+	}
+	void cancel()
+	{
+		for (size_t r = 0; r < ranges.size(); r++) {
+			std::lock_guard<std::mutex> lock(ranges[r].mutex);
+			ranges[r].end = ranges[r].begin;
+		}
+	}
+	const std::function<void(size_t)>& task;
+	std::vector<Range> ranges;
+	std::mutex error_mutex;
+	std::exception_ptr error;
+};
+
+ThreadPool&
+ThreadPool::instance()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+ThreadPool::ThreadPool() :
+	num_threads_(1), job_(0), generation_(0), active_(0),
+	stop_requested_(false)
+{
+	start_(default_num_threads());
+}
+
+ThreadPool::~ThreadPool()
+{
+	stop_();
+}
+
+int
+ThreadPool::default_num_threads()
+{
+	int n = num_threads_from_env("SIRF_NUM_THREADS");
+	if (n < 1)
+		n = num_threads_from_env("OMP_NUM_THREADS");
+	if (n < 1)
+		n = std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+bool
+ThreadPool::in_parallel_region()
+{
+	return in_task;
+}
+
+void
+ThreadPool::set_num_threads(int n)
+{
+	if (in_task)
+		THROW("cannot change the number of threads inside a parallel loop");
+	if (n < 1)
+		n = default_num_threads();
+#ifdef _OPENMP
+	omp_set_num_threads(n);
+#endif
+	std::lock_guard<std::mutex> run_lock(run_mutex_);
+	if (n == num_threads_)
+		return;
+	stop_();
+	start_(n);
+}
+
+void
+ThreadPool::without_threads(const std::function<void()>& f)
+{
+	if (in_task)
+		THROW("cannot stop the threads inside a parallel loop");
+	std::lock_guard<std::mutex> run_lock(run_mutex_);
+	int n = num_threads_;
+	stop_();
+	num_threads_ = 1;
+	try {
+		f();
+	}
+	catch (...) {
+		start_(n);
+		throw;
+	}
+	start_(n);
+}
+
+void
+ThreadPool::after_fork_in_child()
+{
+	// joining the handles of the parent's threads would fail, hence they
+	// are abandoned
+	new std::vector<std::thread>(std::move(workers_));
+	workers_.clear();
+	num_threads_ = 1;
+}
+
+void
+ThreadPool::start_(int n)
+{
+	stop_requested_ = false;
+	num_threads_ = n;
+	for (int i = 1; i < n; i++)
+		workers_.push_back(std::thread(&ThreadPool::worker_, this, i));
+}
+
+void
+ThreadPool::stop_()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_requested_ = true;
+	}
+	wake_.notify_all();
+	for (size_t i = 0; i < workers_.size(); i++)
+		workers_[i].join();
+	workers_.clear();
+}
+
+void
+ThreadPool::worker_(int id)
+{
+	unsigned long seen = 0;
+	for (;;) {
+		Job* job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			wake_.wait(lock, [this, seen]() {
+				return stop_requested_ || (job_ && generation_ != seen);
+			});
+			if (stop_requested_)
+				return;
+			seen = generation_;
+			job = job_;
+			active_++;
+		}
+		participate_(*job, id);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			active_--;
+		}
+		done_.notify_all();
+	}
+}
+
+void
+ThreadPool::participate_(Job& job, int id)
+{
+	in_task = true;
+	int np = (int)job.ranges.size();
+	try {
+		size_t i;
+		if (id < np)
+			while (job.claim(id, false, i))
+				job.task(i);
+		for (int k = 0; k < np; k++) {
+			int r = (id + k) % np;
+			while (job.claim(r, true, i))
+				job.task(i);
+		}
+	}
+	catch (...) {
+		{
+			std::lock_guard<std::mutex> lock(job.error_mutex);
+			if (!job.error)
+				job.error = std::current_exception();
+		}
+		job.cancel();
+	}
+	in_task = false;
+}
+
+void
+ThreadPool::parallel_for(size_t n, const std::function<void(size_t)>& task)
+{
+	std::unique_lock<std::mutex> run_lock(run_mutex_, std::defer_lock);
+	int nt = num_threads_.load();
+	if (n < 2 || nt < 2 || in_task || !run_lock.try_lock()) {
+		for (size_t i = 0; i < n; i++)
+			task(i);
+		return;
+	}
+	// the pool may have been resized before the lock was taken
+	nt = num_threads_.load();
+	int np = (int)std::min(n, (size_t)nt);
+	Job job(n, np, task);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		job_ = &job;
+		generation_++;
+	}
+	wake_.notify_all();
+	participate_(job, 0);
+	{
+		// all indices have been claimed: let running workers finish
+		// and stop others from joining
+		std::unique_lock<std::mutex> lock(mutex_);
+		job_ = 0;
+		done_.wait(lock, [this]() { return active_ == 0; });
+	}
+	if (job.error)
+		std::rethrow_exception(job.error);
+}
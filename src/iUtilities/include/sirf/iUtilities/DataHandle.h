@@ -31,6 +31,7 @@ limitations under the License.
 #define DATA_HANDLE_TYPES
 
 #include <stdlib.h>
+#include <new>
 #include <string>
 #include <vector>
 
@@ -41,27 +42,23 @@ limitations under the License.
 #define THROW(msg) throw LocalisedException(msg, __FILE__, __LINE__)
 #define CATCH \
 	catch (LocalisedException& se) {\
-		ExecutionStatus status(se);\
 		DataHandle* handle = new DataHandle;\
-		handle->set(0, &status);\
+		handle->set_status(se.what(), se.file(), se.line());\
 		return (void*)handle;\
 				}\
 	catch (std::string msg) {\
-		ExecutionStatus status(msg.c_str(), __FILE__, __LINE__);\
 		DataHandle* handle = new DataHandle;\
-		handle->set(0, &status);\
+		handle->set_status(msg.c_str(), __FILE__, __LINE__);\
 		return (void*)handle;\
         }\
     catch (const std::exception &error) {\
-        ExecutionStatus status(error.what(), __FILE__, __LINE__);\
         DataHandle* handle = new DataHandle;\
-        handle->set(0, &status);\
+        handle->set_status(error.what(), __FILE__, __LINE__);\
         return (void*)handle;\
         }\
 	catch (...) {\
-		ExecutionStatus status("unhandled", __FILE__, __LINE__);\
 		DataHandle* handle = new DataHandle;\
-		handle->set(0, &status);\
+		handle->set_status("unhandled", __FILE__, __LINE__);\
 		return (void*)handle;\
 				}\
 
@@ -118,6 +115,89 @@ private:
 	}
 };
 
+/*!
+\ingroup C Interface to C++ Objects
+\brief Thread-local free list of handle-sized memory blocks.
+
+Every C interface call returns a new DataHandle (or ObjectHandle), which the
+caller deletes shortly afterwards, so in tight loops (e.g. computing norms or
+reading parameters from Python) most of the time is spent in the allocator.
+Blocks released by a thread are kept for re-use by the same thread. All blocks
+have the same size and come from the global operator new, hence a block
+allocated by one thread (or shared library) may be released by another.
+*/
+class DataHandleBlockPool {
+public:
+	enum { BLOCK_SIZE = 96, MAX_FREE_BLOCKS = 1024 };
+	static void* allocate(size_t size)
+	{
+		if (size > BLOCK_SIZE)
+			return ::operator new(size);
+		FreeList& list = free_list();
+		if (list.head) {
+			Block* block = list.head;
+			list.head = block->next;
+			list.count--;
+			return (void*)block;
+		}
+		return ::operator new(BLOCK_SIZE);
+	}
+	static void deallocate(void* ptr, size_t size)
+	{
+		if (!ptr)
+			return;
+		FreeList& list = free_list();
+		if (size > BLOCK_SIZE || list.closed || list.count >= MAX_FREE_BLOCKS) {
+			::operator delete(ptr);
+			return;
+		}
+		Block* block = (Block*)ptr;
+		block->next = list.head;
+		list.head = block;
+		list.count++;
+	}
+	/// Number of blocks currently cached by the calling thread.
+	static size_t num_free_blocks()
+	{
+		return free_list().count;
+	}
+private:
+	struct Block {
+		Block* next;
+	};
+	// trivially destructible, hence remains usable during thread exit
+	struct FreeList {
+		Block* head;
+		size_t count;
+		bool closed;
+	};
+	// releases cached blocks when the thread exits
+	struct Drain {
+		~Drain()
+		{
+			FreeList& list = list_();
+			list.closed = true;
+			while (list.head) {
+				Block* block = list.head;
+				list.head = block->next;
+				::operator delete((void*)block);
+			}
+			list.count = 0;
+		}
+	};
+	static FreeList& list_()
+	{
+		static thread_local FreeList list = { 0, 0, false };
+		return list;
+	}
+	static FreeList& free_list()
+	{
+		static thread_local Drain drain;
+		(void)drain;
+		return list_();
+	}
+};
+
 /*!
 \ingroup C Interface to C++ Objects
 \brief Basic wrapper for C++ objects.
@@ -126,6 +206,10 @@ A DataHandle object stores data address (void* _data) and the current
 execution status (ExecutionStatus _status).
 SIRF C interface functions work with pointers to DataHandle objects
 cast to void*.
+
+Handles are allocated from DataHandleBlockPool, and small scalar values
+(up to the size of std::complex<double>) are stored inside the handle
+itself rather than in a separately malloc-ed block.
 */
 class DataHandle {
 public:
@@ -135,6 +219,14 @@ public:
 			free(_data);
 		delete _status;
 	}
+	static void* operator new(size_t size)
+	{
+		return DataHandleBlockPool::allocate(size);
+	}
+	static void operator delete(void* ptr, size_t size)
+	{
+		DataHandleBlockPool::deallocate(ptr, size);
+	}
 	void set(void* data, const ExecutionStatus* status = 0, int grab = 0) {
 		if (status) {
 			delete _status;
@@ -145,6 +237,19 @@ public:
 		_data = data;
 		_owns_data = grab != 0;
 	}
+	/// Stores a copy of a small trivially copyable value inside the handle.
+	template<typename T>
+	bool set_value(const T& x)
+	{
+		if (sizeof(T) > sizeof(_value))
+			return false;
+		if (_data && _owns_data)
+			free(_data);
+		new ((void*)_value) T(x);
+		_data = (void*)_value;
+		_owns_data = false;
+		return true;
+	}
 	void set_status(const char* error, const char* file, int line)
 	{
 		if (_status)
@@ -157,6 +262,7 @@ protected:
 	bool _owns_data; // can free _data
 	void* _data; // data address
 	ExecutionStatus* _status; // execution status
+	double _value[2]; // in-place storage for scalar data
 };
 
 #include <boost/shared_ptr.hpp>
@@ -291,12 +397,14 @@ getObjectSptrFromHandle(const void* h, boost::shared_ptr<Object>& sptr) {
 
 Wraps an object of type T into DataHandle.
 The data is owned by the DataHandle object and hence will be deleted by its 
-destructor.
+destructor. Small values are kept inside the handle (see DataHandle::set_value).
 */
 template <typename T>
 void
 setDataHandle(DataHandle* h, T x)
 {
+	if (h->set_value<T>(x))
+		return;
 	T* ptr = (T*)malloc(sizeof(T));
 	*ptr = x;
 	h->set((void*)ptr, 0, GRAB);
@@ -0,0 +1,184 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup C Interface to C++ Objects
+\brief Tests and stress benchmark for DataHandle allocation.
+
+Checks that pooled handles carry scalar data and error status correctly.
+If the number of calls n is given on the command line, also compares the
+per-call cost of creating and deleting a handle holding a scalar result
+against the former allocation scheme (global new for the handle plus
+malloc for the scalar), over n calls.
+
+\author CCP PETMR
+*/
+
+#include <chrono>
+#include <complex>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "sirf/iUtilities/DataHandle.h"
+#include "iutilities.h"
+
+static int failed = 0;
+
+#define CHECK(cond) \
+	if (!(cond)) {\
+		std::cout << "check failed: " << #cond << " (line " << __LINE__ << ")\n";\
+		failed++;\
+	}
+
+// the allocation scheme used before DataHandleBlockPool
+class PlainHandle {
+public:
+	PlainHandle() : _data(0), _owns_data(false), _status(0) {}
+	virtual ~PlainHandle()
+	{
+		if (_data && _owns_data)
+			free(_data);
+	}
+	void set(void* data)
+	{
+		_data = data;
+		_owns_data = true;
+	}
+	void* data() const { return _data; }
+private:
+	void* _data;
+	bool _owns_data;
+	ExecutionStatus* _status;
+};
+
+static void* plain_norm(float x)
+{
+	PlainHandle* h = new PlainHandle;
+	float* ptr = (float*)malloc(sizeof(float));
+	*ptr = x;
+	h->set((void*)ptr);
+	return (void*)h;
+}
+
+static void* throwing_call(int i)
+{
+	try {
+		if (i >= 0)
+			THROW("test error");
+		return dataHandle<int>(i);
+	}
+	CATCH;
+}
+
+static double ns_per_call(std::chrono::steady_clock::time_point t0, int n)
+{
+	std::chrono::duration<double, std::nano> dt =
+		std::chrono::steady_clock::now() - t0;
+	return dt.count() / n;
+}
+
+static void test_values()
+{
+	void* h = floatDataHandle(2.5f);
+	CHECK(floatDataFromHandle(h) == 2.5f);
+	CHECK(executionStatus(h) == 0);
+	deleteDataHandle(h);
+
+	h = doubleDataHandle(-1.25);
+	CHECK(doubleDataFromHandle(h) == -1.25);
+	deleteDataHandle(h);
+
+	std::complex<double> z(1.5, -3.0);
+	DataHandle* dh = (DataHandle*)dataHandle(z);
+	CHECK(dataFromHandle< std::complex<double> >(dh) == z);
+	delete dh;
+
+	h = charDataHandle("pooled");
+	CHECK(strcmp(charDataFromHandle(h), "pooled") == 0);
+	deleteDataHandle(h);
+
+	h = throwing_call(1);
+	CHECK(executionStatus(h) != 0);
+	CHECK(strcmp(executionError(h), "test error") == 0);
+	CHECK(executionErrorLine(h) > 0);
+	deleteDataHandle(h);
+
+	h = throwing_call(-7);
+	CHECK(executionStatus(h) == 0);
+	CHECK(intDataFromHandle(h) == -7);
+	deleteDataHandle(h);
+
+	// handles created in one thread and deleted in another
+	std::vector<void*> handles(1000);
+	std::thread producer([&handles]() {
+		for (size_t i = 0; i < handles.size(); i++)
+			handles[i] = intDataHandle((int)i);
+	});
+	producer.join();
+	for (size_t i = 0; i < handles.size(); i++) {
+		CHECK(intDataFromHandle(handles[i]) == (int)i);
+		deleteDataHandle(handles[i]);
+	}
+	CHECK(DataHandleBlockPool::num_free_blocks() <=
+		(size_t)DataHandleBlockPool::MAX_FREE_BLOCKS);
+}
+
+static void benchmark(int n)
+{
+	double s = 0;
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	for (int i = 0; i < n; i++) {
+		PlainHandle* h = (PlainHandle*)plain_norm((float)(i % 1000));
+		s += *(float*)h->data();
+		delete h;
+	}
+	double t_plain = ns_per_call(t0, n);
+
+	t0 = std::chrono::steady_clock::now();
+	for (int i = 0; i < n; i++) {
+		void* h = floatDataHandle((float)(i % 1000));
+		s -= floatDataFromHandle(h);
+		deleteDataHandle(h);
+	}
+	double t_pooled = ns_per_call(t0, n);
+
+	t0 = std::chrono::steady_clock::now();
+	for (int i = 0; i < n / 10; i++)
+		deleteDataHandle(throwing_call(i));
+	double t_error = ns_per_call(t0, n / 10);
+
+	std::cout << "scalar handle, new + malloc: " << t_plain << " ns/call\n";
+	std::cout << "scalar handle, pooled:       " << t_pooled << " ns/call\n";
+	std::cout << "error handle, pooled:        " << t_error << " ns/call\n";
+	CHECK(s == 0);
+}
+
+int main(int argc, char* argv[])
+{
+	test_values();
+	if (argc > 1)
+		benchmark(atoi(argv[1]));
+	if (failed)
+		std::cout << failed << " check(s) failed\n";
+	return failed ? 1 : 0;
+}
@@ -31,6 +31,7 @@ limitations under the License.
 #include <iomanip>
 
 #include "sirf/Gadgetron/cgadgetron_shared_ptr.h"
+#include "sirf/common/reductions.h"
 #include "sirf/Gadgetron/gadgetron_data_containers.h"
 
 using namespace gadgetron;
@@ -105,6 +106,7 @@ MRAcquisitionData::read( const std::string& filename_ismrmrd_with_ext )
 
 			ISMRMRD::Acquisition acq;
 			d.readAcquisition( i_acqu, acq);
+			SIRF_COUNT(HDF5_READS, 1);
 
 			if( TO_BE_IGNORED(acq) )
 				continue;
@@ -278,27 +280,19 @@ complex_float_t
 MRAcquisitionData::dot
 (const ISMRMRD::Acquisition& acq_a, const ISMRMRD::Acquisition& acq_b)
 {
-	complex_float_t* pa;
-	complex_float_t* pb;
-	complex_float_t z = 0;
-	for (pa = acq_a.data_begin(), pb = acq_b.data_begin();
-		pa != acq_a.data_end() && pb != acq_b.data_end(); pa++, pb++) {
-		z += std::conj(*pb) * (*pa);
-	}
-	return z;
+	size_t n = std::min(acq_a.getNumberOfDataElements(),
+		acq_b.getNumberOfDataElements());
+	std::complex<double> z = Reductions::serial_cdot
+		(acq_a.data_begin(), acq_b.data_begin(), n);
+	return complex_float_t((float)z.real(), (float)z.imag());
 }
 
 float 
 MRAcquisitionData::norm(const ISMRMRD::Acquisition& acq_a)
 {
-	complex_float_t* pa;
-	float r = 0;
-	for (pa = acq_a.data_begin(); pa != acq_a.data_end(); pa++) {
-		complex_float_t z = std::conj(*pa) * (*pa);
-		r += z.real();
-	}
-	r = sqrt(r);
-	return r;
+	double r = Reductions::serial_csum_sq
+		(acq_a.data_begin(), acq_a.getNumberOfDataElements());
+	return (float)sqrt(r);
 }
 
 void
@@ -308,7 +302,7 @@ MRAcquisitionData::dot(const DataContainer& dc, void* ptr) const
 	DYNAMIC_CAST(const MRAcquisitionData, other, dc);
 	int n = number();
 	int m = other.number();
-	complex_float_t z = 0;
+	std::vector< std::complex<double> > z;
 	ISMRMRD::Acquisition a;
 	ISMRMRD::Acquisition b;
 	for (int i = 0, j = 0; i < n && j < m;) {
@@ -322,12 +316,15 @@ MRAcquisitionData::dot(const DataContainer& dc, void* ptr) const
 			j++;
 			continue;
 		}
-		z += MRAcquisitionData::dot(a, b);
+		size_t na = std::min(a.getNumberOfDataElements(),
+			b.getNumberOfDataElements());
+		z.push_back(Reductions::serial_cdot(a.data_begin(), b.data_begin(), na));
 		i++;
 		j++;
 	}
+	std::complex<double> t = Reductions::pairwise_sum(z);
 	complex_float_t* ptr_z = (complex_float_t*)ptr;
-	*ptr_z = z;
+	*ptr_z = complex_float_t((float)t.real(), (float)t.imag());
 }
 
 void
@@ -435,17 +432,17 @@ float
 MRAcquisitionData::norm() const
 {
 	int n = number();
-	float r = 0;
+	std::vector<double> r;
 	ISMRMRD::Acquisition a;
 	for (int i = 0; i < n; i++) {
 		get_acquisition(i, a);
 		if (TO_BE_IGNORED(a)) {
 			continue;
 		}
-		float s = MRAcquisitionData::norm(a);
-		r += s*s;
+		r.push_back(Reductions::serial_csum_sq
+			(a.data_begin(), a.getNumberOfDataElements()));
 	}
-	return sqrt(r);
+	return (float)sqrt(Reductions::pairwise_sum(r));
 }
 
 MRAcquisitionData*
@@ -605,6 +602,7 @@ AcquisitionsFile::get_acquisition(unsigned int num, ISMRMRD::Acquisition& acq) c
 	Mutex mtx;
 	mtx.lock();
 	dataset_->readAcquisition(ind, acq);
+	SIRF_COUNT(HDF5_READS, 1);
 	//dataset_->readAcquisition(index(num), acq); // ??? does not work!
 	mtx.unlock();
 }
@@ -687,14 +685,16 @@ GadgetronImageData::dot(const DataContainer& dc, void* ptr) const
 {
 	//GadgetronImageData& ic = (GadgetronImageData&)dc;
 	DYNAMIC_CAST(const GadgetronImageData, ic, dc);
-	complex_float_t z = 0;
+	std::vector< std::complex<double> > z;
 	for (unsigned int i = 0; i < number() && i < ic.number(); i++) {
 		const ImageWrap& u = image_wrap(i);
 		const ImageWrap& v = ic.image_wrap(i);
-		z += u.dot(v);
+		complex_float_t zi = u.dot(v);
+		z.push_back(std::complex<double>(zi.real(), zi.imag()));
 	}
+	std::complex<double> t = Reductions::pairwise_sum(z);
 	complex_float_t* ptr_z = (complex_float_t*)ptr;
-	*ptr_z = z;
+	*ptr_z = complex_float_t((float)t.real(), (float)t.imag());
 }
 
 void
@@ -755,14 +755,13 @@ const DataContainer& a_y)
 float 
 GadgetronImageData::norm() const
 {
-	float r = 0;
+	std::vector<double> r;
 	for (unsigned int i = 0; i < number(); i++) {
 		const ImageWrap& u = image_wrap(i);
-		float s = u.norm();
-		r += s*s;
+		double s = u.norm();
+		r.push_back(s*s);
 	}
-	r = sqrt(r);
-	return r;
+	return (float)sqrt(Reductions::pairwise_sum(r));
 }
 
 void
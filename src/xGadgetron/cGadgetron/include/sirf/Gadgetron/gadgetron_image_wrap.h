@@ -36,6 +36,7 @@ limitations under the License.
 #include <ismrmrd/xml.h>
 
 #include "sirf/common/ANumRef.h"
+#include "sirf/common/reductions.h"
 #include "sirf/Gadgetron/cgadgetron_shared_ptr.h"
 #include "sirf/Gadgetron/xgadgetron_utilities.h"
 
@@ -629,31 +630,28 @@ namespace sirf {
 		void dot_(const ISMRMRD::Image<T>* ptr_im, complex_float_t *z) const
 		{
 			const ISMRMRD::Image<T>* ptr = (const ISMRMRD::Image<T>*)ptr_;
-			const T* i;
-			const T* j;
-			*z = 0;
-			size_t ii = 0;
+			const T* i = ptr->getDataPtr();
+			const T* j = ptr_im->getDataPtr();
 			size_t n = ptr_im->getNumberOfDataElements();
-			for (i = ptr->getDataPtr(), j = ptr_im->getDataPtr(); ii < n;
-				i++, j++, ii++) {
-				complex_float_t u = (complex_float_t)*i;
-				complex_float_t v = (complex_float_t)*j;
-				*z += std::conj(v) * u;
-			}
+			std::complex<double> s = Reductions::blocked_sum< std::complex<double> >
+				(n, [i, j](size_t k) {
+				complex_float_t u = (complex_float_t)i[k];
+				complex_float_t v = (complex_float_t)j[k];
+				return Reductions::conj_mult(u, v);
+			});
+			*z = complex_float_t((float)s.real(), (float)s.imag());
 		}
 
 		template<typename T>
 		void norm_(const ISMRMRD::Image<T>* ptr, float *r) const
 		{
-			const T* i;
-			*r = 0;
-			size_t ii = 0;
+			const T* i = ptr->getDataPtr();
 			size_t n = ptr->getNumberOfDataElements();
-			for (i = ptr->getDataPtr(); ii < n; i++, ii++) {
-				complex_float_t a = (complex_float_t)*i;
-				*r += std::abs(std::conj(a) * a);
-			}
-			*r = std::sqrt(*r);
+			double s = Reductions::blocked_sum<double>(n, [i](size_t k) {
+				complex_float_t a = (complex_float_t)i[k];
+				return Reductions::abs_sq(a);
+			});
+			*r = (float)std::sqrt(s);
 		}
 
 		template<typename T>
@@ -35,6 +35,7 @@ limitations under the License.
 
 #include <boost/thread/mutex.hpp>
 
+#include "sirf/common/instrumentation.h"
 #include "sirf/Gadgetron/cgadgetron_shared_ptr.h"
 
 namespace sirf {
@@ -55,6 +56,7 @@ namespace sirf {
 			long long int ms = xGadgetronUtilities::milliseconds();
 			calls++;
 			sprintf(buff, "tmp_%d_%lld.h5", calls, ms);
+			SIRF_COUNT(SCRATCH_FILES, 1);
 			return std::string(buff);
 		}
 		template<typename T>
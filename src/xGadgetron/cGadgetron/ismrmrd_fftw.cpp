@@ -42,6 +42,7 @@ IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <fftw3.h>
 
+#include "sirf/common/instrumentation.h"
 #include "sirf/Gadgetron/ismrmrd_fftw.h"
 
 namespace ISMRMRD {
@@ -58,6 +59,8 @@ namespace ISMRMRD {
 
 		size_t elements = a.getDims()[0] * a.getDims()[1];
 		size_t ffts = a.getNumberOfElements() / elements;
+		SIRF_TIMER("fft2c");
+		SIRF_COUNT(FFTS, ffts);
 
 		//Array for transformation
 		fftwf_complex* tmp =
@@ -151,7 +151,9 @@ void* cSTIR_parameter(const void* ptr, const char* obj, const char* name)
 {
 	try {
 		CAST_PTR(DataHandle, handle, ptr);
-		if (boost::iequals(obj, "Shape"))
+		if (boost::iequals(obj, "ListmodeToSinograms"))
+			return cSTIR_listmodeToSinogramsParameter(handle, name);
+		else if (boost::iequals(obj, "Shape"))
 			return cSTIR_shapeParameter(handle, name);
 		else if (boost::iequals(obj, "EllipsoidalCylinder"))
 			return cSTIR_ellipsoidalCylinderParameter(handle, name);
@@ -160,6 +162,8 @@ void* cSTIR_parameter(const void* ptr, const char* obj, const char* name)
 			(handle, name);
 		else if (boost::iequals(obj, "RayTracingMatrix"))
 			return cSTIR_rayTracingMatrixParameter(handle, name);
+		else if (boost::iequals(obj, "AcquisitionModel"))
+			return cSTIR_acquisitionModelParameter(handle, name);
 		else if (boost::iequals(obj, "AcqModUsingMatrix"))
 			return cSTIR_acqModUsingMatrixParameter(handle, name);
 		else if (boost::iequals(obj, "GeneralisedPrior"))
@@ -230,6 +234,24 @@ void* cSTIR_setListmodeToSinogramsInterval(void* ptr_lm2s, size_t ptr_data)
 	CATCH;
 }
 
+extern "C"
+void* cSTIR_setListmodeToSinogramsFrames
+(void* ptr_lm2s, int num_frames, size_t ptr_data)
+{
+	try {
+		ListmodeToSinograms& lm2s =
+			objectFromHandle<ListmodeToSinograms>(ptr_lm2s);
+		double *data = (double *)ptr_data;
+		std::vector<std::pair<double, double> > intervals;
+		for (int f = 0; f < num_frames; f++)
+			intervals.push_back(std::pair<double, double>
+			(data[2 * f], data[2 * f + 1]));
+		lm2s.set_time_frames(intervals);
+		return (void*)new DataHandle;
+	}
+	CATCH;
+}
+
 extern "C"
 void* cSTIR_setListmodeToSinogramsFlag(void* ptr_lm2s, const char* flag, int v)
 {
@@ -278,6 +300,18 @@ void* cSTIR_convertListmodeToSinograms(void* ptr)
 	CATCH;
 }
 
+extern "C"
+void* cSTIR_listmodeToSinogramsFrame(void* ptr, int frame_num, int delayeds)
+{
+	try {
+		ListmodeToSinograms& lm2s = objectFromHandle<ListmodeToSinograms>(ptr);
+		if (delayeds)
+			return newObjectHandle(lm2s.get_delayeds(frame_num));
+		return newObjectHandle(lm2s.get_output(frame_num));
+	}
+	CATCH;
+}
+
 extern "C"
 void* cSTIR_computeRandoms(void* ptr)
 {
@@ -346,12 +380,10 @@ void* cSTIR_chainPETAcquisitionSensitivityModels
 (const void* ptr_first, const void* ptr_second)
 {
 	try {
-		PETAcquisitionSensitivityModel& first =
-			objectFromHandle<PETAcquisitionSensitivityModel>(ptr_first);
-		PETAcquisitionSensitivityModel& second =
-			objectFromHandle<PETAcquisitionSensitivityModel>(ptr_second);
+		SPTR_FROM_HANDLE(PETAcquisitionSensitivityModel, sptr_first, ptr_first);
+		SPTR_FROM_HANDLE(PETAcquisitionSensitivityModel, sptr_second, ptr_second);
 		shared_ptr<PETAcquisitionSensitivityModel> 
-			sptr(new PETAcquisitionSensitivityModel(first, second));
+			sptr(new PETAcquisitionSensitivityModel(sptr_first, sptr_second));
 		return newObjectHandle(sptr);
 	}
 	CATCH;
@@ -445,6 +477,19 @@ void* cSTIR_acquisitionModelFwdReplace
 	CATCH;
 }
 
+extern "C"
+void* cSTIR_acquisitionModelFwdSubsetViews
+(void* ptr_am, void* ptr_im, int subset_num, int num_subsets)
+{
+	try {
+		AcqMod3DF& am = objectFromHandle<AcqMod3DF>(ptr_am);
+		STIRImageData& id = objectFromHandle<STIRImageData>(ptr_im);
+		return newObjectHandle
+			(am.forward_subset_views(id, subset_num, num_subsets));
+	}
+	CATCH;
+}
+
 extern "C"
 void* cSTIR_acquisitionModelBwd(void* ptr_am, void* ptr_ad, 
 	int subset_num, int num_subsets)
@@ -457,6 +502,72 @@ void* cSTIR_acquisitionModelBwd(void* ptr_am, void* ptr_ad,
 	CATCH;
 }
 
+// batches of acquisition data and images are returned as handles to
+// vectors, whose items are then retrieved one by one
+typedef std::vector<shared_ptr<PETAcquisitionData> > AcquisitionDataBatch;
+typedef std::vector<shared_ptr<STIRImageData> > ImageDataBatch;
+
+extern "C"
+void* cSTIR_acquisitionModelFwdBatch
+(void* ptr_am, const void* ptr_images, int subset_num, int num_subsets)
+{
+	try {
+		AcqMod3DF& am = objectFromHandle<AcqMod3DF>(ptr_am);
+		const DataHandleVector& handles =
+			objectFromHandle<const DataHandleVector>(ptr_images);
+		ImageDataBatch images;
+		for (size_t k = 0; k < handles.size(); k++) {
+			SPTR_FROM_HANDLE(STIRImageData, sptr_id, handles[k]);
+			images.push_back(sptr_id);
+		}
+		shared_ptr<AcquisitionDataBatch> sptr_b(new AcquisitionDataBatch
+			(am.forward(images, subset_num, num_subsets)));
+		return newObjectHandle(sptr_b);
+	}
+	CATCH;
+}
+
+extern "C"
+void* cSTIR_acquisitionModelBwdBatch
+(void* ptr_am, const void* ptr_ads, int subset_num, int num_subsets)
+{
+	try {
+		AcqMod3DF& am = objectFromHandle<AcqMod3DF>(ptr_am);
+		const DataHandleVector& handles =
+			objectFromHandle<const DataHandleVector>(ptr_ads);
+		AcquisitionDataBatch ads;
+		for (size_t k = 0; k < handles.size(); k++) {
+			SPTR_FROM_HANDLE(PETAcquisitionData, sptr_ad, handles[k]);
+			ads.push_back(sptr_ad);
+		}
+		shared_ptr<ImageDataBatch> sptr_b(new ImageDataBatch
+			(am.backward(ads, subset_num, num_subsets)));
+		return newObjectHandle(sptr_b);
+	}
+	CATCH;
+}
+
+extern "C"
+void* cSTIR_acquisitionDataBatchItem(const void* ptr_b, int k)
+{
+	try {
+		const AcquisitionDataBatch& b =
+			objectFromHandle<const AcquisitionDataBatch>(ptr_b);
+		return newObjectHandle(b.at(k));
+	}
+	CATCH;
+}
+
+extern "C"
+void* cSTIR_imageDataBatchItem(const void* ptr_b, int k)
+{
+	try {
+		const ImageDataBatch& b = objectFromHandle<const ImageDataBatch>(ptr_b);
+		return newObjectHandle(b.at(k));
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cSTIR_setAcquisitionsStorageScheme(const char* scheme)
@@ -464,6 +575,8 @@ cSTIR_setAcquisitionsStorageScheme(const char* scheme)
 	try {
 		if (scheme[0] == 'f' || strcmp(scheme, "default") == 0)
 			PETAcquisitionDataInFile::set_as_template();
+		else if (strcmp(scheme, "mmap") == 0)
+			PETAcquisitionDataInMappedFile::set_as_template();
 		else
 			PETAcquisitionDataInMemory::set_as_template();
 		return (void*)new DataHandle;
@@ -471,6 +584,17 @@ cSTIR_setAcquisitionsStorageScheme(const char* scheme)
 	CATCH;
 }
 
+extern "C"
+void*
+cSTIR_setAcquisitionsScratchDirectory(const char* dir)
+{
+	try {
+		PETAcquisitionDataInMappedFile::set_scratch_directory(dir);
+		return (void*)new DataHandle;
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cSTIR_getAcquisitionsStorageScheme()
@@ -712,6 +836,38 @@ void* cSTIR_updateReconstruction(void* ptr_r, void* ptr_i)
 	CATCH;
 }
 
+extern "C"
+void* cSTIR_writeReconstructionCheckpoint
+(void* ptr_r, void* ptr_i, const char* dir, int with_matrix)
+{
+	try {
+		STIRImageData& id = objectFromHandle<STIRImageData>(ptr_i);
+		xSTIR_IterativeReconstruction3DF& recon =
+			objectFromHandle<xSTIR_IterativeReconstruction3DF>(ptr_r);
+		recon.write_checkpoint(dir, id.data(), with_matrix != 0);
+		return (void*) new DataHandle;
+	}
+	CATCH;
+}
+
+extern "C"
+void* cSTIR_resumeReconstruction(void* ptr_r, void* ptr_i, const char* dir)
+{
+	try {
+		DataHandle* handle = new DataHandle;
+		STIRImageData& id = objectFromHandle<STIRImageData>(ptr_i);
+		xSTIR_IterativeReconstruction3DF& recon =
+			objectFromHandle<xSTIR_IterativeReconstruction3DF>(ptr_r);
+		if (recon.resume(dir, id.data_sptr()) != Succeeded::yes) {
+			ExecutionStatus status("cSTIR_resumeReconstruction failed",
+				__FILE__, __LINE__);
+			handle->set(0, &status);
+		}
+		return (void*)handle;
+	}
+	CATCH;
+}
+
 extern "C"
 void* cSTIR_setupObjectiveFunction(void* ptr_r, void* ptr_i)
 {
@@ -1061,4 +1217,19 @@ void* cSTIR_setImageData(const void* ptr_im, size_t ptr_data)
 		return new DataHandle;
 	}
 	CATCH;
+}
+
+extern "C"
+void* cSTIR_imageDataView(void* ptr_im, size_t ptr_address)
+{
+	try {
+		STIRImageData& id = objectFromHandle<STIRImageData>(ptr_im);
+		float* data = id.contiguous_data();
+		if (!data)
+			THROW("image data are not stored contiguously");
+		*(size_t*)ptr_address = (size_t)data;
+		// the returned handle keeps the image data alive while viewed
+		return newObjectHandle(id.data_sptr());
+	}
+	CATCH;
 }
\ No newline at end of file
@@ -42,10 +42,13 @@ extern "C" {
 	// ListmodeToSinogram methods
 	void* cSTIR_setListmodeToSinogramsInterval
 		(void* ptr_acq, PTR_FLOAT ptr_data);
+	void* cSTIR_setListmodeToSinogramsFrames
+		(void* ptr_lm2s, int num_frames, PTR_DOUBLE ptr_data);
 	void* cSTIR_setListmodeToSinogramsFlag
 		(void* ptr_lm2s, const char* flag, int v);
 	void* cSTIR_setupListmodeToSinogramsConverter(void* ptr);
 	void* cSTIR_convertListmodeToSinograms(void* ptr);
+	void* cSTIR_listmodeToSinogramsFrame(void* ptr, int frame_num, int delayeds);
 	void* cSTIR_computeRandoms(void* ptr);
 
 	// Data processor methods
@@ -66,12 +69,21 @@ extern "C" {
 		int subset_num, int num_subsets);
 	void* cSTIR_acquisitionModelFwdReplace
 		(void* ptr_am, void* ptr_im, int subset_num, int num_subsets, void* ptr_ad);
+	void* cSTIR_acquisitionModelFwdSubsetViews(void* ptr_am, void* ptr_im,
+		int subset_num, int num_subsets);
 	void* cSTIR_acquisitionModelBwd(void* ptr_am, void* ptr_ad,
 		int subset_num, int num_subsets);
+	void* cSTIR_acquisitionModelFwdBatch(void* ptr_am, const void* ptr_images,
+		int subset_num, int num_subsets);
+	void* cSTIR_acquisitionModelBwdBatch(void* ptr_am, const void* ptr_ads,
+		int subset_num, int num_subsets);
+	void* cSTIR_acquisitionDataBatchItem(const void* ptr_b, int k);
+	void* cSTIR_imageDataBatchItem(const void* ptr_b, int k);
 
 	// Acquisition data methods
 	void* cSTIR_getAcquisitionsStorageScheme();
 	void* cSTIR_setAcquisitionsStorageScheme(const char* scheme);
+	void* cSTIR_setAcquisitionsScratchDirectory(const char* dir);
 	void* cSTIR_acquisitionsDataFromTemplate(void* ptr_t);
 	void* cSTIR_cloneAcquisitionData(void* ptr_ad);
 	void* cSTIR_rebinnedAcquisitionData(void* ptr_t,
@@ -97,6 +109,9 @@ extern "C" {
 	void* cSTIR_setupReconstruction(void* ptr_r, void* ptr_i);
 	void* cSTIR_runReconstruction(void* ptr_r, void* ptr_i);
 	void* cSTIR_updateReconstruction(void* ptr_r, void* ptr_i);
+	void* cSTIR_writeReconstructionCheckpoint
+		(void* ptr_r, void* ptr_i, const char* dir, int with_matrix);
+	void* cSTIR_resumeReconstruction(void* ptr_r, void* ptr_i, const char* dir);
 
 	// Objective function methods
 	void* cSTIR_setupObjectiveFunction(void* ptr_r, void* ptr_i);
@@ -118,6 +133,7 @@ extern "C" {
 	void* cSTIR_getImageTransformMatrix(const void* ptr_im, PTR_FLOAT ptr_md);
 	void* cSTIR_getImageData(const void* ptr, PTR_FLOAT ptr_data);
 	void* cSTIR_setImageData(const void* ptr_im, PTR_FLOAT ptr_data);
+	void* cSTIR_imageDataView(void* ptr_im, size_t ptr_address);
 	void* cSTIR_voxels3DF(int nx, int ny, int nz,
 		float sx, float sy, float sz, float x, float y, float z);
 	void* cSTIR_imageFromVoxels(void* ptr_v);
@@ -96,6 +96,16 @@ sirf::cSTIR_setListmodeToSinogramsParameter(void* hp, const char* name, const vo
 	return new DataHandle;
 }
 
+void*
+sirf::cSTIR_listmodeToSinogramsParameter(const DataHandle* handle, const char* name)
+{
+	ListmodeToSinograms& lm2s = objectFromHandle<ListmodeToSinograms>(handle);
+	if (boost::iequals(name, "num_frames"))
+		return dataHandle<int>(lm2s.num_frames());
+	else
+		return parameterNotFound(name, __FILE__, __LINE__);
+}
+
 void*
 sirf::cSTIR_setShapeParameter(void* hp, const char* name, const void* hv)
 {
@@ -228,11 +238,22 @@ sirf::cSTIR_setAcquisitionModelParameter
 		SPTR_FROM_HANDLE(PETAcquisitionSensitivityModel, sptr_asm, hv);
 		am.set_asm(sptr_asm);
 	}
+	else if (boost::iequals(name, "terms_storage"))
+		am.set_terms_storage(charDataFromHandle(hv));
 	else
 		return parameterNotFound(name, __FILE__, __LINE__);
 	return new DataHandle;
 }
 
+void*
+sirf::cSTIR_acquisitionModelParameter(DataHandle* hp, const char* name)
+{
+	AcqMod3DF& am = objectFromHandle< AcqMod3DF >(hp);
+	if (boost::iequals(name, "terms_storage"))
+		return charDataHandleFromCharData(am.terms_storage().c_str());
+	return parameterNotFound(name, __FILE__, __LINE__);
+}
+
 void*
 sirf::cSTIR_setAcqModUsingMatrixParameter
 (DataHandle* hm, const char* name, const DataHandle* hv)
@@ -242,6 +263,8 @@ sirf::cSTIR_setAcqModUsingMatrixParameter
 		SPTR_FROM_HANDLE(ProjMatrixByBin, sptr_m, hv);
 		am.set_matrix(sptr_m);
 	}
+	else if (boost::iequals(name, "matrix_cache_directory"))
+		am.set_matrix_cache_directory(charDataFromHandle(hv));
 	else
 		return parameterNotFound(name, __FILE__, __LINE__);
 	return new DataHandle;
@@ -254,6 +277,9 @@ sirf::cSTIR_acqModUsingMatrixParameter
 	AcqModUsingMatrix3DF& am = objectFromHandle<AcqModUsingMatrix3DF>(hm);
 	if (boost::iequals(name, "matrix"))
 		return newObjectHandle(am.matrix_sptr());
+	else if (boost::iequals(name, "matrix_cache_directory"))
+		return charDataHandleFromCharData
+			(am.matrix_cache_directory().c_str());
 	else
 		return parameterNotFound(name, __FILE__, __LINE__);
 	return new DataHandle;
@@ -426,6 +452,12 @@ sirf::cSTIR_setPoissonLogLikelihoodWithLinearModelForMeanAndProjDataParameter
 		SPTR_FROM_HANDLE(AcqMod3DF, sptr_am, hv);
 		obj_fun.set_acquisition_model(sptr_am);
 	}
+	else if (boost::iequals(name, "sensitivity_cache_directory"))
+		obj_fun.set_sensitivity_cache_directory(charDataFromHandle(hv));
+	else if (boost::iequals(name, "sensitivity_cache_size"))
+		obj_fun.set_sensitivity_cache_size(dataFromHandle<int>((void*)hv));
+	else if (boost::iequals(name, "num_processes"))
+		obj_fun.set_num_processes(dataFromHandle<int>((void*)hv));
 	else
 		return parameterNotFound(name, __FILE__, __LINE__);
 	return new DataHandle;
@@ -443,6 +475,13 @@ sirf::cSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjDataParameter
 	//	return newObjectHandle(obj_fun.get_projector_pair_sptr());
 	if (boost::iequals(name, "acquisition_model"))
 		return newObjectHandle(obj_fun.acquisition_model_sptr());
+	if (boost::iequals(name, "sensitivity_cache_directory"))
+		return charDataHandleFromCharData
+		(obj_fun.sensitivity_cache_directory().c_str());
+	if (boost::iequals(name, "sensitivity_cache_size"))
+		return dataHandle<int>(obj_fun.sensitivity_cache_size());
+	if (boost::iequals(name, "num_processes"))
+		return dataHandle<int>(obj_fun.num_processes());
 	return parameterNotFound(name, __FILE__, __LINE__);
 }
 
@@ -27,6 +27,8 @@ namespace sirf {
 
 	void*
 		cSTIR_setListmodeToSinogramsParameter(void* hp, const char* name, const void* hv);
+	void*
+		cSTIR_listmodeToSinogramsParameter(const DataHandle* handle, const char* name);
 
 	void*
 		cSTIR_setShapeParameter(void* hp, const char* name, const void* hv);
@@ -52,6 +54,9 @@ namespace sirf {
 		cSTIR_setAcquisitionModelParameter
 		(DataHandle* hp, const char* name, const DataHandle* hv);
 
+	void*
+		cSTIR_acquisitionModelParameter(DataHandle* hp, const char* name);
+
 	void*
 		cSTIR_setAcqModUsingMatrixParameter
 		(DataHandle* hp, const char* name, const DataHandle* hv);
@@ -32,14 +32,22 @@ limitations under the License.
 
 #include <stdlib.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <fstream>
 #include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <boost/interprocess/streams/bufferstream.hpp>
 
 #include "sirf/iUtilities/LocalisedException.h"
 #include "sirf/iUtilities/DataHandle.h"
 #include "sirf/common/DataContainer.h"
 #include "sirf/common/ANumRef.h"
+#include "sirf/common/instrumentation.h"
 #include "sirf/common/PETImageData.h"
 #include "sirf/STIR/stir_types.h"
 #include "sirf/common/GeometricalInfo.h"
@@ -61,6 +69,7 @@ namespace sirf {
 			long long int ms = milliseconds();
 			calls++;
 			sprintf(buff, "tmp_%d_%lld", calls, ms);
+			SIRF_COUNT(SCRATCH_FILES, 1);
 			return std::string(buff);
 		}
 	};
@@ -124,6 +133,317 @@ namespace sirf {
 		std::string _filename;
 	};
 
+	/*!
+	\ingroup STIR Extensions
+	\brief Storage for ProjDataBuffer (constructed before its STIR base).
+	*/
+
+	class ProjDataBufferStorage {
+	protected:
+		ProjDataBufferStorage(size_t size) :
+			_storage(new float[size](), std::default_delete<float[]>()),
+			_size(size)
+		{}
+		ProjDataBufferStorage(std::shared_ptr<float> storage, size_t size) :
+			_storage(storage), _size(size)
+		{}
+		/*!
+		\brief Zero-filled storage in a new file mapped to memory.
+
+		The file is deleted when the storage is released.
+		*/
+		static std::shared_ptr<float>
+			mapped_file(const std::string& filename, size_t size);
+		std::shared_ptr<float> _storage;
+		size_t _size;
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief Projection data held in a contiguous buffer owned by SIRF.
+
+	Same as stir::ProjDataInMemory (data stored in the sinogram order), but
+	the buffer is accessible, which allows PETAcquisitionData algebra to be
+	performed directly on it. The buffer is either allocated on the heap or
+	is a scratch file mapped to memory.
+	*/
+
+	class ProjDataBuffer : private ProjDataBufferStorage,
+		public stir::ProjDataFromStream {
+	public:
+		ProjDataBuffer(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info) :
+			ProjDataBufferStorage(num_elements(*sptr_proj_data_info)),
+			stir::ProjDataFromStream(sptr_exam_info, sptr_proj_data_info,
+			buffer_stream(_storage.get(), _size), 0,
+			stir::ProjDataFromStream::Segment_AxialPos_View_TangPos)
+		{}
+		ProjDataBuffer(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info,
+			const std::string& filename) :
+			ProjDataBufferStorage(mapped_file(filename,
+			num_elements(*sptr_proj_data_info)),
+			num_elements(*sptr_proj_data_info)),
+			stir::ProjDataFromStream(sptr_exam_info, sptr_proj_data_info,
+			buffer_stream(_storage.get(), _size), 0,
+			stir::ProjDataFromStream::Segment_AxialPos_View_TangPos)
+		{}
+		float* buffer()
+		{
+			return _storage.get();
+		}
+		const float* buffer() const
+		{
+			return _storage.get();
+		}
+		size_t size() const
+		{
+			return _size;
+		}
+		static size_t num_elements(const stir::ProjDataInfo& pdi)
+		{
+			size_t n = 0;
+			for (int s = pdi.get_min_segment_num();
+				s <= pdi.get_max_segment_num(); s++)
+				n += pdi.get_num_axial_poss(s);
+			return n*pdi.get_num_views()*pdi.get_num_tangential_poss();
+		}
+	protected:
+		static stir::shared_ptr<std::iostream>
+			buffer_stream(float* buffer, size_t size)
+		{
+			return stir::shared_ptr<std::iostream>
+				(new boost::interprocess::bufferstream((char*)buffer,
+				size*sizeof(float),
+				std::ios::in | std::ios::out | std::ios::binary));
+		}
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief Projection data stored only for the views of one subset.
+
+	Only the views listed on construction (e.g. those of one subset of views
+	as assigned by STIR projectors) are stored, in a buffer in the order
+	segment, view, axial position, tangential position; bins of other views
+	read as zeros. Writing a non-zero value to a bin of another view throws
+	an exception (zeros are accepted, as they do not change the data).
+	*/
+
+	class ProjDataSubsetViews : public stir::ProjData {
+	public:
+		ProjDataSubsetViews(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info,
+			const std::vector<int>& view_nums);
+
+		/// stored views in ascending order
+		const std::vector<int>& view_nums() const
+		{
+			return _view_nums;
+		}
+		bool in_subset(int view_num) const
+		{
+			return _view_index[view_num - get_min_view_num()] >= 0;
+		}
+		/// the stored row of tangential positions, 0 if the view is not stored
+		const float* row(int segment_num, int view_num, int ax_pos_num) const
+		{
+			return in_subset(view_num) ?
+				&_data[offset_(segment_num, view_num, ax_pos_num)] : 0;
+		}
+		float* buffer()
+		{
+			return _data.size() ? &_data[0] : 0;
+		}
+		const float* buffer() const
+		{
+			return _data.size() ? &_data[0] : 0;
+		}
+		size_t size() const
+		{
+			return _data.size();
+		}
+
+		virtual stir::Viewgram<float> get_viewgram(const int view_num,
+			const int segment_num,
+			const bool make_num_tangential_poss_odd = false) const;
+		virtual stir::Succeeded set_viewgram(const stir::Viewgram<float>& v);
+		virtual stir::Sinogram<float> get_sinogram(const int ax_pos_num,
+			const int segment_num,
+			const bool make_num_tangential_poss_odd = false) const;
+		virtual stir::Succeeded set_sinogram(const stir::Sinogram<float>& s);
+		virtual stir::SegmentBySinogram<float>
+			get_segment_by_sinogram(const int segment_num) const;
+		virtual stir::Succeeded
+			set_segment(const stir::SegmentBySinogram<float>& s);
+		using stir::ProjData::set_segment;
+
+	private:
+		// throws if a view outside the subset is to be given non-zero values
+		void check_outside_(const float* row, int n) const;
+		// buffer index of the first tangential position of a view row
+		size_t offset_(int segment_num, int view_num, int ax_pos_num) const
+		{
+			int j = _view_index[view_num - get_min_view_num()];
+			return _segment_offsets[segment_num - get_min_segment_num()] +
+				((size_t)j*get_num_axial_poss(segment_num) + ax_pos_num -
+				get_min_axial_pos_num(segment_num))*_num_tang_poss;
+		}
+		std::vector<int> _view_nums;
+		// position of each view among the stored ones, -1 if not stored
+		std::vector<int> _view_index;
+		int _num_tang_poss;
+		std::vector<size_t> _segment_offsets;
+		std::vector<float> _data;
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief Projection data stored in 16 bits per bin.
+
+	Meant for terms that stay constant during reconstruction (additive,
+	background and normalisation terms), halving the memory they take.
+	Values are converted to and from float on each access. The bins are
+	stored in the sinogram order (as by ProjDataBuffer) in one of the
+	following formats:
+	- HALF: IEEE 754 half precision floating point (about 3 significant
+	digits, values up to 65504 by absolute value; larger values overflow
+	to +/-infinity, so that e.g. the huge inverse efficiencies of dead bins
+	still unnormalise to zero);
+	- SCALED_UINT16: for each row of tangential positions, the values are
+	mapped linearly onto 0, ..., 65535, so that the error is at most
+	1/131070 of the range of the row; rows of integer values whose range
+	does not exceed 65535 (e.g. counts) are stored exactly.
+	*/
+
+	class ProjDataReducedPrecision : public stir::ProjData {
+	public:
+		enum Format { HALF, SCALED_UINT16 };
+
+		ProjDataReducedPrecision(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info,
+			Format format);
+
+		Format format() const
+		{
+			return _format;
+		}
+		/// number of bins stored
+		size_t size() const
+		{
+			return _data.size();
+		}
+
+		virtual stir::Viewgram<float> get_viewgram(const int view_num,
+			const int segment_num,
+			const bool make_num_tangential_poss_odd = false) const;
+		virtual stir::Succeeded set_viewgram(const stir::Viewgram<float>& v);
+		virtual stir::Sinogram<float> get_sinogram(const int ax_pos_num,
+			const int segment_num,
+			const bool make_num_tangential_poss_odd = false) const;
+		virtual stir::Succeeded set_sinogram(const stir::Sinogram<float>& s);
+		virtual stir::SegmentBySinogram<float>
+			get_segment_by_sinogram(const int segment_num) const;
+		virtual stir::Succeeded
+			set_segment(const stir::SegmentBySinogram<float>& s);
+		using stir::ProjData::set_segment;
+
+		/// nearest half precision number (ties to even)
+		static uint16_t half_from_float(float v);
+		static float float_from_half(uint16_t h);
+
+	private:
+		// index of the row of tangential positions
+		size_t row_(int segment_num, int ax_pos_num, int view_num) const
+		{
+			return _segment_rows[segment_num - get_min_segment_num()] +
+				(size_t)(ax_pos_num - get_min_axial_pos_num(segment_num))
+				*_num_views + view_num - get_min_view_num();
+		}
+		void get_row_(size_t r, float* v) const;
+		void set_row_(size_t r, const float* v);
+
+		Format _format;
+		int _num_views;
+		int _num_tang_poss;
+		std::vector<size_t> _segment_rows;
+		std::vector<uint16_t> _data;
+		// SCALED_UINT16: value = offset + scale*stored value
+		std::vector<float> _offsets;
+		std::vector<float> _scales;
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief Projection data storing only the non-zero bins.
+
+	Meant for measured sinograms at low counts (short time frames, gated
+	data), where most bins are zero. Each row of tangential positions
+	(in the sinogram order, as by ProjDataBuffer) keeps the tangential
+	positions and values of its non-zero bins. Reading returns dense
+	arrays; writing a viewgram or sinogram rebuilds the storage of its
+	segment, so the data is meant to be written once, segment by segment
+	(as by set_segment and fill, which build each segment in one pass).
+	*/
+
+	class ProjDataSparse : public stir::ProjData {
+	public:
+		ProjDataSparse(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info);
+
+		/// number of non-zero bins stored
+		size_t num_nonzeros() const;
+		/*!
+		\brief Calls f(k, i, value) for each non-zero bin.
+
+		i is the index of the bin in the buffer of ProjDataBuffer of the
+		same geometry, and k the position of its segment among the stored
+		ones. Segments are processed in parallel, so that f may accumulate
+		partial results per segment.
+		*/
+		void for_each_nonzero(const std::function
+			<void(size_t k, size_t i, float value)>& f) const;
+
+		virtual stir::Viewgram<float> get_viewgram(const int view_num,
+			const int segment_num,
+			const bool make_num_tangential_poss_odd = false) const;
+		virtual stir::Succeeded set_viewgram(const stir::Viewgram<float>& v);
+		virtual stir::Sinogram<float> get_sinogram(const int ax_pos_num,
+			const int segment_num,
+			const bool make_num_tangential_poss_odd = false) const;
+		virtual stir::Succeeded set_sinogram(const stir::Sinogram<float>& s);
+		virtual stir::SegmentBySinogram<float>
+			get_segment_by_sinogram(const int segment_num) const;
+		virtual stir::Succeeded
+			set_segment(const stir::SegmentBySinogram<float>& s);
+		virtual stir::Succeeded
+			set_segment(const stir::SegmentByView<float>& s);
+		/// copies proj_data (of the same geometry) segment by segment
+		virtual void fill(const stir::ProjData& proj_data);
+		using stir::ProjData::fill;
+
+	private:
+		// non-zero bins of a segment, row by row
+		struct SparseSegment {
+			// entries of row r are at row_start[r], ..., row_start[r + 1] - 1
+			std::vector<size_t> row_start;
+			std::vector<uint16_t> tang_pos;
+			std::vector<float> values;
+		};
+		// dense row r of a segment (v[0] is the first tangential position)
+		void get_row_(const SparseSegment& seg, size_t r, float* v) const;
+		// replaces rows rows[0] < rows[1] < ... of a segment by the
+		// dense rows in data
+		void set_rows_(int segment_num, const std::vector<size_t>& rows,
+			const std::vector<float>& data);
+
+		int _num_views;
+		int _num_tang_poss;
+		// buffer index of the first bin of each segment
+		std::vector<size_t> _segment_offsets;
+		std::vector<SparseSegment> _segments;
+	};
+
 	/*!
 	\ingroup STIR Extensions
 	\brief STIR ProjData wrapper with added functionality.
@@ -192,6 +512,46 @@ namespace sirf {
 		{
 			_data = data;
 		}
+		/// contiguous buffer holding the data, or 0 if the data is not in one
+		float* buffer()
+		{
+			ProjDataBuffer* ptr = dynamic_cast<ProjDataBuffer*>(_data.get());
+			if (ptr)
+				return ptr->buffer();
+			ProjDataSubsetViews* ptr_s =
+				dynamic_cast<ProjDataSubsetViews*>(_data.get());
+			return ptr_s ? ptr_s->buffer() : 0;
+		}
+		const float* buffer() const
+		{
+			const ProjDataBuffer* ptr =
+				dynamic_cast<const ProjDataBuffer*>(_data.get());
+			if (ptr)
+				return ptr->buffer();
+			const ProjDataSubsetViews* ptr_s = subset_views();
+			return ptr_s ? ptr_s->buffer() : 0;
+		}
+		size_t buffer_size() const
+		{
+			const ProjDataBuffer* ptr =
+				dynamic_cast<const ProjDataBuffer*>(_data.get());
+			if (ptr)
+				return ptr->size();
+			const ProjDataSubsetViews* ptr_s = subset_views();
+			return ptr_s ? ptr_s->size() : 0;
+		}
+		/// the data if only the views of a subset are stored, 0 otherwise
+		const ProjDataSubsetViews* subset_views() const
+		{
+			return dynamic_cast<const ProjDataSubsetViews*>(_data.get());
+		}
+		/// the data if only the non-zero bins are stored, 0 otherwise
+		const ProjDataSparse* sparse() const
+		{
+			return dynamic_cast<const ProjDataSparse*>(_data.get());
+		}
+		/// true if the data of this and x are in buffers of the same layout
+		bool same_buffer_layout(const PETAcquisitionData& x) const;
 
 		// data import/export
 		void fill(float v) { data()->fill(v); }
@@ -200,8 +560,16 @@ namespace sirf {
 			stir::shared_ptr<stir::ProjData> sptr = ad.data();
 			data()->fill(*sptr);
 		}
-		void fill_from(const float* d) { data()->fill_from(d); }
-		void copy_to(float* d) { data()->copy_to(d); }
+		void fill_from(const float* d)
+		{
+			SIRF_COUNT(BYTES_MOVED, sizeof(float)*data()->size_all());
+			data()->fill_from(d);
+		}
+		void copy_to(float* d)
+		{
+			SIRF_COUNT(BYTES_MOVED, sizeof(float)*data()->size_all());
+			data()->copy_to(d);
+		}
 		std::unique_ptr<PETAcquisitionData> clone() const
 		{
 			return std::unique_ptr<PETAcquisitionData>(clone_impl());
@@ -416,12 +784,12 @@ namespace sirf {
 			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info)
 		{
 			_data = stir::shared_ptr<stir::ProjData>
-				(new stir::ProjDataInMemory(sptr_exam_info, sptr_proj_data_info));
+				(new ProjDataBuffer(sptr_exam_info, sptr_proj_data_info));
 		}
 		PETAcquisitionDataInMemory(const stir::ProjData& pd)
 		{
 			_data = stir::shared_ptr<stir::ProjData>
-				(new stir::ProjDataInMemory(pd.get_exam_info_sptr(),
+				(new ProjDataBuffer(pd.get_exam_info_sptr(),
 				pd.get_proj_data_info_sptr()));
 		}
 		PETAcquisitionDataInMemory
@@ -431,9 +799,7 @@ namespace sirf {
 			stir::shared_ptr<stir::ProjDataInfo> sptr_pdi =
 				PETAcquisitionData::proj_data_info_from_scanner
 				(scanner_name, span, max_ring_diff, view_mash_factor);
-			stir::ProjDataInMemory* ptr = new stir::ProjDataInMemory(sptr_ei, sptr_pdi);
-			ptr->fill(0.0f);
-			_data.reset(ptr);
+			_data.reset(new ProjDataBuffer(sptr_ei, sptr_pdi));
 		}
 
 		static void init() 
@@ -478,6 +844,284 @@ namespace sirf {
 		}
 	};
 
+	/*!
+	\ingroup STIR Extensions
+	\brief PETAcquisitionData storing only the views of one subset.
+
+	Returned by PETAcquisitionModel::forward_subset_views (only), so that
+	the results of subset forward projections can be stored in memory
+	proportional to the subset size. The data is kept in memory regardless
+	of the storage scheme. Clones store the same subset, whereas new
+	acquisition data created from an object of this class (e.g. to hold
+	the results of algebraic operations) are full-size and stored according
+	to the current storage scheme.
+	*/
+
+	class PETAcquisitionDataSubset : public PETAcquisitionData {
+	public:
+		PETAcquisitionDataSubset
+			(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info,
+			const std::vector<int>& view_nums)
+		{
+			_data.reset(new ProjDataSubsetViews(sptr_exam_info,
+				sptr_proj_data_info, view_nums));
+		}
+
+		virtual PETAcquisitionData* same_acquisition_data
+			(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info) const
+		{
+			const ProjDataSubsetViews* ptr = subset_views();
+			return new PETAcquisitionDataSubset(sptr_exam_info,
+				sptr_proj_data_info, ptr->view_nums());
+		}
+		virtual ObjectHandle<DataContainer>* new_data_container_handle() const
+		{
+			PETAcquisitionDataInFile::init();
+			DataContainer* ptr = _template->same_acquisition_data
+				(this->get_exam_info_sptr(), this->get_proj_data_info_sptr());
+			return new ObjectHandle<DataContainer>
+				(stir::shared_ptr<DataContainer>(ptr));
+		}
+		virtual stir::shared_ptr<PETAcquisitionData> new_acquisition_data() const
+		{
+			PETAcquisitionDataInFile::init();
+			return stir::shared_ptr<PETAcquisitionData>
+				(_template->same_acquisition_data
+				(this->get_exam_info_sptr(), this->get_proj_data_info_sptr()));
+		}
+	private:
+		virtual PETAcquisitionDataSubset* clone_impl() const
+		{
+			PETAcquisitionDataSubset* ptr = (PETAcquisitionDataSubset*)
+				same_acquisition_data(this->get_exam_info_sptr(),
+				this->get_proj_data_info_sptr());
+			std::copy(buffer(), buffer() + buffer_size(), ptr->buffer());
+			return ptr;
+		}
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief Memory-mapped file implementation of PETAcquisitionData.
+
+	The data is kept in a scratch file mapped to memory, so that the
+	operating system pages it in and out as needed, while the algebra runs
+	directly on the mapped buffer as for PETAcquisitionDataInMemory.
+	Scratch files are created in the directory set by set_scratch_directory
+	(by default, the one specified by the environment variable
+	SIRF_SCRATCH_DIR, or else the current directory), which ideally should
+	be on a fast device (tmpfs, NVMe), and are deleted when no longer used.
+	*/
+
+	class PETAcquisitionDataInMappedFile : public PETAcquisitionData {
+	public:
+		PETAcquisitionDataInMappedFile() {}
+		PETAcquisitionDataInMappedFile
+			(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info)
+		{
+			_data.reset(new ProjDataBuffer
+				(sptr_exam_info, sptr_proj_data_info, scratch_file_path()));
+		}
+		PETAcquisitionDataInMappedFile(const stir::ProjData& pd)
+		{
+			_data.reset(new ProjDataBuffer(pd.get_exam_info_sptr(),
+				pd.get_proj_data_info_sptr(), scratch_file_path()));
+		}
+		PETAcquisitionDataInMappedFile
+			(stir::shared_ptr<stir::ExamInfo> sptr_ei, std::string scanner_name,
+			int span = 1, int max_ring_diff = -1, int view_mash_factor = 1)
+		{
+			stir::shared_ptr<stir::ProjDataInfo> sptr_pdi =
+				PETAcquisitionData::proj_data_info_from_scanner
+				(scanner_name, span, max_ring_diff, view_mash_factor);
+			_data.reset(new ProjDataBuffer(sptr_ei, sptr_pdi, scratch_file_path()));
+		}
+
+		static void init()
+		{
+			PETAcquisitionDataInFile::init();
+		}
+		static void set_as_template()
+		{
+			init();
+			_storage_scheme = "mmap";
+			_template.reset(new PETAcquisitionDataInMappedFile);
+		}
+		static std::string scratch_directory();
+		static void set_scratch_directory(const std::string& dir)
+		{
+			_scratch_dir = dir;
+		}
+
+		virtual PETAcquisitionData* same_acquisition_data
+			(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info) const
+		{
+			PETAcquisitionData* ptr_ad = new PETAcquisitionDataInMappedFile
+				(sptr_exam_info, sptr_proj_data_info);
+			return ptr_ad;
+		}
+		virtual ObjectHandle<DataContainer>* new_data_container_handle() const
+		{
+			init();
+			DataContainer* ptr = _template->same_acquisition_data
+				(this->get_exam_info_sptr(), this->get_proj_data_info_sptr());
+			return new ObjectHandle<DataContainer>
+				(stir::shared_ptr<DataContainer>(ptr));
+		}
+		virtual stir::shared_ptr<PETAcquisitionData> new_acquisition_data() const
+		{
+			init();
+			return stir::shared_ptr < PETAcquisitionData >
+				(_template->same_acquisition_data
+				(this->get_exam_info_sptr(), this->get_proj_data_info_sptr()));
+		}
+	private:
+		static std::string _scratch_dir;
+		static std::string scratch_file_path()
+		{
+			return scratch_directory() + "/"
+				+ SIRFUtilities::scratch_file_name() + ".smap";
+		}
+		virtual PETAcquisitionDataInMappedFile* clone_impl() const
+		{
+			init();
+			return (PETAcquisitionDataInMappedFile*)clone_base();
+		}
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief PETAcquisitionData stored in 16 bits per bin.
+
+	A copy of other acquisition data in one of the formats of
+	ProjDataReducedPrecision, kept in memory regardless of the storage
+	scheme. New acquisition data created from an object of this class
+	(e.g. results of algebraic operations) are stored as specified by the
+	storage scheme, in float.
+	*/
+
+	class PETAcquisitionDataReducedPrecision : public PETAcquisitionData {
+	public:
+		PETAcquisitionDataReducedPrecision(const PETAcquisitionData& ad,
+			ProjDataReducedPrecision::Format format)
+		{
+			_data.reset(new ProjDataReducedPrecision(ad.get_exam_info_sptr(),
+				ad.get_proj_data_info_sptr(), format));
+			fill(ad);
+		}
+		ProjDataReducedPrecision::Format format() const
+		{
+			return ((const ProjDataReducedPrecision*)_data.get())->format();
+		}
+
+		virtual PETAcquisitionData* same_acquisition_data
+			(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info) const
+		{
+			PETAcquisitionDataInFile::init();
+			return _template->same_acquisition_data
+				(sptr_exam_info, sptr_proj_data_info);
+		}
+		virtual ObjectHandle<DataContainer>* new_data_container_handle() const
+		{
+			DataContainer* ptr = same_acquisition_data
+				(this->get_exam_info_sptr(), this->get_proj_data_info_sptr());
+			return new ObjectHandle<DataContainer>
+				(stir::shared_ptr<DataContainer>(ptr));
+		}
+		virtual stir::shared_ptr<PETAcquisitionData> new_acquisition_data() const
+		{
+			return stir::shared_ptr<PETAcquisitionData>(same_acquisition_data
+				(this->get_exam_info_sptr(), this->get_proj_data_info_sptr()));
+		}
+	private:
+		PETAcquisitionDataReducedPrecision() {}
+		virtual PETAcquisitionDataReducedPrecision* clone_impl() const
+		{
+			PETAcquisitionDataReducedPrecision* ptr =
+				new PETAcquisitionDataReducedPrecision;
+			ptr->_data.reset(new ProjDataReducedPrecision
+				(*(const ProjDataReducedPrecision*)_data.get()));
+			return ptr;
+		}
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief PETAcquisitionData storing only the non-zero bins.
+
+	A copy of other acquisition data (typically prompts sinograms) in
+	ProjDataSparse. dot() with dense data, and axpby(), multiply() and
+	divide() of a sparse and a dense operand into dense data in a buffer
+	(see PETAcquisitionData::buffer()) only visit the non-zero bins of the
+	sparse operand; all other operations read the data as dense arrays.
+	New acquisition data created from an object of this class are stored
+	as specified by the storage scheme.
+	*/
+
+	class PETAcquisitionDataSparse : public PETAcquisitionData {
+	public:
+		PETAcquisitionDataSparse(const PETAcquisitionData& ad)
+		{
+			ProjDataSparse* ptr = new ProjDataSparse(ad.get_exam_info_sptr(),
+				ad.get_proj_data_info_sptr());
+			_data.reset(ptr);
+			ptr->fill(*ad.data());
+		}
+		size_t num_nonzeros() const
+		{
+			return sparse()->num_nonzeros();
+		}
+		/*!
+		\brief Poisson log-likelihood of this data given its mean.
+
+		Returns the sum over the bins of y log(m) - m, where y is this data
+		and m the mean (typically the forward projection of an image
+		estimate, with additive and background terms), computed as by
+		STIR's Poisson log-likelihood objective functions: m is replaced by
+		y/10000 where smaller, and the terms y log(m) are computed for the
+		non-zero bins of y only. If the mean stores only the views of a
+		subset (see PETAcquisitionModel::forward_subset_views), the sum
+		runs over the bins of these views only, as STIR's value for the
+		subset does.
+		*/
+		double log_likelihood(const PETAcquisitionData& mean) const;
+
+		virtual PETAcquisitionData* same_acquisition_data
+			(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info) const
+		{
+			PETAcquisitionDataInFile::init();
+			return _template->same_acquisition_data
+				(sptr_exam_info, sptr_proj_data_info);
+		}
+		virtual ObjectHandle<DataContainer>* new_data_container_handle() const
+		{
+			DataContainer* ptr = same_acquisition_data
+				(this->get_exam_info_sptr(), this->get_proj_data_info_sptr());
+			return new ObjectHandle<DataContainer>
+				(stir::shared_ptr<DataContainer>(ptr));
+		}
+		virtual stir::shared_ptr<PETAcquisitionData> new_acquisition_data() const
+		{
+			return stir::shared_ptr<PETAcquisitionData>(same_acquisition_data
+				(this->get_exam_info_sptr(), this->get_proj_data_info_sptr()));
+		}
+	private:
+		PETAcquisitionDataSparse() {}
+		virtual PETAcquisitionDataSparse* clone_impl() const
+		{
+			PETAcquisitionDataSparse* ptr = new PETAcquisitionDataSparse;
+			ptr->_data.reset(new ProjDataSparse
+				(*(const ProjDataSparse*)_data.get()));
+			return ptr;
+		}
+	};
+
 	/*!
 	\ingroup STIR Extensions
 	\brief STIR DiscretisedDensity<3, float> wrapper with added functionality.
@@ -715,6 +1359,14 @@ namespace sirf {
 		void get_voxel_sizes(float* vsizes) const;
 		virtual void get_data(float* data) const;
 		virtual void set_data(const float* data);
+		/*!
+		\brief Address of the voxel values if the image is stored in one block.
+
+		The values are in the order used by get_data (z, y, x, the last one
+		changing fastest). Returns 0 if the rows of the image are not
+		adjacent in memory.
+		*/
+		float* contiguous_data();
 		virtual Iterator& begin()
 		{
 			_begin.reset(new Iterator(data().begin_all()));
@@ -32,8 +32,14 @@ limitations under the License.
 \author CCP PETMR
 */
 
+#include <mutex>
 #include <stdlib.h>
+#include <vector>
 
+#include "stir/RelatedViewgrams.h"
+
+#include "sirf/common/getenv.h"
+#include "sirf/common/process_pool.h"
 #include "sirf/STIR/stir_data_containers.h"
 
 #define MIN_BIN_EFFICIENCY 1.0e-20f
@@ -56,6 +62,16 @@ PETAcquisitionData. 2 variables decide what done with 3 possible cases:
 - `store_prompts`=`true`, `store_delayeds`=`true`: prompts-delayeds are stored
 Clearly, enabling the `store_delayeds` option only makes sense if the data was
 acquired accordingly.
+With the `parallel_unlisting` flag on (the default), process() bins the events
+on the SIRF thread pool (see process_data()).
+Any number of time frames can be converted in one pass over the listmode data
+(see set_time_frames()); with the `separate_delayeds` flag on, the delayeds are
+stored in sinograms of their own rather than subtracted from the prompts.
+With the `accumulate_fan_sums` flag on (the default), the delayeds fan sums
+needed by estimate_randoms() are accumulated by process() in the same pass.
+With the `sparse_output` flag on, the sinograms returned by get_output() and
+get_delayeds() store only their non-zero bins (see PETAcquisitionDataSparse),
+which for short time frames takes much less memory.
 - estimate_randoms() can be used to get a relatively noiseless estimate of the
 random coincidences.
 
@@ -87,9 +103,20 @@ The actual algorithm is described in
 			By default, `store_prompts` is `true` and `store_delayeds` is `false`.
 			*/
 		//ListmodeToSinograms(const char* const par) : stir::LmToProjData(par) {}
-		ListmodeToSinograms(const char* par) : stir::LmToProjData(par) {}
+		ListmodeToSinograms(const char* par) : stir::LmToProjData(par)
+		{
+			parallel_unlisting = true;
+			separate_delayeds = false;
+			accumulate_fan_sums = true;
+			sparse_output = false;
+			fan_size = -1;
+		}
 		ListmodeToSinograms() : stir::LmToProjData()
 		{
+			parallel_unlisting = true;
+			separate_delayeds = false;
+			accumulate_fan_sums = true;
+			sparse_output = false;
 			fan_size = -1;
 			store_prompts = true;
 			store_delayeds = false;
@@ -120,15 +147,50 @@ The actual algorithm is described in
 			std::pair<double, double> interval(start, stop);
 			std::vector < std::pair<double, double> > intervals;
 			intervals.push_back(interval);
+			set_time_frames(intervals);
+		}
+		//! Sets the (start, stop) time intervals of the frames to convert.
+		/*! All frames are converted in one pass over the listmode data;
+			frames after the end of the data are written as empty sinograms.
+			The intervals must be sorted by time and must not overlap; as in
+			STIR, a stop time of (nearly) 0 means the end of the data, which
+			is only allowed for the last frame.
+		*/
+		void set_time_frames
+			(const std::vector<std::pair<double, double> >& intervals)
+		{
+			if (intervals.size() < 1)
+				THROW("no time frames specified");
+			for (size_t f = 0; f < intervals.size(); f++) {
+				bool open_ended = intervals[f].second <= 0.01;
+				if (open_ended && f + 1 < intervals.size())
+					THROW("only the last time frame may extend to the end of the data");
+				if (!open_ended && intervals[f].second <= intervals[f].first)
+					THROW("time frame ends before it starts");
+				if (f > 0 && intervals[f].first < intervals[f - 1].second)
+					THROW("time frames must be sorted and must not overlap");
+			}
 			frame_defs = stir::TimeFrameDefinitions(intervals);
 			do_time_frame = true;
 		}
+		int num_frames() const
+		{
+			return frame_defs.get_num_frames();
+		}
 		int set_flag(const char* flag, bool value)
 		{
 			if (boost::iequals(flag, "store_prompts"))
 				store_prompts = value;
 			else if (boost::iequals(flag, "store_delayeds"))
 				store_delayeds = value;
+			else if (boost::iequals(flag, "parallel_unlisting"))
+				parallel_unlisting = value;
+			else if (boost::iequals(flag, "separate_delayeds"))
+				separate_delayeds = value;
+			else if (boost::iequals(flag, "accumulate_fan_sums"))
+				accumulate_fan_sums = value;
+			else if (boost::iequals(flag, "sparse_output"))
+				sparse_output = value;
 #if 0
 			else if (boost::iequals(flag, "do_pre_normalisation"))
 				do_pre_normalisation = value;
@@ -149,11 +211,28 @@ The actual algorithm is described in
 		{
 			return store_delayeds;
 		}
+		bool get_parallel_unlisting() const
+		{
+			return parallel_unlisting;
+		}
+		bool get_separate_delayeds() const
+		{
+			return separate_delayeds;
+		}
+		bool get_accumulate_fan_sums() const
+		{
+			return accumulate_fan_sums;
+		}
+		bool get_sparse_output() const
+		{
+			return sparse_output;
+		}
 		bool set_up()
 		{
 			// always reset here, in case somebody set a new listmode or template file
 			max_segment_num_to_process = -1;
 			fan_size = -1;
+			fan_sums_sptr.reset();
 
 			bool failed = post_processing();
 			if (failed)
@@ -178,16 +257,49 @@ The actual algorithm is described in
 
 			return false;
 		}
-		stir::shared_ptr<PETAcquisitionData> get_output()
+		/*!
+		\brief Converts the listmode data into sinograms.
+
+		Chunks of listmode records are read by one thread, while the events
+		already read are turned into bins by the threads of the SIRF thread
+		pool, each handling one chunk. Each thread sorts the bins of its chunk by the
+		part of the sinograms they belong to, and each part is then updated
+		by one thread, taking the bins of all chunks in the order of the
+		events, so that the sinograms are the same as those produced by the
+		serial conversion. Every time frame is kept in memory while being
+		binned. With parallel unlisting off, in interactive mode, or with
+		frames defined by numbers of events, STIR's serial conversion is
+		used instead (in which case estimate_randoms() computes the fan sums
+		in a pass of its own), unless the delayeds are to be stored
+		separately (then, with parallel unlisting off, the above runs on the
+		calling thread only).
+		*/
+		virtual void process_data();
+		//! Returns the sinograms of a time frame (numbered from 1).
+		/*! The sinograms are read from the file written by process_data()
+			and, if the `sparse_output` flag is on, copied into sparse
+			storage, or else, unless the acquisition data storage scheme
+			is "file", into storage of that scheme.
+		*/
+		stir::shared_ptr<PETAcquisitionData> get_output(int frame_num = 1) const
+		{
+			return frame_data_(output_filename_prefix, frame_num);
+		}
+		//! Returns the delayeds sinograms of a time frame (numbered from 1).
+		/*! Available if the delayeds were stored separately.
+		*/
+		stir::shared_ptr<PETAcquisitionData> get_delayeds(int frame_num = 1) const
 		{
-			std::string filename = output_filename_prefix + "_f1g1d0b0.hs";
-			return stir::shared_ptr<PETAcquisitionData>
-				(new PETAcquisitionDataInFile(filename.c_str()));
+			if (!(store_delayeds && separate_delayeds))
+				THROW("delayeds were not stored separately");
+			return frame_data_(output_filename_prefix + "_delayeds", frame_num);
 		}
 
 		int estimate_randoms()
 		{
-			compute_fan_sums_();
+			// fan sums are computed by process() unless not requested
+			if (!fan_sums_sptr.get() || fan_sums_sptr->size() < 1)
+				compute_fan_sums_();
 			int err = compute_singles_();
 			if (err)
 				return err;
@@ -200,6 +312,10 @@ The actual algorithm is described in
 		}
 
 	protected:
+		bool parallel_unlisting;
+		bool separate_delayeds;
+		bool accumulate_fan_sums;
+		bool sparse_output;
 		// variables for ML estimation of singles/randoms
 		int fan_size;
 		int half_fan_size;
@@ -212,11 +328,19 @@ The actual algorithm is described in
 		stir::shared_ptr<stir::DetectorEfficiencies> det_eff_sptr;
 		stir::shared_ptr<PETAcquisitionData> randoms_sptr;
 		void compute_fan_sums_(bool prompt_fansum = false);
+		void set_max_ring_diff_for_fansums_();
+		void add_to_fan_sums_(float* fan_sums, const stir::CListEvent& event,
+			int num_detectors_per_ring) const;
 		int compute_singles_();
 		void estimate_randoms_();
 		static unsigned long compute_num_bins_(const int num_rings,
 			const int num_detectors_per_ring,
 			const int max_ring_diff, const int half_fan_size);
+		// name (without extension) of the sinograms file of a frame
+		static std::string frame_filename_
+			(const std::string& prefix, int frame_num);
+		stir::shared_ptr<PETAcquisitionData> frame_data_
+			(const std::string& prefix, int frame_num) const;
 	};
 
 	/*!
@@ -232,14 +356,19 @@ The actual algorithm is described in
 		PETAcquisitionSensitivityModel(PETAcquisitionData& ad);
 		// create from ECAT8
 		PETAcquisitionSensitivityModel(std::string filename);
-		// chain two normalizations
+		// chain two normalizations (set_up sets up both, so that e.g. an
+		// attenuation model uses its cached attenuation factors)
 		PETAcquisitionSensitivityModel
-			(PETAcquisitionSensitivityModel& mod1, PETAcquisitionSensitivityModel& mod2)
+			(stir::shared_ptr<PETAcquisitionSensitivityModel> sptr_mod1,
+			stir::shared_ptr<PETAcquisitionSensitivityModel> sptr_mod2) :
+			sptr_mod1_(sptr_mod1), sptr_mod2_(sptr_mod2)
 		{
-			norm_.reset(new stir::ChainedBinNormalisation(mod1.data(), mod2.data()));
+			norm_.reset(new stir::ChainedBinNormalisation
+				(sptr_mod1->data(), sptr_mod2->data()));
 		}
 
-		stir::Succeeded set_up(const stir::shared_ptr<stir::ProjDataInfo>&);
+		virtual stir::Succeeded set_up
+			(const stir::shared_ptr<stir::ProjDataInfo>&);
 
 		// multiply by bin efficiencies
 		virtual void unnormalise(PETAcquisitionData& ad) const;
@@ -262,15 +391,41 @@ The actual algorithm is described in
 			return sptr_ad;
 		}
 
-		stir::shared_ptr<stir::BinNormalisation> data()
+		virtual stir::shared_ptr<stir::BinNormalisation> data()
 		{
 			return norm_;
 			//return std::dynamic_pointer_cast<stir::BinNormalisation>(norm_);
 		}
+		// inverse bin efficiencies if created from bin efficiencies
+		stir::shared_ptr<PETAcquisitionData> inverse_efficiencies_sptr()
+		{
+			return sptr_ad_;
+		}
+		// the chained models if created by chaining two
+		stir::shared_ptr<PETAcquisitionSensitivityModel> first_model_sptr()
+		{
+			return sptr_mod1_;
+		}
+		stir::shared_ptr<PETAcquisitionSensitivityModel> second_model_sptr()
+		{
+			return sptr_mod2_;
+		}
+		// create from inverse bin efficiencies sinograms
+		static stir::shared_ptr<PETAcquisitionSensitivityModel>
+			from_inverse_efficiencies(stir::shared_ptr<PETAcquisitionData> sptr_ad);
+		// identifies the model by what it was created from (bin efficiencies
+		// values, ECAT8 file, attenuation image), empty if unknown
+		virtual std::string id() const;
 
 	protected:
 		stir::shared_ptr<stir::BinNormalisation> norm_;
+		stir::shared_ptr<PETAcquisitionData> sptr_ad_;
+		// ECAT8 file, if created from one
+		std::string filename_;
 		//shared_ptr<stir::ChainedBinNormalisation> norm_;
+		// the chained models, if any
+		stir::shared_ptr<PETAcquisitionSensitivityModel> sptr_mod1_;
+		stir::shared_ptr<PETAcquisitionSensitivityModel> sptr_mod2_;
 	};
 
 	/*!
@@ -313,6 +468,7 @@ The actual algorithm is described in
 
 	class PETAcquisitionModel {
 	public:
+		PETAcquisitionModel() : terms_storage_("float") {}
 		void set_projectors(stir::shared_ptr<stir::ProjectorByBinPair> sptr_projectors)
 		{
 			sptr_projectors_ = sptr_projectors;
@@ -323,7 +479,7 @@ The actual algorithm is described in
 		}
 		void set_additive_term(stir::shared_ptr<PETAcquisitionData> sptr)
 		{
-			sptr_add_ = sptr;
+			sptr_add_ = stored_term_(sptr);
 		}
 		stir::shared_ptr<PETAcquisitionData> additive_term_sptr()
 		{
@@ -331,7 +487,7 @@ The actual algorithm is described in
 		}
 		void set_background_term(stir::shared_ptr<PETAcquisitionData> sptr)
 		{
-			sptr_background_ = sptr;
+			sptr_background_ = stored_term_(sptr);
 		}
 		stir::shared_ptr<PETAcquisitionData> background_term_sptr()
 		{
@@ -349,6 +505,10 @@ The actual algorithm is described in
 			return sptr;
 			//return sptr_normalisation_;
 		}
+		stir::shared_ptr<PETAcquisitionSensitivityModel> asm_sptr()
+		{
+			return sptr_asm_;
+		}
 		//void set_bin_efficiency(shared_ptr<PETAcquisitionData> sptr_data);
 		//void set_normalisation(shared_ptr<PETAcquisitionData> sptr_data)
 		//{
@@ -357,7 +517,32 @@ The actual algorithm is described in
 		void set_asm(stir::shared_ptr<PETAcquisitionSensitivityModel> sptr_asm)
 		{
 			//sptr_normalisation_ = sptr_asm->data();
-			sptr_asm_ = sptr_asm;
+			sptr_asm_ = stored_asm_(sptr_asm);
+		}
+		/*!
+		\brief Sets the storage format of the additive and background terms
+		and of the bin normalisation.
+
+		These terms stay constant during reconstruction, and for large
+		scanners storing them as floats may take more memory than the
+		measured data and its estimate. The formats are
+		"float" (default),
+		"half" (IEEE 754 binary16, relative precision about 5e-4) and
+		"uint16" (16-bit integers with offset and scale per row of
+		tangential positions, exact for integer-valued rows such as
+		randoms from delayed coincidences).
+		Bin normalisation created from bin efficiencies (alone or chained
+		with other models) is stored in half precision in both reduced
+		formats. In a reduced format only the converted copies of the terms
+		are kept (and returned by the term accessors, converting to float
+		on access), so that the memory is indeed saved. Terms that are
+		already set are converted; the precision lost by converting to a
+		reduced format is not restored by converting back to "float".
+		*/
+		void set_terms_storage(const std::string& storage);
+		const std::string& terms_storage() const
+		{
+			return terms_storage_;
 		}
 
 		void cancel_background_term()
@@ -385,11 +570,78 @@ The actual algorithm is described in
 		// replaces a subset of acquisition data with forward-projected data
 		void forward(PETAcquisitionData& acq_data, const STIRImageData& image,
 			int subset_num, int num_subsets, bool zero = false);
+		/*!
+		\brief Computes and returns a subset of forward-projected data,
+		stored only for the views of the subset.
+
+		The result (see PETAcquisitionDataSubset) takes memory proportional
+		to the subset size; its bins outside the subset read as zeros
+		(the additive and background terms are not added there), and
+		attempts to store non-zero values there throw.
+		*/
+		stir::shared_ptr<PETAcquisitionData>
+			forward_subset_views(const STIRImageData& image,
+			int subset_num, int num_subsets);
 
 		stir::shared_ptr<STIRImageData> backward(PETAcquisitionData& ad,
 			int subset_num = 0, int num_subsets = 1);
 
+		/*!
+		\brief Forward projects a series of images (e.g. time frames or gates)
+		with the same geometry.
+
+		The result is the same as that of calling forward for each image,
+		but each set of related viewgrams is projected for all images in
+		turn, so that the geometry of each bin is obtained once for all of
+		them by projectors that compute it (see forward_project_), and the
+		additive and background terms are read once.
+		*/
+		std::vector<stir::shared_ptr<PETAcquisitionData> >
+			forward(const std::vector<stir::shared_ptr<STIRImageData> >& images,
+			int subset_num = 0, int num_subsets = 1);
+		/*!
+		\brief Back projects a series of acquisition data with the same
+		geometry.
+
+		See forward above. The images are split into as many groups as
+		there are threads (fewer if there are fewer images); each group is
+		back projected by separate tasks that share the geometry of each bin
+		between the images of the group.
+		*/
+		std::vector<stir::shared_ptr<STIRImageData> >
+			backward(const std::vector<stir::shared_ptr<PETAcquisitionData> >& ad,
+			int subset_num = 0, int num_subsets = 1);
+
 	protected:
+		/*!
+		\brief Forward projects images[k] into *viewgrams[k] for each k.
+
+		Called concurrently for different sets of related viewgrams if
+		projections are parallel. The default implementation calls the
+		forward projector for each image.
+		*/
+		virtual void forward_project_(
+			const std::vector<stir::RelatedViewgrams<float>*>& viewgrams,
+			const std::vector<const Image3DF*>& images);
+		/// Back projects *viewgrams[k] into *images[k] for each k (see above).
+		virtual void back_project_(const std::vector<Image3DF*>& images,
+			const std::vector<const stir::RelatedViewgrams<float>*>& viewgrams);
+		// forward and backward projections of several images
+		void forward_(const std::vector<PETAcquisitionData*>& ads,
+			const std::vector<const Image3DF*>& images,
+			int subset_num, int num_subsets, bool zero);
+		std::vector<stir::shared_ptr<STIRImageData> > backward_(
+			const std::vector<const PETAcquisitionData*>& ads,
+			int subset_num, int num_subsets);
+		// factors by which norm unnormalises the related viewgrams vs
+		// (norm_mutex serialises reading the normalisation data)
+		static stir::RelatedViewgrams<float> bin_efficiencies_(
+			const stir::BinNormalisation& norm,
+			const stir::ProjData& proj_data,
+			const stir::ViewSegmentNumbers& vs,
+			const stir::shared_ptr<stir::DataSymmetriesForViewSegmentNumbers>&
+			sptr_symmetries, std::mutex& norm_mutex);
+
 		stir::shared_ptr<stir::ProjectorByBinPair> sptr_projectors_;
 		stir::shared_ptr<PETAcquisitionData> sptr_acq_template_;
 		stir::shared_ptr<STIRImageData> sptr_image_template_;
@@ -397,6 +649,15 @@ The actual algorithm is described in
 		stir::shared_ptr<PETAcquisitionData> sptr_background_;
 		stir::shared_ptr<PETAcquisitionSensitivityModel> sptr_asm_;
 		//shared_ptr<stir::BinNormalisation> sptr_normalisation_;
+
+	private:
+		// copies of the terms in the storage format
+		stir::shared_ptr<PETAcquisitionData>
+			stored_term_(stir::shared_ptr<PETAcquisitionData> sptr) const;
+		stir::shared_ptr<PETAcquisitionSensitivityModel> stored_asm_
+			(stir::shared_ptr<PETAcquisitionSensitivityModel> sptr) const;
+
+		std::string terms_storage_;
 	};
 
 	/*!
@@ -411,6 +672,14 @@ The actual algorithm is described in
 	Furthermore, owing to symmetries, many rows have the same values only
 	in different order, and thus only one set of values needs to be computed
 	and stored (see STIR documentation for details).
+
+	Computing the matrix elements is expensive, hence ray tracing matrices can
+	be saved to files in a cache directory (see write_matrix_cache and the
+	utility sirf_build_matrix_cache). If the cache directory is set (by
+	set_matrix_cache_directory or the environment variable
+	SIRF_MATRIX_CACHE_DIR) and has the matrix for the geometry at hand
+	(scanner, projection data info, image geometry and matrix parameters),
+	set_up loads it instead of computing the elements again.
 	*/
 
 	class PETAcquisitionModelUsingMatrix : public PETAcquisitionModel {
@@ -418,6 +687,7 @@ The actual algorithm is described in
 		PETAcquisitionModelUsingMatrix()
 		{
 			this->sptr_projectors_.reset(new ProjectorPairUsingMatrix);
+			matrix_cache_dir_ = sirf::getenv("SIRF_MATRIX_CACHE_DIR");
 		}
 		void set_matrix(stir::shared_ptr<stir::ProjMatrixByBin> sptr_matrix)
 		{
@@ -427,20 +697,69 @@ The actual algorithm is described in
 		}
 		stir::shared_ptr<stir::ProjMatrixByBin> matrix_sptr()
 		{
-			return ((ProjectorPairUsingMatrix*)this->sptr_projectors_.get())->
-				get_proj_matrix_sptr();
+			return sptr_matrix_;
 		}
-		virtual stir::Succeeded set_up(
-			stir::shared_ptr<PETAcquisitionData> sptr_acq,
-			stir::shared_ptr<STIRImageData> sptr_image)
+		/// empty directory name disables the matrix cache
+		void set_matrix_cache_directory(const std::string& dir)
+		{
+			matrix_cache_dir_ = dir;
+		}
+		std::string matrix_cache_directory() const
 		{
-			if (!sptr_matrix_.get())
-				return stir::Succeeded::no;
-			return PETAcquisitionModel::set_up(sptr_acq, sptr_image);
+			return matrix_cache_dir_;
 		}
+		virtual stir::Succeeded set_up(
+			stir::shared_ptr<PETAcquisitionData> sptr_acq,
+			stir::shared_ptr<STIRImageData> sptr_image);
+
+		/// prefix of the cache files for a ray tracing matrix
+		static std::string matrix_cache_prefix(const std::string& dir,
+			const RayTracingMatrix& matrix, const stir::ProjDataInfo& pdi,
+			const Image3DF& image);
+		/*!
+		\brief Computes all elements of a ray tracing matrix and saves them
+		in the cache directory.
+		*/
+		static void write_matrix_cache(const std::string& dir,
+			RayTracingMatrix& matrix,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_pdi,
+			stir::shared_ptr<Image3DF> sptr_image);
+		/*!
+		\brief Saves the ray tracing matrix for the geometry of the last
+		set_up in directory dir (in the cache format), unless it is there.
+
+		Returns false if there is no such matrix or set_up was not called.
+		*/
+		bool write_matrix(const std::string& dir);
+		/*!
+		\brief Projects with the matrix saved in dir for the geometry of the
+		last set_up, if there is one (returns true if so).
+		*/
+		bool use_saved_matrix(const std::string& dir);
+
+	protected:
+		/*!
+		\brief Forward projects several images using the matrix directly.
+
+		The row of the matrix for each bin is obtained once and applied to
+		all images.
+		*/
+		virtual void forward_project_(
+			const std::vector<stir::RelatedViewgrams<float>*>& viewgrams,
+			const std::vector<const Image3DF*>& images);
+		virtual void back_project_(const std::vector<Image3DF*>& images,
+			const std::vector<const stir::RelatedViewgrams<float>*>& viewgrams);
 
 	private:
+		static std::string matrix_cache_key_(const RayTracingMatrix& matrix,
+			const stir::ProjDataInfo& pdi, const Image3DF& image);
+		// matrix cached in dir for the geometry at hand, if available
+		stir::shared_ptr<stir::ProjMatrixByBin> cached_matrix_
+			(const std::string& dir, const PETAcquisitionData& ad,
+			const STIRImageData& image) const;
+
 		stir::shared_ptr<stir::ProjMatrixByBin> sptr_matrix_;
+		std::string matrix_cache_dir_;
 	};
 
 	typedef PETAcquisitionModel AcqMod3DF;
@@ -451,17 +770,41 @@ The actual algorithm is described in
 	\ingroup STIR Extensions
 	\brief Attenuation model.
 
+	The attenuation correction factors are computed by forward projecting the
+	attenuation image once, at set_up, and kept as acquisition data (stored
+	according to the current storage scheme), so that applying the model
+	amounts to an elementwise multiplication or division. A repeated set_up
+	reuses the factors unless the geometry, the projector parameters or the
+	attenuation image have changed (the image is checked at set_up only: if
+	it is modified after set_up, set_up must be called again). Before set_up,
+	or for acquisition data of a different geometry, the attenuation image is
+	forward projected on each use.
 	*/
 
 	class PETAttenuationModel : public PETAcquisitionSensitivityModel {
 	public:
 		PETAttenuationModel(STIRImageData& id, PETAcquisitionModel& am);
+		virtual stir::Succeeded set_up
+			(const stir::shared_ptr<stir::ProjDataInfo>& sptr_pdi);
 		// multiply by bin efficiencies
 		virtual void unnormalise(PETAcquisitionData& ad) const;
 		// divide by bin efficiencies
 		virtual void normalise(PETAcquisitionData& ad) const;
+		virtual std::string id() const;
 	protected:
 		stir::shared_ptr<stir::ForwardProjectorByBin> sptr_forw_projector_;
+	private:
+		// true if the cached factors apply to ad
+		bool use_acf_(const PETAcquisitionData& ad) const;
+		static unsigned long long checksum_(const Image3DF& image);
+
+		stir::shared_ptr<Image3DF> sptr_image_;
+		stir::shared_ptr<stir::BinNormalisation> sptr_att_norm_;
+		// cached attenuation correction factors
+		stir::shared_ptr<PETAcquisitionData> sptr_acf_;
+		// checksum of the attenuation image and projector parameters
+		// the factors were computed with
+		unsigned long long acf_checksum_;
 	};
 
 	/*!
@@ -504,34 +847,170 @@ The actual algorithm is described in
 
 	//typedef xSTIR_GeneralisedObjectiveFunction3DF ObjectiveFunction3DF;
 
+	/*!
+	\ingroup STIR Extensions
+	\brief Poisson log-likelihood with cached sensitivity images.
+
+	If the sensitivity cache directory is set (by
+	set_sensitivity_cache_directory or the environment variable
+	SIRF_SENSITIVITY_CACHE_DIR), the (subset) sensitivity images computed by
+	set_up are saved, in Interfile format, in a subdirectory named after the
+	hash of everything they depend on: projectors, acquisition data geometry,
+	normalisation (via the data of its sensitivity model, see
+	PETAcquisitionSensitivityModel::id) and the start and end times of the
+	frame it is applied for, image geometry and subsets. A later
+	set_up with the same configuration reads them instead of recomputing.
+	The least recently used entries are removed when the cache exceeds its
+	size (set by set_sensitivity_cache_size or SIRF_SENSITIVITY_CACHE_SIZE,
+	in MB, default 4096). The cache is not used if the sensitivity file name
+	is set, the sensitivity is not to be recomputed or the normalisation was
+	not set by set_acquisition_model.
+
+	If the acquisition data is sparse (see PETAcquisitionDataSparse), the
+	value for each subset is computed from the forward projection of the
+	subset views by the acquisition model (see
+	PETAcquisitionModel::forward_subset_views) and the non-zero bins of the
+	data (see PETAcquisitionDataSparse::log_likelihood) rather than by
+	STIR, provided
+	that the projectors, additive term and normalisation are those set by
+	set_acquisition_model, the acquisition model has no background term
+	(which STIR does not model) and all segments are processed without
+	zeroing the end planes of segment 0. The normalisation is then applied
+	as by the acquisition model, i.e. regardless of the time frame.
+	*/
+
 	class xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF :
 		public stir::PoissonLogLikelihoodWithLinearModelForMeanAndProjData < Image3DF > {
 	public:
+		xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF()
+		{
+			sensitivity_cache_dir_ = sirf::getenv("SIRF_SENSITIVITY_CACHE_DIR");
+			std::string size = sirf::getenv("SIRF_SENSITIVITY_CACHE_SIZE");
+			sensitivity_cache_size_ = size.length() > 0 ? atoi(size.c_str()) : 4096;
+			std::string np = sirf::getenv("SIRF_NUM_PROCESSES");
+			num_processes_ = np.length() > 0 ? atoi(np.c_str()) : 1;
+		}
+		void set_sensitivity_cache_directory(const std::string& dir)
+		{
+			sensitivity_cache_dir_ = dir;
+		}
+		std::string sensitivity_cache_directory() const
+		{
+			return sensitivity_cache_dir_;
+		}
+		//! Sets the cache size in MB.
+		void set_sensitivity_cache_size(int size)
+		{
+			sensitivity_cache_size_ = size;
+		}
+		int sensitivity_cache_size() const
+		{
+			return sensitivity_cache_size_;
+		}
+		/*!
+		\brief Sets the number of processes computing subset gradients.
+
+		If greater than 1, the back-projections of the ratios of measured to
+		estimated data are computed by as many worker processes forked from
+		this one, each handling its share of the related viewgrams of the
+		subset, with the current estimate and partial gradients exchanged
+		via shared memory. Useful where STIR projectors are not
+		multi-threaded; on POSIX systems only, ignored elsewhere. The
+		workers are forked at set_up (or, if the number is changed
+		afterwards, at the next subset gradient) and handle segment 0 end
+		planes as STIR does. The default is the value of SIRF_NUM_PROCESSES
+		environment variable, or 1. See also sirf::ProcessPool.
+		*/
+		void set_num_processes(int num_processes)
+		{
+			num_processes_ = num_processes;
+			workers_.reset();
+		}
+		int num_processes() const
+		{
+			return num_processes_;
+		}
+		/*!
+		\brief Identifies the sensitivity images computed by the last
+		set_up.
+
+		Equal for set-ups with the same projectors, acquisition data
+		geometry, normalisation and its time frame, image geometry and
+		subsets. Empty before set_up, or if the normalisation was not set
+		by set_acquisition_model (and hence cannot be identified without
+		applying it).
+		*/
+		std::string sensitivity_id() const;
+		/// The id the sensitivity images set up for image would have with
+		/// the current settings (empty if it cannot be determined).
+		std::string sensitivity_id(const Image3DF& image);
+		virtual stir::Succeeded set_up(stir::shared_ptr<Image3DF> const& target_sptr);
 		void set_input_file(const char* filename) {
 			input_filename = filename;
 		}
 		void set_acquisition_data(stir::shared_ptr<PETAcquisitionData> sptr)
 		{
+			workers_.reset();
 			sptr_ad_ = sptr;
 			set_proj_data_sptr(sptr->data());
 		}
 		void set_acquisition_model(stir::shared_ptr<AcqMod3DF> sptr)
 		{
+			workers_.reset();
 			sptr_am_ = sptr;
 			AcqMod3DF& am = *sptr;
 			set_projector_pair_sptr(am.projectors_sptr());
 			if (am.additive_term_sptr().get())
 				set_additive_proj_data_sptr(am.additive_term_sptr()->data());
-			if (am.normalisation_sptr().get())
-				set_normalisation_sptr(am.normalisation_sptr());
+			sptr_asm_ = am.asm_sptr();
+			sptr_asm_norm_ = am.normalisation_sptr();
+			if (sptr_asm_norm_.get())
+				set_normalisation_sptr(sptr_asm_norm_);
 		}
 		stir::shared_ptr<AcqMod3DF> acquisition_model_sptr()
 		{
 			return sptr_am_;
 		}
+	protected:
+		virtual void actual_compute_subset_gradient_without_penalty
+			(Image3DF& gradient, const Image3DF& current_estimate,
+			const int subset_num, const bool add_sensitivity);
+		virtual double actual_compute_objective_function_without_penalty
+			(const Image3DF& current_estimate, const int subset_num);
 	private:
+		// the acquisition data if sparse and the value can be computed
+		// from its non-zero bins, 0 otherwise
+		const PETAcquisitionDataSparse* sparse_acquisition_data_() const;
 		stir::shared_ptr<PETAcquisitionData> sptr_ad_;
 		stir::shared_ptr<AcqMod3DF> sptr_am_;
+		// sensitivity model of the acquisition model and the normalisation
+		// it provided, by which the normalisation is identified
+		stir::shared_ptr<PETAcquisitionSensitivityModel> sptr_asm_;
+		stir::shared_ptr<stir::BinNormalisation> sptr_asm_norm_;
+		std::string sensitivity_cache_dir_;
+		int sensitivity_cache_size_;
+		// what the sensitivities depend on, computed at set_up
+		std::string sensitivity_key_;
+		int num_processes_;
+		// worker processes and their copies of the current estimate and
+		// of their part of the gradient
+		stir::shared_ptr<sirf::ProcessPool> workers_;
+		stir::shared_ptr<Image3DF> sptr_worker_estimate_;
+		stir::shared_ptr<Image3DF> sptr_worker_gradient_;
+		// STIR's set_up, reading cached sensitivities if available
+		stir::Succeeded set_up_sensitivities_
+			(stir::shared_ptr<Image3DF> const& target_sptr);
+		void start_workers_(const Image3DF& image);
+		void worker_gradient_(int worker, int subset_num, float* shared);
+		static void zero_end_planes_(stir::RelatedViewgrams<float>& viewgrams);
+		// empty if the normalisation cannot be identified
+		std::string sensitivity_cache_key_(const Image3DF& image);
+		void write_sensitivity_cache_
+			(const std::string& dir, const std::string& key);
+		// FNV-1a hash of a key, in hexadecimal
+		static std::string key_hash_(const std::string& key);
+		static void trim_sensitivity_cache_(const std::string& dir,
+			unsigned long long max_size, const std::string& keep);
 	};
 
 	typedef xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF
@@ -562,6 +1041,38 @@ The actual algorithm is described in
 		void set_initial_estimate_file(const char* filename) {
 			initial_data_filename = filename;
 		}
+		/*!
+		\brief Saves the state of the reconstruction in directory dir.
+
+		The checkpoint consists of the current estimate, the subiteration and
+		start subset numbers, the sensitivity images of a Poisson
+		log-likelihood objective function and, if with_matrix is true and
+		the acquisition model uses a ray tracing matrix, the matrix (see
+		PETAcquisitionModelUsingMatrix::write_matrix). Images are written
+		in Interfile format, i.e. as raw floats. New files are written
+		before the state file referring to them is replaced (by renaming),
+		and the files of the previous checkpoint are removed after that,
+		so a run killed at any point leaves a complete checkpoint.
+		Sensitivity images and matrix already saved for the same set-up are
+		not written again.
+		*/
+		void write_checkpoint(const std::string& dir, const Image3DF& image,
+			bool with_matrix = false);
+		/*!
+		\brief Sets up the reconstruction to continue from the checkpoint
+		saved in directory dir.
+
+		Called instead of set_up: the sensitivity images (and the matrix)
+		are read from the checkpoint rather than computed, the estimate is
+		copied into the image, which must have the geometry of the saved
+		one, and the subiteration and start subiteration numbers are
+		restored. The sensitivity images are read only if their id (see
+		xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+		sensitivity_id) is that of the current set-up, e.g. they are
+		recomputed if the normalisation has changed since the checkpoint.
+		*/
+		stir::Succeeded resume(const std::string& dir,
+			stir::shared_ptr<Image3DF> sptr_image);
 	};
 
 	class xSTIR_OSMAPOSLReconstruction3DF :
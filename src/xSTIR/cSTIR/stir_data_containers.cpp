@@ -19,7 +19,21 @@ limitations under the License.
 
 */
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <mutex>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
 #include "sirf/STIR/stir_data_containers.h"
+#include "sirf/common/getenv.h"
+#include "sirf/common/reductions.h"
+#include "sirf/common/thread_pool.h"
 #include "stir/KeyParser.h"
 #include "stir/is_null_ptr.h"
 
@@ -32,59 +46,970 @@ using namespace sirf;
 std::string PETAcquisitionData::_storage_scheme;
 shared_ptr<PETAcquisitionData> PETAcquisitionData::_template;
 
-float
-PETAcquisitionData::norm() const
+std::string PETAcquisitionDataInMappedFile::_scratch_dir;
+
+// number of elements processed by one task in the loops over data buffers
+static const size_t BUFFER_BLOCK_SIZE = 1 << 16;
+
+namespace {
+	// scratch file mapped to memory, deleted on destruction
+	class MappedFile {
+	public:
+		MappedFile(const std::string& filename, size_t size) :
+			_filename(filename)
+		{
+			{
+				std::filebuf fbuf;
+				if (!fbuf.open(filename.c_str(), std::ios::in | std::ios::out
+					| std::ios::trunc | std::ios::binary)) {
+					std::string msg = "cannot create scratch file " + filename;
+					THROW(msg.c_str());
+				}
+				fbuf.pubseekoff(size - 1, std::ios::beg);
+				fbuf.sputc(0);
+			}
+			try {
+				boost::interprocess::file_mapping
+					mapping(filename.c_str(), boost::interprocess::read_write);
+				boost::interprocess::mapped_region
+					region(mapping, boost::interprocess::read_write);
+				_region.swap(region);
+			}
+			catch (...) {
+				std::remove(filename.c_str());
+				throw;
+			}
+		}
+		~MappedFile()
+		{
+			boost::interprocess::mapped_region().swap(_region);
+			if (std::remove(_filename.c_str()))
+				std::cout << "deleting " << _filename << " "
+				<< "failed, please delete manually" << std::endl;
+		}
+		void* address()
+		{
+			return _region.get_address();
+		}
+	private:
+		std::string _filename;
+		boost::interprocess::mapped_region _region;
+	};
+}
+
+std::shared_ptr<float>
+ProjDataBufferStorage::mapped_file(const std::string& filename, size_t size)
+{
+	if (size == 0)
+		return std::shared_ptr<float>(new float[1](), std::default_delete<float[]>());
+	std::shared_ptr<MappedFile> sptr_file
+		(new MappedFile(filename, size*sizeof(float)));
+	return std::shared_ptr<float>(sptr_file, (float*)sptr_file->address());
+}
+
+std::string
+PETAcquisitionDataInMappedFile::scratch_directory()
 {
-	double t = 0.0;
-	for (int s = 0; s <= get_max_segment_num(); ++s)
+	if (_scratch_dir.length() > 0)
+		return _scratch_dir;
+	std::string dir = sirf::getenv("SIRF_SCRATCH_DIR");
+	return dir.length() > 0 ? dir : std::string(".");
+}
+
+// pointers to and lengths of the rows of a STIR array (each row is contiguous)
+static void
+array_rows(const Array<3, float>& a,
+	std::vector<const float*>& rows, std::vector<size_t>& lengths)
+{
+	for (int i = a.get_min_index(); i <= a.get_max_index(); i++) {
+		const Array<2, float>& ai = a[i];
+		for (int j = ai.get_min_index(); j <= ai.get_max_index(); j++) {
+			const Array<1, float>& r = ai[j];
+			if (r.size() > 0)
+				rows.push_back(&r[r.get_min_index()]);
+			else
+				rows.push_back(0);
+			lengths.push_back(r.size());
+		}
+	}
+}
+
+static double
+array_dot(const Array<3, float>& a, const Array<3, float>& b)
+{
+	std::vector<const float*> ra, rb;
+	std::vector<size_t> na, nb;
+	array_rows(a, ra, na);
+	array_rows(b, rb, nb);
+	size_t nr = std::min(ra.size(), rb.size());
+	size_t work = 0;
+	for (size_t k = 0; k < nr; k++)
+		work += std::min(na[k], nb[k]);
+	return Reductions::sum_of_items<double>(nr, work, [&](size_t k) {
+		return Reductions::serial_dot(ra[k], rb[k], std::min(na[k], nb[k]));
+	});
+}
+
+static double
+array_sum_sq(const Array<3, float>& a)
+{
+	std::vector<const float*> ra;
+	std::vector<size_t> na;
+	array_rows(a, ra, na);
+	size_t work = 0;
+	for (size_t k = 0; k < na.size(); k++)
+		work += na[k];
+	return Reductions::sum_of_items<double>(ra.size(), work, [&](size_t k) {
+		return Reductions::serial_sum_sq(ra[k], na[k]);
+	});
+}
+
+namespace {
+	/*
+	Splits the elements of STIR arrays z, x and y of the same shape into
+	pieces contiguous in each of them, to be processed by plain loops that
+	the compiler can vectorise. Rows of the arrays (which are contiguous) are
+	merged with the next ones when they follow each other in memory in all
+	three arrays, so that a contiguously stored image is split by size only;
+	pieces have at most BUFFER_BLOCK_SIZE elements.
+	*/
+	class ArrayPieces {
+	public:
+		ArrayPieces(Array<3, float>& z,
+			const Array<3, float>& x, const Array<3, float>& y) : _valid(false)
+		{
+			std::vector<const float*> rz, rx, ry;
+			std::vector<size_t> nz, nx, ny;
+			array_rows(z, rz, nz);
+			array_rows(x, rx, nx);
+			array_rows(y, ry, ny);
+			if (nz != nx || nz != ny)
+				return;
+			_valid = true;
+			size_t nr = nz.size();
+			for (size_t k = 0; k < nr;) {
+				size_t n = nz[k];
+				size_t l = k + 1;
+				for (; l < nr && rz[l] == rz[k] + n && rx[l] == rx[k] + n
+					&& ry[l] == ry[k] + n; l++)
+					n += nz[l];
+				for (size_t i = 0; i < n; i += BUFFER_BLOCK_SIZE) {
+					_z.push_back(const_cast<float*>(rz[k]) + i);
+					_x.push_back(rx[k] + i);
+					_y.push_back(ry[k] + i);
+					_n.push_back(std::min(n - i, BUFFER_BLOCK_SIZE));
+				}
+				k = l;
+			}
+		}
+		/// false if the arrays have different shapes
+		bool valid() const
+		{
+			return _valid;
+		}
+		size_t size() const
+		{
+			return _n.size();
+		}
+		/// calls op(k, z, x, y, n) for each piece k on the thread pool
+		template<class Op>
+		void for_each(const Op& op) const
+		{
+			parallel_for(_n.size(), [this, &op](size_t k) {
+				op(k, _z[k], _x[k], _y[k], _n[k]);
+			});
+		}
+	private:
+		bool _valid;
+		std::vector<float*> _z;
+		std::vector<const float*> _x;
+		std::vector<const float*> _y;
+		std::vector<size_t> _n;
+	};
+
+	// z = x / y with the divisors that are smaller than vmin by absolute
+	// value replaced by +vmin or -vmin (see STIRImageData::divide)
+	void divide_with_threshold(float* z, const float* x, const float* y,
+		size_t n, float vmin)
 	{
-		SegmentBySinogram<float> seg = get_segment_by_sinogram(s);
-		SegmentBySinogram<float>::full_iterator seg_iter;
-		for (seg_iter = seg.begin_all(); seg_iter != seg.end_all();) {
-			double r = *seg_iter++;
-			t += r*r;
+		for (size_t i = 0; i < n; i++) {
+			float vy = y[i];
+			if (vy >= 0 && vy < vmin)
+				vy = vmin;
+			else if (vy < 0 && vy > -vmin)
+				vy = -vmin;
+			z[i] = x[i] / vy;
+		}
+	}
+}
+
+namespace {
+	typedef SegmentBySinogram<float> Segment;
+	typedef std::shared_ptr<Segment> SegmentSptr;
+
+	/*
+	Processes the segments of PETAcquisitionData operands in the order
+	0, 1, -1, 2, -2, ... with disk I/O overlapped with computation:
+	while segment s is being processed by the calling thread, a task run by
+	the SIRF thread pool writes the result for the previous segment (if
+	there is a result) and reads the operands' segments for the next one
+	(if the pool has no free thread, the two run one after the other).
+	Segments are processed, and results written, in the same order as by a
+	sequential loop, hence the results are the same.
+	*/
+	class SegmentPipeline {
+	public:
+		typedef std::function<void(const std::vector<SegmentSptr>& in,
+			Segment* out)> Process;
+
+		SegmentPipeline(const std::vector<const PETAcquisitionData*>& operands,
+			int max_segment_num, PETAcquisitionData* result = 0) :
+			_operands(operands), _result(result)
+		{
+			for (int s = 0; s <= max_segment_num; s++) {
+				_segments.push_back(s);
+				if (s != 0)
+					_segments.push_back(-s);
+			}
 		}
-		if (s != 0) {
-			seg = get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(); seg_iter != seg.end_all();) {
-				double r = *seg_iter++;
-				t += r*r;
+		void run(const Process& process)
+		{
+			size_t ns = _segments.size();
+			if (ns < 1)
+				return;
+			std::vector<SegmentSptr> in = read_(_segments[0]);
+			SegmentSptr out;
+			for (size_t i = 0; i < ns; i++) {
+				std::vector<SegmentSptr> next;
+				SegmentSptr done = out;
+				if (_result)
+					out.reset(new Segment
+					(_result->get_empty_segment_by_sinogram(_segments[i])));
+				// task 0 is taken by the calling thread
+				parallel_for(2, [&](size_t task) {
+					if (task == 0) {
+						process(in, out.get());
+						return;
+					}
+					if (done)
+						_result->set_segment(*done);
+					if (i + 1 < ns)
+						next = read_(_segments[i + 1]);
+				});
+				in.swap(next);
 			}
+			if (out)
+				_result->set_segment(*out);
 		}
+	private:
+		std::vector<SegmentSptr> read_(int s) const
+		{
+			std::vector<SegmentSptr> segments;
+			for (size_t k = 0; k < _operands.size(); k++)
+				segments.push_back(SegmentSptr
+				(new Segment(_operands[k]->get_segment_by_sinogram(s))));
+			return segments;
+		}
+		std::vector<const PETAcquisitionData*> _operands;
+		PETAcquisitionData* _result;
+		std::vector<int> _segments;
+	};
+}
+
+ProjDataSubsetViews::ProjDataSubsetViews
+(shared_ptr<ExamInfo> sptr_exam_info, shared_ptr<ProjDataInfo> sptr_pdi,
+const std::vector<int>& view_nums) :
+ProjData(sptr_exam_info, sptr_pdi),
+_view_index(sptr_pdi->get_num_views(), -1)
+{
+	int min_view = get_min_view_num();
+	for (size_t i = 0; i < view_nums.size(); i++) {
+		int v = view_nums[i];
+		if (v < min_view || v > get_max_view_num())
+			THROW("view number out of range");
+		_view_index[v - min_view] = 0;
 	}
-	return sqrt((float)t);
+	int num_views = 0;
+	for (int v = min_view; v <= get_max_view_num(); v++)
+		if (in_subset(v)) {
+			_view_index[v - min_view] = num_views++;
+			_view_nums.push_back(v);
+		}
+	_num_tang_poss = get_num_tangential_poss();
+	size_t n = 0;
+	for (int s = get_min_segment_num(); s <= get_max_segment_num(); s++) {
+		_segment_offsets.push_back(n);
+		n += (size_t)num_views*get_num_axial_poss(s)*_num_tang_poss;
+	}
+	_data.assign(n, 0.0f);
+}
+
+Viewgram<float>
+ProjDataSubsetViews::get_viewgram(const int view_num, const int segment_num,
+const bool make_num_tangential_poss_odd) const
+{
+	Viewgram<float> v = get_proj_data_info_sptr()->get_empty_viewgram
+		(view_num, segment_num, make_num_tangential_poss_odd);
+	if (!in_subset(view_num))
+		return v;
+	int min_t = get_min_tangential_pos_num();
+	for (int a = get_min_axial_pos_num(segment_num);
+		a <= get_max_axial_pos_num(segment_num); a++) {
+		const float* row = &_data[offset_(segment_num, view_num, a)];
+		for (int t = 0; t < _num_tang_poss; t++)
+			v[a][min_t + t] = row[t];
+	}
+	return v;
 }
 
 void
-PETAcquisitionData::dot(const DataContainer& a_x, void* ptr) const
+ProjDataSubsetViews::check_outside_(const float* row, int n) const
 {
-	//PETAcquisitionData& x = (PETAcquisitionData&)a_x;
-	DYNAMIC_CAST(const PETAcquisitionData, x, a_x);
-	int n = get_max_segment_num();
-	int nx = x.get_max_segment_num();
-	double t = 0;
-	for (int s = 0; s <= n && s <= nx; ++s)
+	for (int t = 0; t < n; t++)
+		if (row[t] != 0)
+			THROW("cannot store non-zero values outside the subset views");
+}
+
+Succeeded
+ProjDataSubsetViews::set_viewgram(const Viewgram<float>& v)
+{
+	int view_num = v.get_view_num();
+	int segment_num = v.get_segment_num();
+	int min_t = get_min_tangential_pos_num();
+	if (!in_subset(view_num)) {
+		for (int a = get_min_axial_pos_num(segment_num);
+			a <= get_max_axial_pos_num(segment_num); a++)
+			check_outside_(&v[a][min_t], _num_tang_poss);
+		return Succeeded::yes;
+	}
+	for (int a = get_min_axial_pos_num(segment_num);
+		a <= get_max_axial_pos_num(segment_num); a++) {
+		float* row = &_data[offset_(segment_num, view_num, a)];
+		for (int t = 0; t < _num_tang_poss; t++)
+			row[t] = v[a][min_t + t];
+	}
+	return Succeeded::yes;
+}
+
+Sinogram<float>
+ProjDataSubsetViews::get_sinogram(const int ax_pos_num, const int segment_num,
+const bool make_num_tangential_poss_odd) const
+{
+	Sinogram<float> sino = get_proj_data_info_sptr()->get_empty_sinogram
+		(ax_pos_num, segment_num, make_num_tangential_poss_odd);
+	int min_t = get_min_tangential_pos_num();
+	for (size_t i = 0; i < _view_nums.size(); i++) {
+		int v = _view_nums[i];
+		const float* row = &_data[offset_(segment_num, v, ax_pos_num)];
+		for (int t = 0; t < _num_tang_poss; t++)
+			sino[v][min_t + t] = row[t];
+	}
+	return sino;
+}
+
+Succeeded
+ProjDataSubsetViews::set_sinogram(const Sinogram<float>& sino)
+{
+	int ax_pos_num = sino.get_axial_pos_num();
+	int segment_num = sino.get_segment_num();
+	int min_t = get_min_tangential_pos_num();
+	for (int v = get_min_view_num(); v <= get_max_view_num(); v++)
+		if (!in_subset(v))
+			check_outside_(&sino[v][min_t], _num_tang_poss);
+	for (size_t i = 0; i < _view_nums.size(); i++) {
+		int v = _view_nums[i];
+		float* row = &_data[offset_(segment_num, v, ax_pos_num)];
+		for (int t = 0; t < _num_tang_poss; t++)
+			row[t] = sino[v][min_t + t];
+	}
+	return Succeeded::yes;
+}
+
+SegmentBySinogram<float>
+ProjDataSubsetViews::get_segment_by_sinogram(const int segment_num) const
+{
+	SegmentBySinogram<float> seg =
+		get_proj_data_info_sptr()->get_empty_segment_by_sinogram(segment_num);
+	int min_t = get_min_tangential_pos_num();
+	for (int a = get_min_axial_pos_num(segment_num);
+		a <= get_max_axial_pos_num(segment_num); a++)
+		for (size_t i = 0; i < _view_nums.size(); i++) {
+			int v = _view_nums[i];
+			const float* row = &_data[offset_(segment_num, v, a)];
+			for (int t = 0; t < _num_tang_poss; t++)
+				seg[a][v][min_t + t] = row[t];
+		}
+	return seg;
+}
+
+Succeeded
+ProjDataSubsetViews::set_segment(const SegmentBySinogram<float>& seg)
+{
+	int segment_num = seg.get_segment_num();
+	int min_t = get_min_tangential_pos_num();
+	for (int a = get_min_axial_pos_num(segment_num);
+		a <= get_max_axial_pos_num(segment_num); a++)
+		for (int v = get_min_view_num(); v <= get_max_view_num(); v++)
+			if (!in_subset(v))
+				check_outside_(&seg[a][v][min_t], _num_tang_poss);
+	for (int a = get_min_axial_pos_num(segment_num);
+		a <= get_max_axial_pos_num(segment_num); a++)
+		for (size_t i = 0; i < _view_nums.size(); i++) {
+			int v = _view_nums[i];
+			float* row = &_data[offset_(segment_num, v, a)];
+			for (int t = 0; t < _num_tang_poss; t++)
+				row[t] = seg[a][v][min_t + t];
+		}
+	return Succeeded::yes;
+}
+
+uint16_t
+ProjDataReducedPrecision::half_from_float(float v)
+{
+	uint32_t x;
+	std::memcpy(&x, &v, sizeof(x));
+	uint16_t sign = (uint16_t)((x >> 16) & 0x8000);
+	uint32_t a = x & 0x7fffffff;
+	if (a >= 0x7f800000) // infinity or NaN
+		return sign | 0x7c00 | (a > 0x7f800000 ? 0x200 : 0);
+	if (a >= 0x477ff000) // rounds to 65520 or more: overflow
+		return sign | 0x7c00;
+	if (a < 0x38800000) { // below 2^-14: subnormal (scaling by 2^24 is exact)
+		float f;
+		std::memcpy(&f, &a, sizeof(f));
+		return sign | (uint16_t)std::lrint(f * 16777216.0f);
+	}
+	// rebias the exponent and round the mantissa to nearest even
+	a += 0xc8000fff + ((a >> 13) & 1);
+	return sign | (uint16_t)(a >> 13);
+}
+
+float
+ProjDataReducedPrecision::float_from_half(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t e = (h >> 10) & 0x1f;
+	uint32_t m = h & 0x3ff;
+	uint32_t x;
+	if (e == 0) {
+		float f = m*(1.0f / 16777216.0f);
+		std::memcpy(&x, &f, sizeof(x));
+		x |= sign;
+	}
+	else if (e == 31)
+		x = sign | 0x7f800000 | (m << 13);
+	else
+		x = sign | ((e + 112) << 23) | (m << 13);
+	float f;
+	std::memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+namespace {
+	// float values of all half precision numbers
+	const float* half_table()
 	{
-		SegmentBySinogram<float> seg = get_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
-		SegmentBySinogram<float>::full_iterator seg_iter;
-		SegmentBySinogram<float>::full_iterator sx_iter;
-		for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
-			seg_iter != seg.end_all() && sx_iter != sx.end_all();
-			/*empty*/) {
-			t += (*seg_iter++)*double(*sx_iter++);
+		static std::vector<float> table;
+		static std::once_flag once;
+		std::call_once(once, []() {
+			table.resize(1 << 16);
+			for (size_t h = 0; h < table.size(); h++)
+				table[h] = ProjDataReducedPrecision::float_from_half((uint16_t)h);
+		});
+		return table.data();
+	}
+}
+
+ProjDataReducedPrecision::ProjDataReducedPrecision
+(shared_ptr<ExamInfo> sptr_exam_info, shared_ptr<ProjDataInfo> sptr_pdi,
+Format format) :
+ProjData(sptr_exam_info, sptr_pdi), _format(format)
+{
+	_num_views = get_num_views();
+	_num_tang_poss = get_num_tangential_poss();
+	size_t num_rows = 0;
+	for (int s = get_min_segment_num(); s <= get_max_segment_num(); s++) {
+		_segment_rows.push_back(num_rows);
+		num_rows += (size_t)get_num_axial_poss(s)*_num_views;
+	}
+	// zeros in both formats
+	_data.assign(num_rows*_num_tang_poss, 0);
+	if (format == SCALED_UINT16) {
+		_offsets.assign(num_rows, 0.0f);
+		_scales.assign(num_rows, 1.0f);
+	}
+}
+
+void
+ProjDataReducedPrecision::get_row_(size_t r, float* v) const
+{
+	const uint16_t* row = &_data[r*_num_tang_poss];
+	if (_format == HALF) {
+		const float* table = half_table();
+		for (int t = 0; t < _num_tang_poss; t++)
+			v[t] = table[row[t]];
+		return;
+	}
+	float offset = _offsets[r];
+	float scale = _scales[r];
+	for (int t = 0; t < _num_tang_poss; t++)
+		v[t] = offset + scale*row[t];
+}
+
+void
+ProjDataReducedPrecision::set_row_(size_t r, const float* v)
+{
+	uint16_t* row = &_data[r*_num_tang_poss];
+	if (_format == HALF) {
+		for (int t = 0; t < _num_tang_poss; t++)
+			row[t] = half_from_float(v[t]);
+		return;
+	}
+	if (_num_tang_poss < 1)
+		return;
+	float vmin = v[0];
+	float vmax = v[0];
+	bool integer = true;
+	for (int t = 0; t < _num_tang_poss; t++) {
+		vmin = std::min(vmin, v[t]);
+		vmax = std::max(vmax, v[t]);
+		integer = integer && v[t] == std::floor(v[t]);
+	}
+	float scale = 1.0f;
+	if (!integer || double(vmax) - vmin > 65535.0)
+		scale = float((double(vmax) - vmin) / 65535.0);
+	if (scale == 0.0f)
+		scale = 1.0f;
+	_offsets[r] = vmin;
+	_scales[r] = scale;
+	for (int t = 0; t < _num_tang_poss; t++) {
+		double q = std::floor((double(v[t]) - vmin) / scale + 0.5);
+		row[t] = (uint16_t)std::min(65535.0, std::max(0.0, q));
+	}
+}
+
+Viewgram<float>
+ProjDataReducedPrecision::get_viewgram(const int view_num,
+const int segment_num, const bool make_num_tangential_poss_odd) const
+{
+	Viewgram<float> v = get_proj_data_info_sptr()->get_empty_viewgram
+		(view_num, segment_num, make_num_tangential_poss_odd);
+	int min_t = get_min_tangential_pos_num();
+	std::vector<float> row(_num_tang_poss);
+	for (int a = get_min_axial_pos_num(segment_num);
+		a <= get_max_axial_pos_num(segment_num); a++) {
+		get_row_(row_(segment_num, a, view_num), row.data());
+		for (int t = 0; t < _num_tang_poss; t++)
+			v[a][min_t + t] = row[t];
+	}
+	return v;
+}
+
+Succeeded
+ProjDataReducedPrecision::set_viewgram(const Viewgram<float>& v)
+{
+	int view_num = v.get_view_num();
+	int segment_num = v.get_segment_num();
+	int min_t = get_min_tangential_pos_num();
+	std::vector<float> row(_num_tang_poss);
+	for (int a = get_min_axial_pos_num(segment_num);
+		a <= get_max_axial_pos_num(segment_num); a++) {
+		for (int t = 0; t < _num_tang_poss; t++)
+			row[t] = v[a][min_t + t];
+		set_row_(row_(segment_num, a, view_num), row.data());
+	}
+	return Succeeded::yes;
+}
+
+Sinogram<float>
+ProjDataReducedPrecision::get_sinogram(const int ax_pos_num,
+const int segment_num, const bool make_num_tangential_poss_odd) const
+{
+	Sinogram<float> sino = get_proj_data_info_sptr()->get_empty_sinogram
+		(ax_pos_num, segment_num, make_num_tangential_poss_odd);
+	int min_t = get_min_tangential_pos_num();
+	std::vector<float> row(_num_tang_poss);
+	for (int v = get_min_view_num(); v <= get_max_view_num(); v++) {
+		get_row_(row_(segment_num, ax_pos_num, v), row.data());
+		for (int t = 0; t < _num_tang_poss; t++)
+			sino[v][min_t + t] = row[t];
+	}
+	return sino;
+}
+
+Succeeded
+ProjDataReducedPrecision::set_sinogram(const Sinogram<float>& sino)
+{
+	int ax_pos_num = sino.get_axial_pos_num();
+	int segment_num = sino.get_segment_num();
+	int min_t = get_min_tangential_pos_num();
+	std::vector<float> row(_num_tang_poss);
+	for (int v = get_min_view_num(); v <= get_max_view_num(); v++) {
+		for (int t = 0; t < _num_tang_poss; t++)
+			row[t] = sino[v][min_t + t];
+		set_row_(row_(segment_num, ax_pos_num, v), row.data());
+	}
+	return Succeeded::yes;
+}
+
+SegmentBySinogram<float>
+ProjDataReducedPrecision::get_segment_by_sinogram(const int segment_num) const
+{
+	SegmentBySinogram<float> seg =
+		get_proj_data_info_sptr()->get_empty_segment_by_sinogram(segment_num);
+	int min_t = get_min_tangential_pos_num();
+	std::vector<float> row(_num_tang_poss);
+	for (int a = get_min_axial_pos_num(segment_num);
+		a <= get_max_axial_pos_num(segment_num); a++)
+		for (int v = get_min_view_num(); v <= get_max_view_num(); v++) {
+			get_row_(row_(segment_num, a, v), row.data());
+			for (int t = 0; t < _num_tang_poss; t++)
+				seg[a][v][min_t + t] = row[t];
+		}
+	return seg;
+}
+
+Succeeded
+ProjDataReducedPrecision::set_segment(const SegmentBySinogram<float>& seg)
+{
+	int segment_num = seg.get_segment_num();
+	int min_t = get_min_tangential_pos_num();
+	std::vector<float> row(_num_tang_poss);
+	for (int a = get_min_axial_pos_num(segment_num);
+		a <= get_max_axial_pos_num(segment_num); a++)
+		for (int v = get_min_view_num(); v <= get_max_view_num(); v++) {
+			for (int t = 0; t < _num_tang_poss; t++)
+				row[t] = seg[a][v][min_t + t];
+			set_row_(row_(segment_num, a, v), row.data());
+		}
+	return Succeeded::yes;
+}
+
+ProjDataSparse::ProjDataSparse
+(shared_ptr<ExamInfo> sptr_exam_info, shared_ptr<ProjDataInfo> sptr_pdi) :
+ProjData(sptr_exam_info, sptr_pdi)
+{
+	_num_views = get_num_views();
+	_num_tang_poss = get_num_tangential_poss();
+	if (_num_tang_poss > 65536)
+		THROW("too many tangential positions for sparse projection data");
+	size_t offset = 0;
+	for (int s = get_min_segment_num(); s <= get_max_segment_num(); s++) {
+		size_t num_rows = (size_t)get_num_axial_poss(s)*_num_views;
+		SparseSegment seg;
+		seg.row_start.assign(num_rows + 1, 0);
+		_segments.push_back(seg);
+		_segment_offsets.push_back(offset);
+		offset += num_rows*_num_tang_poss;
+	}
+}
+
+size_t
+ProjDataSparse::num_nonzeros() const
+{
+	size_t n = 0;
+	for (size_t k = 0; k < _segments.size(); k++)
+		n += _segments[k].values.size();
+	return n;
+}
+
+void
+ProjDataSparse::for_each_nonzero
+(const std::function<void(size_t, size_t, float)>& f) const
+{
+	parallel_for(_segments.size(), [&](size_t k) {
+		const SparseSegment& seg = _segments[k];
+		size_t num_rows = seg.row_start.size() - 1;
+		for (size_t r = 0; r < num_rows; r++) {
+			size_t row_offset = _segment_offsets[k] + r*_num_tang_poss;
+			for (size_t j = seg.row_start[r]; j < seg.row_start[r + 1]; j++)
+				f(k, row_offset + seg.tang_pos[j], seg.values[j]);
+		}
+	});
+}
+
+void
+ProjDataSparse::get_row_(const SparseSegment& seg, size_t r, float* v) const
+{
+	std::fill(v, v + _num_tang_poss, 0.0f);
+	for (size_t j = seg.row_start[r]; j < seg.row_start[r + 1]; j++)
+		v[seg.tang_pos[j]] = seg.values[j];
+}
+
+void
+ProjDataSparse::set_rows_(int segment_num, const std::vector<size_t>& rows,
+	const std::vector<float>& data)
+{
+	SparseSegment& old_seg = _segments[segment_num - get_min_segment_num()];
+	size_t num_rows = old_seg.row_start.size() - 1;
+	SparseSegment seg;
+	seg.row_start.reserve(num_rows + 1);
+	size_t i = 0;
+	for (size_t r = 0; r < num_rows; r++) {
+		seg.row_start.push_back(seg.values.size());
+		if (i < rows.size() && rows[i] == r) {
+			const float* v = &data[i*_num_tang_poss];
+			for (int t = 0; t < _num_tang_poss; t++)
+				if (v[t] != 0.0f) {
+					seg.tang_pos.push_back((uint16_t)t);
+					seg.values.push_back(v[t]);
+				}
+			i++;
+			continue;
 		}
-		if (s != 0) {
-			seg = get_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
-				seg_iter != seg.end_all() && sx_iter != sx.end_all();
-				/*empty*/)
-				t += (*seg_iter++)*double(*sx_iter++);
+		for (size_t j = old_seg.row_start[r]; j < old_seg.row_start[r + 1]; j++) {
+			seg.tang_pos.push_back(old_seg.tang_pos[j]);
+			seg.values.push_back(old_seg.values[j]);
 		}
 	}
+	seg.row_start.push_back(seg.values.size());
+	seg.tang_pos.shrink_to_fit();
+	seg.values.shrink_to_fit();
+	std::swap(old_seg, seg);
+}
+
+Viewgram<float>
+ProjDataSparse::get_viewgram(const int view_num,
+const int segment_num, const bool make_num_tangential_poss_odd) const
+{
+	Viewgram<float> v = get_proj_data_info_sptr()->get_empty_viewgram
+		(view_num, segment_num, make_num_tangential_poss_odd);
+	const SparseSegment& seg = _segments[segment_num - get_min_segment_num()];
+	int min_a = get_min_axial_pos_num(segment_num);
+	int min_t = get_min_tangential_pos_num();
+	std::vector<float> row(_num_tang_poss);
+	for (int a = min_a; a <= get_max_axial_pos_num(segment_num); a++) {
+		get_row_(seg, (size_t)(a - min_a)*_num_views + view_num -
+			get_min_view_num(), row.data());
+		for (int t = 0; t < _num_tang_poss; t++)
+			v[a][min_t + t] = row[t];
+	}
+	return v;
+}
+
+Succeeded
+ProjDataSparse::set_viewgram(const Viewgram<float>& v)
+{
+	int view_num = v.get_view_num();
+	int segment_num = v.get_segment_num();
+	int min_a = get_min_axial_pos_num(segment_num);
+	int min_t = get_min_tangential_pos_num();
+	std::vector<size_t> rows;
+	std::vector<float> data;
+	for (int a = min_a; a <= get_max_axial_pos_num(segment_num); a++) {
+		rows.push_back((size_t)(a - min_a)*_num_views + view_num -
+			get_min_view_num());
+		for (int t = 0; t < _num_tang_poss; t++)
+			data.push_back(v[a][min_t + t]);
+	}
+	set_rows_(segment_num, rows, data);
+	return Succeeded::yes;
+}
+
+Sinogram<float>
+ProjDataSparse::get_sinogram(const int ax_pos_num,
+const int segment_num, const bool make_num_tangential_poss_odd) const
+{
+	Sinogram<float> sino = get_proj_data_info_sptr()->get_empty_sinogram
+		(ax_pos_num, segment_num, make_num_tangential_poss_odd);
+	const SparseSegment& seg = _segments[segment_num - get_min_segment_num()];
+	size_t first_row = (size_t)(ax_pos_num -
+		get_min_axial_pos_num(segment_num))*_num_views;
+	int min_t = get_min_tangential_pos_num();
+	std::vector<float> row(_num_tang_poss);
+	for (int v = get_min_view_num(); v <= get_max_view_num(); v++) {
+		get_row_(seg, first_row + v - get_min_view_num(), row.data());
+		for (int t = 0; t < _num_tang_poss; t++)
+			sino[v][min_t + t] = row[t];
+	}
+	return sino;
+}
+
+Succeeded
+ProjDataSparse::set_sinogram(const Sinogram<float>& sino)
+{
+	int ax_pos_num = sino.get_axial_pos_num();
+	int segment_num = sino.get_segment_num();
+	size_t first_row = (size_t)(ax_pos_num -
+		get_min_axial_pos_num(segment_num))*_num_views;
+	int min_t = get_min_tangential_pos_num();
+	std::vector<size_t> rows;
+	std::vector<float> data;
+	for (int v = get_min_view_num(); v <= get_max_view_num(); v++) {
+		rows.push_back(first_row + v - get_min_view_num());
+		for (int t = 0; t < _num_tang_poss; t++)
+			data.push_back(sino[v][min_t + t]);
+	}
+	set_rows_(segment_num, rows, data);
+	return Succeeded::yes;
+}
+
+SegmentBySinogram<float>
+ProjDataSparse::get_segment_by_sinogram(const int segment_num) const
+{
+	SegmentBySinogram<float> segment =
+		get_proj_data_info_sptr()->get_empty_segment_by_sinogram(segment_num);
+	const SparseSegment& seg = _segments[segment_num - get_min_segment_num()];
+	int min_t = get_min_tangential_pos_num();
+	std::vector<float> row(_num_tang_poss);
+	size_t r = 0;
+	for (int a = get_min_axial_pos_num(segment_num);
+		a <= get_max_axial_pos_num(segment_num); a++)
+		for (int v = get_min_view_num(); v <= get_max_view_num(); v++, r++) {
+			get_row_(seg, r, row.data());
+			for (int t = 0; t < _num_tang_poss; t++)
+				segment[a][v][min_t + t] = row[t];
+		}
+	return segment;
+}
+
+Succeeded
+ProjDataSparse::set_segment(const SegmentBySinogram<float>& segment)
+{
+	int segment_num = segment.get_segment_num();
+	int min_t = get_min_tangential_pos_num();
+	std::vector<size_t> rows;
+	std::vector<float> data;
+	data.reserve((size_t)get_num_axial_poss(segment_num)*_num_views*
+		_num_tang_poss);
+	for (int a = get_min_axial_pos_num(segment_num);
+		a <= get_max_axial_pos_num(segment_num); a++)
+		for (int v = get_min_view_num(); v <= get_max_view_num(); v++) {
+			rows.push_back(rows.size());
+			for (int t = 0; t < _num_tang_poss; t++)
+				data.push_back(segment[a][v][min_t + t]);
+		}
+	set_rows_(segment_num, rows, data);
+	return Succeeded::yes;
+}
+
+Succeeded
+ProjDataSparse::set_segment(const SegmentByView<float>& segment)
+{
+	int segment_num = segment.get_segment_num();
+	int min_t = get_min_tangential_pos_num();
+	std::vector<size_t> rows;
+	std::vector<float> data;
+	data.reserve((size_t)get_num_axial_poss(segment_num)*_num_views*
+		_num_tang_poss);
+	for (int a = get_min_axial_pos_num(segment_num);
+		a <= get_max_axial_pos_num(segment_num); a++)
+		for (int v = get_min_view_num(); v <= get_max_view_num(); v++) {
+			rows.push_back(rows.size());
+			for (int t = 0; t < _num_tang_poss; t++)
+				data.push_back(segment[v][a][min_t + t]);
+		}
+	set_rows_(segment_num, rows, data);
+	return Succeeded::yes;
+}
+
+void
+ProjDataSparse::fill(const ProjData& proj_data)
+{
+	if (!(*proj_data.get_proj_data_info_sptr() == *get_proj_data_info_sptr()))
+		THROW("sparse projection data can only be filled from data of the "
+			"same geometry");
+	for (int s = get_min_segment_num(); s <= get_max_segment_num(); s++)
+		set_segment(proj_data.get_segment_by_sinogram(s));
+}
+
+bool
+PETAcquisitionData::same_buffer_layout(const PETAcquisitionData& x) const
+{
+	if (!buffer() || !x.buffer() || buffer_size() != x.buffer_size())
+		return false;
+	// subset buffers have the same layout only if the subsets are the same
+	const ProjDataSubsetViews* s = subset_views();
+	const ProjDataSubsetViews* sx = x.subset_views();
+	if ((s == 0) != (sx == 0))
+		return false;
+	if (s && s->view_nums() != sx->view_nums())
+		return false;
+	return *get_proj_data_info_sptr() == *x.get_proj_data_info_sptr();
+}
+
+float
+PETAcquisitionData::norm() const
+{
+	if (buffer())
+		return (float)sqrt(Reductions::sum_sq(buffer(), buffer_size()));
+	std::vector<double> t;
+	SegmentPipeline({ this }, get_max_segment_num()).run
+		([&t](const std::vector<SegmentSptr>& in, Segment*) {
+		t.push_back(array_sum_sq(*in[0]));
+	});
+	return (float)sqrt(Reductions::pairwise_sum(t));
+}
+
+// true if x stores only its non-zero bins and y is in a buffer of the
+// same geometry
+static bool
+sparse_and_dense(const PETAcquisitionData& x, const PETAcquisitionData& y)
+{
+	return x.sparse() && y.buffer() && !y.subset_views() &&
+		*x.get_proj_data_info_sptr() == *y.get_proj_data_info_sptr();
+}
+
+static double
+sparse_dot(const ProjDataSparse& x, const float* y)
+{
+	std::vector<double> t(x.get_num_segments(), 0.0);
+	x.for_each_nonzero([&t, y](size_t k, size_t i, float v) {
+		t[k] += v*double(y[i]);
+	});
+	return Reductions::pairwise_sum(t);
+}
+
+// z[i] = f(x[i], y[i]) for a sparse x, and y and z in buffers of its
+// geometry: f(0, y[i]) is computed for all bins, then f(x[i], y[i]) for
+// the non-zero x[i]
+template<class F>
+static void
+sparse_dense_op(float* z, const ProjDataSparse& x, const float* y, size_t n,
+	F f)
+{
+	// values of y at the non-zero bins of x, if y is overwritten
+	std::vector<std::vector<float> > yx(x.get_num_segments());
+	if (y == z)
+		x.for_each_nonzero([&yx, y](size_t k, size_t i, float) {
+			yx[k].push_back(y[i]);
+		});
+	parallel_for_blocks(n, BUFFER_BLOCK_SIZE, [=](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			z[i] = f(0.0f, y[i]);
+	});
+	std::vector<size_t> pos(yx.size(), 0);
+	x.for_each_nonzero([&](size_t k, size_t i, float v) {
+		z[i] = f(v, y == z ? yx[k][pos[k]++] : y[i]);
+	});
+}
+
+void
+PETAcquisitionData::dot(const DataContainer& a_x, void* ptr) const
+{
+	//PETAcquisitionData& x = (PETAcquisitionData&)a_x;
+	DYNAMIC_CAST(const PETAcquisitionData, x, a_x);
 	float* ptr_t = (float*)ptr;
-	*ptr_t = (float)t;
+	if (same_buffer_layout(x)) {
+		*ptr_t = (float)Reductions::dot(buffer(), x.buffer(), buffer_size());
+		return;
+	}
+	if (sparse_and_dense(*this, x)) {
+		*ptr_t = (float)sparse_dot(*sparse(), x.buffer());
+		return;
+	}
+	if (sparse_and_dense(x, *this)) {
+		*ptr_t = (float)sparse_dot(*x.sparse(), buffer());
+		return;
+	}
+	int n = get_max_segment_num();
+	int nx = x.get_max_segment_num();
+	std::vector<double> t;
+	SegmentPipeline({ this, &x }, std::min(n, nx)).run
+		([&t](const std::vector<SegmentSptr>& in, Segment*) {
+		t.push_back(array_dot(*in[0], *in[1]));
+	});
+	*ptr_t = (float)Reductions::pairwise_sum(t);
 }
 
 void
@@ -99,17 +1024,38 @@ const void* ptr_b, const DataContainer& a_y
 	DYNAMIC_CAST(const PETAcquisitionData, y, a_y);
 	//PETAcquisitionData& x = (PETAcquisitionData&)a_x;
 	//PETAcquisitionData& y = (PETAcquisitionData&)a_y;
+	if (same_buffer_layout(x) && same_buffer_layout(y)) {
+		float* pz = buffer();
+		const float* px = x.buffer();
+		const float* py = y.buffer();
+		parallel_for_blocks(buffer_size(), BUFFER_BLOCK_SIZE,
+			[=](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+				pz[i] = float(a*double(px[i]) + b*double(py[i]));
+		});
+		return;
+	}
+	if (sparse_and_dense(x, *this) && same_buffer_layout(y)) {
+		sparse_dense_op(buffer(), *x.sparse(), y.buffer(), buffer_size(),
+			[a, b](float u, float v) { return float(a*double(u) + b*double(v)); });
+		return;
+	}
+	if (sparse_and_dense(y, *this) && same_buffer_layout(x)) {
+		sparse_dense_op(buffer(), *y.sparse(), x.buffer(), buffer_size(),
+			[a, b](float u, float v) { return float(a*double(v) + b*double(u)); });
+		return;
+	}
 	int n = get_max_segment_num();
 	int nx = x.get_max_segment_num();
 	int ny = y.get_max_segment_num();
-	for (int s = 0; s <= n && s <= nx && s <= ny; ++s)
-	{
-		SegmentBySinogram<float> seg = get_empty_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
-		SegmentBySinogram<float> sy = y.get_segment_by_sinogram(s);
-		SegmentBySinogram<float>::full_iterator seg_iter;
-		SegmentBySinogram<float>::full_iterator sx_iter;
-		SegmentBySinogram<float>::full_iterator sy_iter;
+	SegmentPipeline({ &x, &y }, std::min(n, std::min(nx, ny)), this).run
+		([=](const std::vector<SegmentSptr>& in, Segment* out) {
+		Segment& seg = *out;
+		Segment& sx = *in[0];
+		Segment& sy = *in[1];
+		Segment::full_iterator seg_iter;
+		Segment::full_iterator sx_iter;
+		Segment::full_iterator sy_iter;
 		for (seg_iter = seg.begin_all(),
 			sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
 			seg_iter != seg.end_all() &&
@@ -117,21 +1063,7 @@ const void* ptr_b, const DataContainer& a_y
 		/*empty*/) {
 			*seg_iter++ = float(a*double(*sx_iter++) + b*double(*sy_iter++));
 		}
-		set_segment(seg);
-		if (s != 0) {
-			seg = get_empty_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			sy = y.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(),
-				sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
-				seg_iter != seg.end_all() &&
-				sx_iter != sx.end_all() && sy_iter != sy.end_all();
-			/*empty*/) {
-				*seg_iter++ = float(a*double(*sx_iter++) + b*double(*sy_iter++));
-			}
-			set_segment(seg);
-		}
-	}
+	});
 }
 
 void
@@ -139,32 +1071,29 @@ PETAcquisitionData::inv(float amin, const DataContainer& a_x)
 {
 	//PETAcquisitionData& x = (PETAcquisitionData&)a_x;
 	DYNAMIC_CAST(const PETAcquisitionData, x, a_x);
+	if (same_buffer_layout(x)) {
+		float* pz = buffer();
+		const float* px = x.buffer();
+		parallel_for_blocks(buffer_size(), BUFFER_BLOCK_SIZE,
+			[=](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+				pz[i] = float(1.0 / std::max(amin, px[i]));
+		});
+		return;
+	}
 	int n = get_max_segment_num();
 	int nx = x.get_max_segment_num();
-	for (int s = 0; s <= n && s <= nx; ++s)
-	{
-		//std::cout << "processing segment " << s << std::endl;
-		SegmentBySinogram<float> seg = get_empty_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
-		SegmentBySinogram<float>::full_iterator seg_iter;
-		SegmentBySinogram<float>::full_iterator sx_iter;
+	SegmentPipeline({ &x }, std::min(n, nx), this).run
+		([amin](const std::vector<SegmentSptr>& in, Segment* out) {
+		Segment& seg = *out;
+		Segment& sx = *in[0];
+		Segment::full_iterator seg_iter;
+		Segment::full_iterator sx_iter;
 		for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
 			seg_iter != seg.end_all() && sx_iter != sx.end_all();
 			/*empty*/)
 			*seg_iter++ = float(1.0 / std::max(amin, *sx_iter++));
-		set_segment(seg);
-		if (s != 0) {
-			//std::cout << "processing segment " << -s << std::endl;
-			seg = get_empty_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
-				seg_iter != seg.end_all() && sx_iter != sx.end_all();
-				/*empty*/) {
-				*seg_iter++ = float(1.0 / std::max(amin, *sx_iter++));
-			}
-			set_segment(seg);
-		}
-	}
+	});
 }
 
 void
@@ -177,17 +1106,38 @@ const DataContainer& a_y
 	//PETAcquisitionData& y = (PETAcquisitionData&)a_y;
 	DYNAMIC_CAST(const PETAcquisitionData, x, a_x);
 	DYNAMIC_CAST(const PETAcquisitionData, y, a_y);
+	if (same_buffer_layout(x) && same_buffer_layout(y)) {
+		float* pz = buffer();
+		const float* px = x.buffer();
+		const float* py = y.buffer();
+		parallel_for_blocks(buffer_size(), BUFFER_BLOCK_SIZE,
+			[=](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+				pz[i] = px[i] * py[i];
+		});
+		return;
+	}
+	if (sparse_and_dense(x, *this) && same_buffer_layout(y)) {
+		sparse_dense_op(buffer(), *x.sparse(), y.buffer(), buffer_size(),
+			[](float u, float v) { return u * v; });
+		return;
+	}
+	if (sparse_and_dense(y, *this) && same_buffer_layout(x)) {
+		sparse_dense_op(buffer(), *y.sparse(), x.buffer(), buffer_size(),
+			[](float u, float v) { return v * u; });
+		return;
+	}
 	int n = get_max_segment_num();
 	int nx = x.get_max_segment_num();
 	int ny = y.get_max_segment_num();
-	for (int s = 0; s <= n && s <= nx && s <= ny; ++s)
-	{
-		SegmentBySinogram<float> seg = get_empty_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
-		SegmentBySinogram<float> sy = y.get_segment_by_sinogram(s);
-		SegmentBySinogram<float>::full_iterator seg_iter;
-		SegmentBySinogram<float>::full_iterator sx_iter;
-		SegmentBySinogram<float>::full_iterator sy_iter;
+	SegmentPipeline({ &x, &y }, std::min(n, std::min(nx, ny)), this).run
+		([](const std::vector<SegmentSptr>& in, Segment* out) {
+		Segment& seg = *out;
+		Segment& sx = *in[0];
+		Segment& sy = *in[1];
+		Segment::full_iterator seg_iter;
+		Segment::full_iterator sx_iter;
+		Segment::full_iterator sy_iter;
 		for (seg_iter = seg.begin_all(),
 			sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
 			seg_iter != seg.end_all() &&
@@ -195,21 +1145,7 @@ const DataContainer& a_y
 		/*empty*/) {
 			*seg_iter++ = (*sx_iter++) * (*sy_iter++);
 		}
-		set_segment(seg);
-		if (s != 0) {
-			seg = get_empty_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			sy = y.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(),
-				sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
-				seg_iter != seg.end_all() &&
-				sx_iter != sx.end_all() && sy_iter != sy.end_all();
-			/*empty*/) {
-				*seg_iter++ = (*sx_iter++) * (*sy_iter++);
-			}
-			set_segment(seg);
-		}
-	}
+	});
 }
 
 void
@@ -222,17 +1158,33 @@ const DataContainer& a_y
 	//PETAcquisitionData& y = (PETAcquisitionData&)a_y;
 	DYNAMIC_CAST(const PETAcquisitionData, x, a_x);
 	DYNAMIC_CAST(const PETAcquisitionData, y, a_y);
+	if (same_buffer_layout(x) && same_buffer_layout(y)) {
+		float* pz = buffer();
+		const float* px = x.buffer();
+		const float* py = y.buffer();
+		parallel_for_blocks(buffer_size(), BUFFER_BLOCK_SIZE,
+			[=](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+				pz[i] = px[i] / py[i];
+		});
+		return;
+	}
+	if (sparse_and_dense(x, *this) && same_buffer_layout(y)) {
+		sparse_dense_op(buffer(), *x.sparse(), y.buffer(), buffer_size(),
+			[](float u, float v) { return u / v; });
+		return;
+	}
 	int n = get_max_segment_num();
 	int nx = x.get_max_segment_num();
 	int ny = y.get_max_segment_num();
-	for (int s = 0; s <= n && s <= nx && s <= ny; ++s)
-	{
-		SegmentBySinogram<float> seg = get_empty_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
-		SegmentBySinogram<float> sy = y.get_segment_by_sinogram(s);
-		SegmentBySinogram<float>::full_iterator seg_iter;
-		SegmentBySinogram<float>::full_iterator sx_iter;
-		SegmentBySinogram<float>::full_iterator sy_iter;
+	SegmentPipeline({ &x, &y }, std::min(n, std::min(nx, ny)), this).run
+		([](const std::vector<SegmentSptr>& in, Segment* out) {
+		Segment& seg = *out;
+		Segment& sx = *in[0];
+		Segment& sy = *in[1];
+		Segment::full_iterator seg_iter;
+		Segment::full_iterator sx_iter;
+		Segment::full_iterator sy_iter;
 		for (seg_iter = seg.begin_all(),
 			sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
 			seg_iter != seg.end_all() &&
@@ -240,21 +1192,85 @@ const DataContainer& a_y
 		/*empty*/) {
 			*seg_iter++ = (*sx_iter++) / (*sy_iter++);
 		}
-		set_segment(seg);
-		if (s != 0) {
-			seg = get_empty_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			sy = y.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(),
-				sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
-				seg_iter != seg.end_all() &&
-				sx_iter != sx.end_all() && sy_iter != sy.end_all();
-			/*empty*/) {
-				*seg_iter++ = (*sx_iter++) / (*sy_iter++);
-			}
-			set_segment(seg);
+	});
+}
+
+// the term of bin i of the Poisson log-likelihood, as by STIR
+static inline double
+log_likelihood_term(float y, float m)
+{
+	const float max_quotient = 10000.0f;
+	const float m_thresholded = std::max(m, y / max_quotient);
+	double t = -double(m_thresholded);
+	if (y > 0)
+		t += y*std::log(double(m_thresholded));
+	return t;
+}
+
+double
+PETAcquisitionDataSparse::log_likelihood(const PETAcquisitionData& mean) const
+{
+	if (sparse_and_dense(*this, mean)) {
+		// the terms of all bins as if y were zero, corrected at the
+		// non-zero bins of y
+		const float* pm = mean.buffer();
+		double sum_zero = Reductions::blocked_sum<double>(mean.buffer_size(),
+			[pm](size_t i) { return log_likelihood_term(0.0f, pm[i]); });
+		std::vector<double> t(data()->get_num_segments(), 0.0);
+		sparse()->for_each_nonzero([&t, pm](size_t k, size_t i, float y) {
+			t[k] += log_likelihood_term(y, pm[i]) -
+				log_likelihood_term(0.0f, pm[i]);
+		});
+		return sum_zero + Reductions::pairwise_sum(t);
+	}
+	if (!(*get_proj_data_info_sptr() == *mean.get_proj_data_info_sptr()))
+		THROW("log-likelihood: the mean has a different geometry");
+	const ProjDataSubsetViews* ptr_s = mean.subset_views();
+	if (ptr_s) {
+		const float* pm = ptr_s->buffer();
+		double sum_zero = Reductions::blocked_sum<double>(ptr_s->size(),
+			[pm](size_t i) { return log_likelihood_term(0.0f, pm[i]); });
+		// the non-zero bins of y are located by their index in the
+		// sinogram order (segment, axial position, view, tangential
+		// position), as given by for_each_nonzero
+		const ProjData& pd = *data();
+		const int min_segment_num = pd.get_min_segment_num();
+		const int min_view_num = pd.get_min_view_num();
+		const size_t num_views = pd.get_num_views();
+		const size_t num_tang_poss = pd.get_num_tangential_poss();
+		std::vector<size_t> offsets;
+		size_t n = 0;
+		for (int s = min_segment_num; s <= pd.get_max_segment_num(); s++) {
+			offsets.push_back(n);
+			n += pd.get_num_axial_poss(s)*num_views*num_tang_poss;
 		}
+		std::vector<double> t(offsets.size(), 0.0);
+		sparse()->for_each_nonzero([&](size_t k, size_t i, float y) {
+			const int s = min_segment_num + (int)k;
+			const size_t r = (i - offsets[k]) / num_tang_poss;
+			const int v = min_view_num + (int)(r % num_views);
+			const int a = pd.get_min_axial_pos_num(s) + (int)(r / num_views);
+			const float* row = ptr_s->row(s, v, a);
+			if (!row)
+				return;
+			const float m = row[(i - offsets[k]) % num_tang_poss];
+			t[k] += log_likelihood_term(y, m) - log_likelihood_term(0.0f, m);
+		});
+		return sum_zero + Reductions::pairwise_sum(t);
 	}
+	std::vector<double> t;
+	SegmentPipeline({ this, &mean }, get_max_segment_num()).run
+		([&t](const std::vector<SegmentSptr>& in, Segment*) {
+		double s = 0;
+		Segment::full_iterator y_iter;
+		Segment::full_iterator m_iter;
+		for (y_iter = in[0]->begin_all(), m_iter = in[1]->begin_all();
+			y_iter != in[0]->end_all() && m_iter != in[1]->end_all();
+			++y_iter, ++m_iter)
+			s += log_likelihood_term(*y_iter, *m_iter);
+		t.push_back(s);
+	});
+	return Reductions::pairwise_sum(t);
 }
 
 STIRImageData::STIRImageData(const ImageData& id)
@@ -315,23 +1331,8 @@ STIRImageData::dot(const DataContainer& a_x, void* ptr) const
 {
 	//STIRImageData& x = (STIRImageData&)a_x;
 	DYNAMIC_CAST(const STIRImageData, x, a_x);
-#if defined(_MSC_VER) && _MSC_VER < 1900
-	Image3DF::const_full_iterator iter;
-	Image3DF::const_full_iterator iter_x;
-#else
-	typename Array<3, float>::const_full_iterator iter;
-	typename Array<3, float>::const_full_iterator iter_x;
-#endif
-
-	double s = 0.0;
-	for (iter = data().begin_all(), iter_x = x.data().begin_all();
-		iter != data().end_all() && iter_x != x.data().end_all(); 
-		iter++, iter_x++) {
-		double t = *iter;
-		s += t * (*iter_x);
-	}
 	float* ptr_s = (float*)ptr;
-	*ptr_s = (float)s;
+	*ptr_s = (float)array_dot(data(), x.data());
 }
 
 void
@@ -345,6 +1346,15 @@ const void* ptr_b, const DataContainer& a_y)
 	DYNAMIC_CAST(const STIRImageData, y, a_y);
 	//STIRImageData& x = (STIRImageData&)a_x;
 	//STIRImageData& y = (STIRImageData&)a_y;
+	ArrayPieces pieces(data(), x.data(), y.data());
+	if (pieces.valid()) {
+		pieces.for_each([a, b](size_t, float* pz, const float* px,
+			const float* py, size_t n) {
+			for (size_t i = 0; i < n; i++)
+				pz[i] = a * px[i] + b * py[i];
+		});
+		return;
+	}
 #if defined(_MSC_VER) && _MSC_VER < 1900
 	Image3DF::full_iterator iter;
 	Image3DF::const_full_iterator iter_x;
@@ -366,20 +1376,7 @@ const void* ptr_b, const DataContainer& a_y)
 float
 STIRImageData::norm() const
 {
-#if defined(_MSC_VER) && _MSC_VER < 1900
-	//Array<3, float>::const_full_iterator iter;
-	Image3DF::const_full_iterator iter;
-#else
-	typename Array<3, float>::const_full_iterator iter;
-#endif
-	double s = 0.0;
-	int i = 0;
-	for (iter = _data->begin_all(); iter != _data->end_all(); iter++, i++) {
-		double t = *iter;
-		s += t*t;
-	}
-	//std::cout << "voxels count: " << i << std::endl;
-	return (float)sqrt(s);
+	return (float)sqrt(array_sum_sq(data()));
 }
 
 void
@@ -391,6 +1388,15 @@ const DataContainer& a_y)
 	//STIRImageData& y = (STIRImageData&)a_y;
 	DYNAMIC_CAST(const STIRImageData, x, a_x);
 	DYNAMIC_CAST(const STIRImageData, y, a_y);
+	ArrayPieces pieces(data(), x.data(), y.data());
+	if (pieces.valid()) {
+		pieces.for_each([](size_t, float* pz, const float* px,
+			const float* py, size_t n) {
+			for (size_t i = 0; i < n; i++)
+				pz[i] = px[i] * py[i];
+		});
+		return;
+	}
 #if defined(_MSC_VER) && _MSC_VER < 1900
 	Image3DF::full_iterator iter;
 	Image3DF::const_full_iterator iter_x;
@@ -418,6 +1424,46 @@ const DataContainer& a_y)
 	//STIRImageData& y = (STIRImageData&)a_y;
 	DYNAMIC_CAST(const STIRImageData, x, a_x);
 	DYNAMIC_CAST(const STIRImageData, y, a_y);
+	ArrayPieces pieces(data(), x.data(), y.data());
+	if (pieces.valid()) {
+		// divisors smaller by absolute value than 1e-6 of the largest are
+		// replaced by the threshold; if the result is not one of the
+		// operands, the division is done in the same pass as finding the
+		// largest divisor, and is only redone for the pieces that have
+		// divisors below the threshold (usually none)
+		bool fused = &data() != &x.data() && &data() != &y.data();
+		std::vector<float> vmax_piece(pieces.size(), 0.0f);
+		std::vector<float> vmin_piece(pieces.size(), 0.0f);
+		float* pmax = vmax_piece.data();
+		float* pmin = vmin_piece.data();
+		pieces.for_each([fused, pmax, pmin](size_t k, float* pz,
+			const float* px, const float* py, size_t n) {
+			float vmax = 0.0f;
+			float vmin = std::numeric_limits<float>::max();
+			for (size_t i = 0; i < n; i++) {
+				float vy = std::abs(py[i]);
+				vmax = vy > vmax ? vy : vmax;
+				vmin = vy < vmin ? vy : vmin;
+			}
+			pmax[k] = vmax;
+			pmin[k] = vmin;
+			if (fused)
+				for (size_t i = 0; i < n; i++)
+					pz[i] = px[i] / py[i];
+		});
+		float vmax = 0.0f;
+		for (size_t k = 0; k < vmax_piece.size(); k++)
+			vmax = std::max(vmax, vmax_piece[k]);
+		float vmin = 1e-6*vmax;
+		if (vmin == 0.0)
+			THROW("division by zero in STIRImageData::divide");
+		pieces.for_each([fused, pmin, vmin](size_t k, float* pz,
+			const float* px, const float* py, size_t n) {
+			if (!fused || pmin[k] < vmin)
+				divide_with_threshold(pz, px, py, n, vmin);
+		});
+		return;
+	}
 #if defined(_MSC_VER) && _MSC_VER < 1900
 	Image3DF::full_iterator iter;
 	Image3DF::const_full_iterator iter_x;
@@ -481,6 +1527,32 @@ STIRImageData::get_voxel_sizes(float* vsize) const
 		vsize[i] = vs[i + 1];
 }
 
+// copies the rows of image to or from data (in the order of rows)
+static void
+copy_image_rows(const Image3DF& image, float* data, bool to_data)
+{
+	std::vector<const float*> rows;
+	std::vector<size_t> lengths;
+	array_rows(image, rows, lengths);
+	std::vector<size_t> offsets(rows.size() + 1, 0);
+	for (size_t k = 0; k < rows.size(); k++)
+		offsets[k + 1] = offsets[k] + lengths[k];
+	SIRF_COUNT(BYTES_MOVED, sizeof(float)*offsets.back());
+	// about BUFFER_BLOCK_SIZE elements per task
+	size_t row_length = rows.size() > 0 ? std::max(lengths[0], size_t(1)) : 1;
+	size_t rows_per_task = std::max(BUFFER_BLOCK_SIZE / row_length, size_t(1));
+	parallel_for_blocks(rows.size(), rows_per_task,
+		[&, to_data](size_t begin, size_t end) {
+		for (size_t k = begin; k < end; k++) {
+			float* row = const_cast<float*>(rows[k]);
+			if (to_data)
+				std::memcpy(data + offsets[k], row, lengths[k] * sizeof(float));
+			else
+				std::memcpy(row, data + offsets[k], lengths[k] * sizeof(float));
+		}
+	});
+}
+
 void
 STIRImageData::get_data(float* data) const
 {
@@ -489,24 +1561,9 @@ STIRImageData::get_data(float* data) const
 	Coordinate3D<int> max_indices;
 	if (!image.get_regular_range(min_indices, max_indices))
 		throw LocalisedException("irregular STIR image", __FILE__, __LINE__);
-		//return -1;
-	//std::cout << "trying new const iterator...\n";
-	STIRImageData::Iterator_const iter(begin());
-	for (int i = 0; iter != end(); ++i, ++iter)
-		data[i] = *iter;
-	//std::copy(begin(), end(), data);
-	//std::copy(image.begin_all(), image.end_all(), data);
-	//auto iter = image.begin_all();
-	//for (int i = 0; iter != image.end_all(); i++, iter++)
-	//	data[i] = *iter;
-	//for (int z = min_indices[1], i = 0; z <= max_indices[1]; z++) {
-	//	for (int y = min_indices[2]; y <= max_indices[2]; y++) {
-	//		for (int x = min_indices[3]; x <= max_indices[3]; x++, i++) {
-	//			data[i] = image[z][y][x];
-	//		}
-	//	}
-	//}
-	//return 0;
+	// the order of the rows of a regular STIR image is that of SIRF
+	// (z, y, x), hence the copy is done row by row
+	copy_image_rows(image, data, true);
 }
 
 void
@@ -517,24 +1574,21 @@ STIRImageData::set_data(const float* data)
 	Coordinate3D<int> max_indices;
 	if (!image.get_regular_range(min_indices, max_indices))
 		throw LocalisedException("irregular STIR image", __FILE__, __LINE__);
-	//return -1;
-	size_t n = 1;
-	for (int i = 0; i < 3; i++)
-		n *= (max_indices[i + 1] - min_indices[i + 1] + 1);
-	//std::cout << "trying new iterator...\n";
-	STIRImageData::Iterator iter(begin());
-	for (int i = 0; iter != end(); ++i, ++iter)
-		*iter = data[i];
-	//std::copy(data, data + n, begin());
-	//std::copy(data, data + n, image.begin_all());
-	//for (int z = min_indices[1], i = 0; z <= max_indices[1]; z++) {
-	//	for (int y = min_indices[2]; y <= max_indices[2]; y++) {
-	//		for (int x = min_indices[3]; x <= max_indices[3]; x++, i++) {
-	//			image[z][y][x] = data[i];
-	//		}
-	//	}
-	//}
-	//return 0;
+	copy_image_rows(image, const_cast<float*>(data), false);
+}
+
+float*
+STIRImageData::contiguous_data()
+{
+	std::vector<const float*> rows;
+	std::vector<size_t> lengths;
+	array_rows(data(), rows, lengths);
+	if (rows.size() < 1)
+		return 0;
+	for (size_t k = 1; k < rows.size(); k++)
+		if (rows[k] != rows[k - 1] + lengths[k - 1])
+			return 0;
+	return const_cast<float*>(rows[0]);
 }
 
 void
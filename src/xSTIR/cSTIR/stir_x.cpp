@@ -19,17 +19,457 @@ limitations under the License.
 
 */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+
 #include "stir/common.h"
+#include "stir/Bin.h"
+#include "stir/IO/InterfileOutputFileFormat.h"
 #include "stir/IO/stir_ecat_common.h"
 #include "stir/is_null_ptr.h"
 #include "stir/error.h"
-
+#include "stir/info.h"
+#include "stir/DataSymmetriesForViewSegmentNumbers.h"
+#include "stir/ExamInfo.h"
+#include "stir/ProjDataInterfile.h"
+#include "stir/RelatedViewgrams.h"
+#include "stir/Viewgram.h"
+#include "stir/ViewSegmentNumbers.h"
+#include "stir/stream.h"
+#include "stir/TimeFrameDefinitions.h"
+#include "stir/recon_buildblock/BackProjectorByBin.h"
+#include "stir/recon_buildblock/ForwardProjectorByBin.h"
+#include "stir/recon_buildblock/ProjMatrixByBinFromFile.h"
+#include "stir/recon_buildblock/ProjMatrixElemsForOneBin.h"
+#include "stir/recon_buildblock/TrivialDataSymmetriesForViewSegmentNumbers.h"
+#include "stir/recon_buildblock/write_proj_matrix_by_bin.h"
+
+#include "sirf/common/instrumentation.h"
+#include "sirf/common/thread_pool.h"
 #include "sirf/STIR/stir_x.h"
 
 using namespace stir;
 using namespace ecat;
 using namespace sirf;
 
+namespace {
+
+	// listmode records read into their own record objects, to be binned
+	// while the next ones are being read
+	struct EventChunk {
+		std::vector<shared_ptr<CListRecord> > records;
+		size_t size;
+	};
+
+	// a number of chunks of the events of one time frame
+	struct EventBatch {
+		std::vector<EventChunk> chunks;
+		unsigned int frame_num;
+		bool last_in_frame;
+	};
+
+	// sinogram index of a bin and the value to add to it
+	struct BinIncrement {
+		size_t index;
+		float value;
+	};
+
+	// Reads listmode records in batches, keeping the events that are to be
+	// binned into the current time frame; a batch ends early at the end
+	// of a time frame or of the data.
+	class ListmodeReader {
+	public:
+		static const size_t CHUNK_SIZE = 1 << 16;
+
+		ListmodeReader(const CListModeData& lm_data,
+			const TimeFrameDefinitions& frame_defs) :
+			lm_data_(lm_data), frame_defs_(frame_defs),
+			frame_num_(1), current_time_(0), num_records_(0), eof_(false)
+		{}
+		bool done() const
+		{
+			return eof_ || frame_num_ > frame_defs_.get_num_frames();
+		}
+		bool eof() const
+		{
+			return eof_;
+		}
+		unsigned int frame_num() const
+		{
+			return frame_num_;
+		}
+		unsigned long long num_records() const
+		{
+			return num_records_;
+		}
+		double current_time() const
+		{
+			return current_time_;
+		}
+		void read(EventBatch& batch)
+		{
+			batch.frame_num = frame_num_;
+			batch.last_in_frame = false;
+			for (size_t c = 0; c < batch.chunks.size(); c++) {
+				EventChunk& chunk = batch.chunks[c];
+				chunk.size = 0;
+				if (!batch.last_in_frame)
+					batch.last_in_frame = read_(chunk);
+			}
+		}
+	private:
+		// returns true if the frame has ended
+		bool read_(EventChunk& chunk)
+		{
+			const double start_time = frame_defs_.get_start_time(frame_num_);
+			const double end_time = frame_defs_.get_end_time(frame_num_);
+			while (chunk.size < CHUNK_SIZE) {
+				if (chunk.records.size() <= chunk.size)
+					chunk.records.push_back(lm_data_.get_empty_record_sptr());
+				CListRecord& record = *chunk.records[chunk.size];
+				if (lm_data_.get_next_record(record) == Succeeded::no) {
+					eof_ = true;
+					return true;
+				}
+				num_records_++;
+				if (record.is_time() && end_time > 0.01) {
+					current_time_ = record.time().get_time_in_secs();
+					if (current_time_ >= end_time) {
+						frame_num_++;
+						return true;
+					}
+				}
+				else if (record.is_event() && start_time <= current_time_)
+					chunk.size++;
+			}
+			return false;
+		}
+
+		const CListModeData& lm_data_;
+		const TimeFrameDefinitions& frame_defs_;
+		unsigned int frame_num_;
+		double current_time_;
+		unsigned long long num_records_;
+		bool eof_;
+	};
+
+}
+
+std::string
+ListmodeToSinograms::frame_filename_(const std::string& prefix, int frame_num)
+{
+	std::ostringstream filename;
+	filename << prefix << "_f" << frame_num << "g1d0b0";
+	return filename.str();
+}
+
+shared_ptr<PETAcquisitionData>
+ListmodeToSinograms::frame_data_(const std::string& prefix, int frame_num) const
+{
+	if (frame_num < 1 || frame_num > num_frames())
+		THROW("frame number out of range");
+	std::string filename = frame_filename_(prefix, frame_num) + ".hs";
+	shared_ptr<PETAcquisitionData>
+		sptr_ad(new PETAcquisitionDataInFile(filename.c_str()));
+	if (sparse_output)
+		return shared_ptr<PETAcquisitionData>
+			(new PETAcquisitionDataSparse(*sptr_ad));
+	if (PETAcquisitionData::storage_scheme() == "file")
+		return sptr_ad;
+	shared_ptr<PETAcquisitionData> sptr(PETAcquisitionData::storage_template()->
+		same_acquisition_data(sptr_ad->get_exam_info_sptr(),
+		sptr_ad->get_proj_data_info_sptr()));
+	sptr->fill(*sptr_ad);
+	return sptr;
+}
+
+void
+ListmodeToSinograms::process_data()
+{
+	fan_sums_sptr.reset();
+	// delayeds are stored separately only by the code below
+	const bool delayeds_apart = store_delayeds && separate_delayeds;
+	if (delayeds_apart && (interactive || !do_time_frame))
+		THROW("separate delayeds require time frames and no interactive mode");
+	// STIR's serial conversion is kept as the reference (fan sums are
+	// then computed by estimate_randoms())
+	if (!delayeds_apart && (!parallel_unlisting || interactive || !do_time_frame)) {
+		LmToProjData::process_data();
+		return;
+	}
+	const int num_threads =
+		parallel_unlisting ? ThreadPool::instance().num_threads() : 1;
+	SIRF_TIMER("ListmodeToSinograms::process_data");
+	std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+
+	shared_ptr<ProjDataInfo> sptr_pdi(template_proj_data_info_ptr->clone());
+	const int max_segment_num = max_segment_num_to_process < 0 ?
+		sptr_pdi->get_max_segment_num() :
+		std::min(max_segment_num_to_process, sptr_pdi->get_max_segment_num());
+	const int min_segment_num =
+		std::max(-max_segment_num, sptr_pdi->get_min_segment_num());
+	sptr_pdi->reduce_segment_range(min_segment_num, max_segment_num);
+	const ProjDataInfo& pdi = *sptr_pdi;
+
+	// sinograms of the current frame (followed by those of the delayeds if
+	// these are stored separately) in the order segment, axial position,
+	// view, tangential position, split into parts updated by one thread each
+	const int num_views = pdi.get_num_views();
+	const int num_tang_poss = pdi.get_num_tangential_poss();
+	std::vector<size_t> segment_offsets;
+	size_t size = 0;
+	for (int s = min_segment_num; s <= max_segment_num; s++) {
+		segment_offsets.push_back(size);
+		size += (size_t)pdi.get_num_axial_poss(s)*num_views*num_tang_poss;
+	}
+	const int num_sinograms = delayeds_apart ? 2 : 1;
+	std::vector<float> sinograms(num_sinograms*size, 0.0f);
+	const size_t num_parts = num_threads;
+	const size_t part_size = (sinograms.size() + num_parts - 1) / num_parts;
+	const int prompt_increment = store_prompts ? 1 : 0;
+	const int delayed_inc = delayeds_apart ? 1 : delayed_increment;
+
+	// delayeds fan sums for randoms estimation (fan_size is set by set_up())
+	bool fan_sums = accumulate_fan_sums && fan_size > 0;
+	const int num_rings = lm_data_ptr->get_scanner_ptr()->get_num_rings();
+	const int num_dets =
+		lm_data_ptr->get_scanner_ptr()->get_num_detectors_per_ring();
+	if (fan_sums) {
+		set_max_ring_diff_for_fansums_();
+		fan_sums_sptr.reset(new std::vector<Array<2, float> >);
+	}
+	std::vector<std::vector<float> > chunk_fan_sums(num_threads);
+	std::vector<float> frame_fan_sums;
+
+	// two batches, so that one is read while the other is binned
+	EventBatch batches[2];
+	std::vector<std::vector<std::vector<BinIncrement> > > increments(num_threads);
+	for (int c = 0; c < num_threads; c++)
+		increments[c].resize(num_parts);
+	for (int b = 0; b < 2; b++)
+		batches[b].chunks.resize(num_threads);
+
+	lm_data_ptr->reset();
+	ListmodeReader reader(*lm_data_ptr, frame_defs);
+	long num_stored_events = 0;
+	bool first_batch = true;
+	int b = 0;
+	reader.read(batches[b]);
+	// writes the sinograms and fan sums accumulated for a frame and
+	// zeroes them
+	auto write_frame = [&](unsigned int frame_num) {
+		shared_ptr<ExamInfo> sptr_ei
+			(new ExamInfo(lm_data_ptr->get_exam_info()));
+		std::vector<std::pair<double, double> > frame(1,
+			std::pair<double, double>(frame_defs.get_start_time(frame_num),
+			frame_defs.get_end_time(frame_num)));
+		sptr_ei->set_time_frame_definitions(TimeFrameDefinitions(frame));
+		for (int k = 0; k < num_sinograms; k++) {
+			std::string prefix = output_filename_prefix;
+			if (k > 0)
+				prefix += "_delayeds";
+			ProjDataInterfile proj_data(sptr_ei, sptr_pdi,
+				frame_filename_(prefix, frame_num), std::ios::out);
+			for (int s = min_segment_num; s <= max_segment_num; s++) {
+				SegmentBySinogram<float> segment =
+					pdi.get_empty_segment_by_sinogram(s);
+				const float* data = &sinograms
+					[k*size + segment_offsets[s - min_segment_num]];
+				for (int a = segment.get_min_axial_pos_num();
+					a <= segment.get_max_axial_pos_num(); a++)
+					for (int v = segment.get_min_view_num();
+						v <= segment.get_max_view_num(); v++)
+						for (int t = segment.get_min_tangential_pos_num();
+							t <= segment.get_max_tangential_pos_num(); t++)
+							segment[a][v][t] = *data++;
+				proj_data.set_segment(segment);
+			}
+		}
+		if (fan_sums) {
+			Array<2, float> data_fan_sums(IndexRange2D(num_rings, num_dets));
+			if (frame_fan_sums.size() > 0) {
+				for (int r = 0; r < num_rings; r++)
+					for (int d = 0; d < num_dets; d++)
+						data_fan_sums[r][d] =
+						frame_fan_sums[(size_t)r*num_dets + d];
+				std::fill(frame_fan_sums.begin(), frame_fan_sums.end(), 0.0f);
+			}
+			fan_sums_sptr->push_back(data_fan_sums);
+		}
+		std::ostringstream msg;
+		msg << "processed frame " << frame_num;
+		info(msg.str());
+		std::fill(sinograms.begin(), sinograms.end(), 0.0f);
+	};
+
+	while (true) {
+		EventBatch& batch = batches[b];
+		bool more = !reader.done();
+
+		// the first event is binned serially, so that any tables STIR
+		// computes on first use are in place before the parallel binning
+		if (first_batch && batch.chunks[0].size > 0) {
+			const CListEvent& event = batch.chunks[0].records[0]->event();
+			Bin bin;
+			bin.set_bin_value(1);
+			get_bin_from_event(bin, event);
+			first_batch = false;
+			if (fan_sums && dynamic_cast
+				<const CListEventCylindricalScannerWithDiscreteDetectors*>
+				(&event) == 0) {
+				warning("Fan sums need a scanner with discrete detectors");
+				fan_sums = false;
+				fan_sums_sptr.reset();
+			}
+			if (fan_sums) {
+				frame_fan_sums.assign((size_t)num_rings*num_dets, 0.0f);
+				for (int c = 0; c < num_threads; c++)
+					chunk_fan_sums[c].resize(frame_fan_sums.size());
+			}
+		}
+		// the chunks are binned while the next batch is read by an extra
+		// task (all on the SIRF thread pool)
+		std::vector<long> num_stored(num_threads, 0);
+		sirf::parallel_for(num_threads + (more ? 1 : 0), [&](size_t c) {
+			if (c == (size_t)num_threads) {
+				reader.read(batches[1 - b]);
+				return;
+			}
+			const EventChunk& chunk = batch.chunks[c];
+			std::vector<std::vector<BinIncrement> >& inc = increments[c];
+			for (size_t p = 0; p < num_parts; p++)
+				inc[p].clear();
+			float* fan = fan_sums && chunk_fan_sums[c].size() > 0 ?
+				&chunk_fan_sums[c][0] : 0;
+			if (fan)
+				std::fill(fan, fan + chunk_fan_sums[c].size(), 0.0f);
+			for (size_t i = 0; i < chunk.size; i++) {
+				const CListEvent& event = chunk.records[i]->event();
+				const bool prompt = event.is_prompt();
+				if (fan && !prompt)
+					add_to_fan_sums_(fan, event, num_dets);
+				const int event_increment =
+					prompt ? prompt_increment : delayed_inc;
+				if (event_increment == 0)
+					continue;
+				Bin bin;
+				// set value in case the event decoder does not touch it
+				bin.set_bin_value(1);
+				get_bin_from_event(bin, event);
+				const int s = bin.segment_num();
+				if (bin.get_bin_value() > 0 &&
+					s >= min_segment_num && s <= max_segment_num &&
+					bin.tangential_pos_num() >= pdi.get_min_tangential_pos_num() &&
+					bin.tangential_pos_num() <= pdi.get_max_tangential_pos_num() &&
+					bin.axial_pos_num() >= pdi.get_min_axial_pos_num(s) &&
+					bin.axial_pos_num() <= pdi.get_max_axial_pos_num(s)) {
+					BinIncrement bi;
+					bi.index = segment_offsets[s - min_segment_num] +
+						((size_t)(bin.axial_pos_num() - pdi.get_min_axial_pos_num(s))*
+						num_views + bin.view_num() - pdi.get_min_view_num())*
+						num_tang_poss + bin.tangential_pos_num() -
+						pdi.get_min_tangential_pos_num();
+					if (delayeds_apart && !prompt)
+						bi.index += size;
+					bi.value = bin.get_bin_value()*event_increment;
+					inc[bi.index / part_size].push_back(bi);
+					num_stored[c] += event_increment;
+				}
+			}
+		});
+		sirf::parallel_for(num_parts, [&](size_t p) {
+			for (int c = 0; c < num_threads; c++) {
+				const std::vector<BinIncrement>& inc = increments[c][p];
+				for (size_t i = 0; i < inc.size(); i++)
+					sinograms[inc[i].index] += inc[i].value;
+			}
+		});
+		for (int c = 0; c < num_threads; c++) {
+			num_stored_events += num_stored[c];
+			if (fan_sums && chunk_fan_sums[c].size() > 0) {
+				const std::vector<float>& fan = chunk_fan_sums[c];
+				for (size_t i = 0; i < fan.size(); i++)
+					frame_fan_sums[i] += fan[i];
+			}
+		}
+
+		if (batch.last_in_frame)
+			write_frame(batch.frame_num);
+		if (!more)
+			break;
+		b = 1 - b;
+	}
+	// the frames after the end of the data are empty
+	bool early_eof = reader.eof() &&
+		reader.frame_num() < frame_defs.get_num_frames();
+	if (early_eof)
+		for (unsigned int f = reader.frame_num() + 1;
+			f <= frame_defs.get_num_frames(); f++)
+			write_frame(f);
+
+	double t = std::chrono::duration<double>
+		(std::chrono::steady_clock::now() - start).count();
+	unsigned long long num_records = reader.num_records();
+	SIRF_COUNT(LISTMODE_RECORDS, num_records);
+	std::ostringstream msg;
+	msg << "Last time tag read was at " << reader.current_time() << " secs\n";
+	if (early_eof)
+		msg << "Early stop due to EOF: frames " << reader.frame_num() + 1
+			<< " to " << frame_defs.get_num_frames() << " are empty\n";
+	msg << "Total number of prompts/trues/delayed stored: "
+		<< num_stored_events << '\n';
+	msg << "Processed " << num_records << " listmode records in "
+		<< t << "s on " << num_threads << " threads ("
+		<< (t > 0 ? num_records / t : 0) << " records/s)";
+	info(msg.str());
+}
+
+void
+ListmodeToSinograms::set_max_ring_diff_for_fansums_()
+{
+	// TODO have to use lm_data_ptr->get_proj_data_info_sptr() once STIR PR 108 is merged
+	max_ring_diff_for_fansums = 60;
+	if (*lm_data_ptr->get_scanner_ptr() != Scanner(Scanner::Siemens_mMR))
+	{
+		warning("This is not mMR data. Assuming all possible ring differences are in the listmode file");
+		max_ring_diff_for_fansums = lm_data_ptr->get_scanner_ptr()->get_num_rings() - 1;
+	}
+}
+
+void
+ListmodeToSinograms::add_to_fan_sums_(float* fan_sums, const CListEvent& event,
+	int num_detectors_per_ring) const
+{
+	// same selection of detector pairs as in compute_fan_sums_()
+	DetectionPositionPair<> det_pos;
+	static_cast<const CListEventCylindricalScannerWithDiscreteDetectors&>
+		(event).get_detection_position(det_pos);
+	const int ra = det_pos.pos1().axial_coord();
+	const int rb = det_pos.pos2().axial_coord();
+	const int a = det_pos.pos1().tangential_coord();
+	const int b = det_pos.pos2().tangential_coord();
+	if (abs(ra - rb) > max_ring_diff_for_fansums)
+		return;
+	const int det_num_diff = (a - b + 3 * num_detectors_per_ring / 2) %
+		num_detectors_per_ring;
+	if (det_num_diff <= fan_size / 2 ||
+		det_num_diff >= num_detectors_per_ring - fan_size / 2) {
+		fan_sums[ra*num_detectors_per_ring + a] += 1;
+		fan_sums[rb*num_detectors_per_ring + b] += 1;
+	}
+}
+
 void
 ListmodeToSinograms::compute_fan_sums_(bool prompt_fansum)
 {
@@ -53,13 +493,7 @@ ListmodeToSinograms::compute_fan_sums_(bool prompt_fansum)
 	// go to the beginning of the binary data
 	lm_data_ptr->reset();
 
-	// TODO have to use lm_data_ptr->get_proj_data_info_sptr() once STIR PR 108 is merged
-	max_ring_diff_for_fansums = 60;
-	if (*lm_data_ptr->get_scanner_ptr() != Scanner(Scanner::Siemens_mMR))
-	{
-		warning("This is not mMR data. Assuming all possible ring differences are in the listmode file");
-		max_ring_diff_for_fansums = lm_data_ptr->get_scanner_ptr()->get_num_rings() - 1;
-	}
+	set_max_ring_diff_for_fansums_();
 	unsigned int current_frame_num = 1;
 	{
 		// loop over all events in the listmode file
@@ -186,6 +620,48 @@ const int max_ring_diff, const int half_fan_size)
 	return num;
 }
 
+// Same as STIR's iterate_efficiencies(), which updates the efficiencies
+// one detector at a time using those already updated, run on the thread pool.
+// Efficiency a of ring ra depends on the updated efficiencies of the
+// preceding rings and of the detectors of ring ra at least
+// num_detectors_per_ring/2 - half_fan_size positions before a, so that these
+// many consecutive detectors of a ring can be updated concurrently with
+// results identical to STIR's.
+static void
+iterate_efficiencies_in_parallel(DetectorEfficiencies& efficiencies,
+	const Array<2, float>& data_fan_sums,
+	const int max_ring_diff, const int half_fan_size)
+{
+	const int num_rings = data_fan_sums.get_length();
+	const int num_detectors_per_ring =
+		data_fan_sums[data_fan_sums.get_min_index()].get_length();
+	const int block_size =
+		std::max(1, num_detectors_per_ring / 2 - half_fan_size);
+	for (int ra = data_fan_sums.get_min_index();
+		ra <= data_fan_sums.get_max_index(); ++ra) {
+		const int min_a = data_fan_sums[ra].get_min_index();
+		const int max_a = data_fan_sums[ra].get_max_index();
+		for (int a0 = min_a; a0 <= max_a; a0 += block_size) {
+			const int n = std::min(block_size, max_a - a0 + 1);
+			sirf::parallel_for(n, [&](size_t i) {
+				const int a = a0 + (int)i;
+				if (data_fan_sums[ra][a] == 0)
+					efficiencies[ra][a] = 0;
+				else {
+					float denominator = 0;
+					for (int rb = std::max(ra - max_ring_diff, 0);
+						rb <= std::min(ra + max_ring_diff, num_rings - 1); ++rb)
+						for (int b = a + num_detectors_per_ring / 2 - half_fan_size;
+							b <= a + num_detectors_per_ring / 2 + half_fan_size; ++b)
+							denominator +=
+							efficiencies[rb][b%num_detectors_per_ring];
+					efficiencies[ra][a] = data_fan_sums[ra][a] / denominator;
+				}
+			});
+		}
+	}
+}
+
 int
 ListmodeToSinograms::compute_singles_()
 {
@@ -235,8 +711,8 @@ ListmodeToSinograms::compute_singles_()
 				for (int iter = 1; iter <= num_iterations; ++iter)
 				{
 					std::cout << "Starting iteration " << iter;
-					iterate_efficiencies(efficiencies, data_fan_sums, max_ring_diff,
-						half_fan_size);
+					iterate_efficiencies_in_parallel(efficiencies, data_fan_sums,
+						max_ring_diff, half_fan_size);
 					if (iter == num_iterations ||
 						(do_KL_interval>0 && iter%do_KL_interval == 0))
 					{
@@ -297,81 +773,101 @@ ListmodeToSinograms::estimate_randoms_()
 		const ProjDataInfoCylindricalNoArcCorr * const uncompressed_proj_data_info_ptr =
 			dynamic_cast<const ProjDataInfoCylindricalNoArcCorr * const>
 			(uncompressed_proj_data_info_uptr.get());
-		Bin bin;
-		Bin uncompressed_bin;
+		if (proj_data.get_min_view_num() != 0)
+			error("Can only handle min_view_num==0\n");
+
+		// detector pairs of the uncompressed views and tangential positions
+		const int num_uncompressed_views =
+			uncompressed_proj_data_info_ptr->get_num_views();
+		const int min_tang_pos_num =
+			proj_data_info_ptr->get_min_tangential_pos_num();
+		const int num_tang_poss = proj_data_info_ptr->get_num_tangential_poss();
+		std::vector<int> det_a((size_t)num_uncompressed_views*num_tang_poss);
+		std::vector<int> det_b(det_a.size());
+		for (int v = 0; v < num_uncompressed_views; v++)
+			for (int t = 0; t < num_tang_poss; t++) {
+				size_t i = (size_t)v*num_tang_poss + t;
+				uncompressed_proj_data_info_ptr->
+					get_det_num_pair_for_view_tangential_pos_num
+					(det_a[i], det_b[i], v, min_tang_pos_num + t);
+				det_b[i] %= num_detectors_per_ring;
+			}
 
-		for (bin.segment_num() = proj_data.get_min_segment_num();
-			bin.segment_num() <= proj_data.get_max_segment_num();
-			++bin.segment_num())
-		{
+		// Tables of the axial positions (m) and ring pairs of the uncompressed
+		// sinograms and of the axial positions and ring difference ranges of
+		// the sinograms to compute. STIR initialises the tables behind get_m
+		// and get_ring_pair_for_segment_axial_pos_num on first use (safely
+		// only if built with OpenMP), hence they are built here serially.
+		struct RingPair {
+			int segment_num;
+			float m;
+			int ra, rb;
+		};
+		std::vector<RingPair> ring_pairs;
+		for (int s = uncompressed_proj_data_info_ptr->get_min_segment_num();
+			s <= uncompressed_proj_data_info_ptr->get_max_segment_num(); ++s)
+			for (int ax = uncompressed_proj_data_info_ptr->get_min_axial_pos_num(s);
+				ax <= uncompressed_proj_data_info_ptr->get_max_axial_pos_num(s);
+				++ax) {
+				RingPair rp;
+				rp.segment_num = s;
+				rp.m = uncompressed_proj_data_info_ptr->get_m(Bin(s, 0, ax, 0));
+				uncompressed_proj_data_info_ptr->
+					get_ring_pair_for_segment_axial_pos_num(rp.ra, rp.rb, s, ax);
+				ring_pairs.push_back(rp);
+			}
+		// sinograms to compute, each a task for the thread pool
+		struct OutputSinogram {
+			int segment_num, axial_pos_num;
+			float m;
+			int min_ring_diff, max_ring_diff;
+		};
+		std::vector<OutputSinogram> sinograms;
+		for (int s = proj_data.get_min_segment_num();
+			s <= proj_data.get_max_segment_num(); ++s)
+			for (int ax = proj_data.get_min_axial_pos_num(s);
+				ax <= proj_data.get_max_axial_pos_num(s); ++ax) {
+				OutputSinogram os;
+				os.segment_num = s;
+				os.axial_pos_num = ax;
+				os.m = proj_data_info_ptr->get_m(Bin(s, 0, ax, 0));
+				os.min_ring_diff = proj_data_info_ptr->get_min_ring_difference(s);
+				os.max_ring_diff = proj_data_info_ptr->get_max_ring_difference(s);
+				sinograms.push_back(os);
+			}
 
-			for (bin.axial_pos_num() = proj_data.get_min_axial_pos_num
-				(bin.segment_num());
-				bin.axial_pos_num() <= proj_data.get_max_axial_pos_num
-				(bin.segment_num());
-			++bin.axial_pos_num())
-			{
-				Sinogram<float> sinogram = proj_data_info_ptr->get_empty_sinogram
-					(bin.axial_pos_num(), bin.segment_num());
-				const float out_m = proj_data_info_ptr->get_m(bin);
-				const int in_min_segment_num =
-					proj_data_info_ptr->get_min_ring_difference(bin.segment_num());
-				const int in_max_segment_num =
-					proj_data_info_ptr->get_max_ring_difference(bin.segment_num());
-
-				// now loop over uncompressed detector-pairs
-				{
-					for (uncompressed_bin.segment_num() = in_min_segment_num;
-						uncompressed_bin.segment_num() <= in_max_segment_num;
-						++uncompressed_bin.segment_num())
-						for (uncompressed_bin.axial_pos_num() =
-							uncompressed_proj_data_info_ptr->get_min_axial_pos_num
-							(uncompressed_bin.segment_num());
-					uncompressed_bin.axial_pos_num() <=
-						uncompressed_proj_data_info_ptr->get_max_axial_pos_num
-						(uncompressed_bin.segment_num());
-					++uncompressed_bin.axial_pos_num())
-						{
-							const float in_m =
-								uncompressed_proj_data_info_ptr->get_m(uncompressed_bin);
-							if (fabs(out_m - in_m) > 1E-4)
-								continue;
-
-							// views etc
-							if (proj_data.get_min_view_num() != 0)
-								error("Can only handle min_view_num==0\n");
-							for (bin.view_num() = proj_data.get_min_view_num();
-								bin.view_num() <= proj_data.get_max_view_num();
-								++bin.view_num())
-							{
-
-								for (bin.tangential_pos_num() = proj_data_info_ptr->get_min_tangential_pos_num();
-									bin.tangential_pos_num() <= proj_data_info_ptr->get_max_tangential_pos_num();
-									++bin.tangential_pos_num())
-								{
-									uncompressed_bin.tangential_pos_num() =
-										bin.tangential_pos_num();
-									for (uncompressed_bin.view_num() =
-										bin.view_num()*mashing_factor;
-										uncompressed_bin.view_num() <
-										(bin.view_num() + 1)*mashing_factor;
-									++uncompressed_bin.view_num())
-									{
-										int ra = 0, a = 0;
-										int rb = 0, b = 0;
-										uncompressed_proj_data_info_ptr->get_det_pair_for_bin(a, ra, b, rb,
-											uncompressed_bin);
-										/*(*segment_ptr)[bin.axial_pos_num()]*/
-										sinogram[bin.view_num()][bin.tangential_pos_num()] +=
-											efficiencies[ra][a] * efficiencies[rb][b%num_detectors_per_ring];
-									}
-								}
-							}
+		std::mutex io_mutex;
+		sirf::parallel_for(sinograms.size(), [&](size_t i) {
+			const OutputSinogram& os = sinograms[i];
+			Sinogram<float> sinogram = proj_data_info_ptr->get_empty_sinogram
+				(os.axial_pos_num, os.segment_num);
+
+			// loop over uncompressed ring pairs contributing to the sinogram,
+			// adding to each bin in the same order as the serial loops did
+			for (size_t k = 0; k < ring_pairs.size(); k++) {
+				const RingPair& rp = ring_pairs[k];
+				if (rp.segment_num < os.min_ring_diff ||
+					rp.segment_num > os.max_ring_diff)
+					continue;
+				if (fabs(os.m - rp.m) > 1E-4)
+					continue;
+				const int ra = rp.ra;
+				const int rb = rp.rb;
+				const Array<1, float>& eff_a = efficiencies[ra];
+				const Array<1, float>& eff_b = efficiencies[rb];
+				for (int view = 0; view <= proj_data.get_max_view_num(); ++view)
+					for (int t = 0; t < num_tang_poss; ++t) {
+						float& value = sinogram[view][min_tang_pos_num + t];
+						for (int uv = view*mashing_factor;
+							uv < (view + 1)*mashing_factor; ++uv) {
+							size_t j = (size_t)uv*num_tang_poss + t;
+							value += eff_a[det_a[j]] * eff_b[det_b[j]];
 						}
-				}
-				proj_data.set_sinogram(sinogram);
+					}
 			}
-		}
+			std::lock_guard<std::mutex> lock(io_mutex);
+			proj_data.set_sinogram(sinogram);
+		});
 	}
 	randoms_sptr->write(filename.c_str());
 }
@@ -387,10 +883,22 @@ PETAcquisitionSensitivityModel(PETAcquisitionData& ad)
 	//shared_ptr<BinNormalisation> sptr_0;
 	//norm_.reset(new ChainedBinNormalisation(sptr_n, sptr_0));
 	norm_ = sptr_n;
+	sptr_ad_ = sptr_ad;
 	//norm_ = shared_ptr<BinNormalisation>
 	//	(new BinNormalisationFromProjData(sptr_ad->data()));
 }
 
+shared_ptr<PETAcquisitionSensitivityModel>
+PETAcquisitionSensitivityModel::from_inverse_efficiencies
+(shared_ptr<PETAcquisitionData> sptr_ad)
+{
+	shared_ptr<PETAcquisitionSensitivityModel>
+		sptr(new PETAcquisitionSensitivityModel);
+	sptr->norm_.reset(new BinNormalisationFromProjData(sptr_ad->data()));
+	sptr->sptr_ad_ = sptr_ad;
+	return sptr;
+}
+
 PETAcquisitionSensitivityModel::
 PETAcquisitionSensitivityModel(std::string filename)
 {
@@ -399,17 +907,74 @@ PETAcquisitionSensitivityModel(std::string filename)
 	//shared_ptr<BinNormalisation> sptr_0;
 	//norm_.reset(new ChainedBinNormalisation(sptr_n, sptr_0));
 	norm_ = sptr_n;
+	filename_ = filename;
+}
+
+std::string
+PETAcquisitionSensitivityModel::id() const
+{
+	std::ostringstream id;
+	if (sptr_mod1_.get()) {
+		std::string id1 = sptr_mod1_->id();
+		std::string id2 = sptr_mod2_->id();
+		if (id1.length() < 1 || id2.length() < 1)
+			return "";
+		id << "chained normalisation:\n" << id1 << id2;
+	}
+	else if (sptr_ad_.get()) {
+		// FNV-1a over the inverse efficiencies
+		const unsigned long long prime = 1099511628211ULL;
+		unsigned long long h = 14695981039346656037ULL;
+		const ProjData& proj_data = *sptr_ad_->data();
+		for (int s = proj_data.get_min_segment_num();
+			s <= proj_data.get_max_segment_num(); ++s) {
+			SegmentBySinogram<float> segment =
+				proj_data.get_segment_by_sinogram(s);
+			for (SegmentBySinogram<float>::const_full_iterator
+				iter = segment.begin_all_const();
+				iter != segment.end_all_const(); ++iter) {
+				unsigned int u;
+				memcpy(&u, &*iter, sizeof(u));
+				h = (h ^ u) * prime;
+			}
+		}
+		id << "inverse bin efficiencies:\n"
+			<< proj_data.get_proj_data_info_sptr()->parameter_info()
+			<< "values: " << std::hex << std::setw(16) << std::setfill('0')
+			<< h << '\n';
+	}
+	else if (filename_.length() > 0) {
+		namespace fs = boost::filesystem;
+		boost::system::error_code ec;
+		fs::path path = fs::absolute(filename_);
+		id << "ECAT8 file: " << path.string() << '\n';
+		id << "modified: " << fs::last_write_time(path, ec) << '\n';
+	}
+	return id.str();
 }
 
 Succeeded 
 PETAcquisitionSensitivityModel::set_up(const shared_ptr<ProjDataInfo>& sptr_pdi)
 {
+	if (sptr_mod1_.get()) {
+		if (sptr_mod1_->set_up(sptr_pdi) != Succeeded::yes ||
+			sptr_mod2_->set_up(sptr_pdi) != Succeeded::yes)
+			return Succeeded::no;
+		// the chained models' normalisations may have changed at set_up
+		norm_.reset(new ChainedBinNormalisation
+			(sptr_mod1_->data(), sptr_mod2_->data()));
+	}
 	return norm_->set_up(sptr_pdi);
 }
 
 void
 PETAcquisitionSensitivityModel::unnormalise(PETAcquisitionData& ad) const
 {
+	if (sptr_mod1_.get()) {
+		sptr_mod1_->unnormalise(ad);
+		sptr_mod2_->unnormalise(ad);
+		return;
+	}
 	BinNormalisation* norm = norm_.get();
 	norm->undo(*ad.data(), 0, 1);
 }
@@ -417,6 +982,11 @@ PETAcquisitionSensitivityModel::unnormalise(PETAcquisitionData& ad) const
 void
 PETAcquisitionSensitivityModel::normalise(PETAcquisitionData& ad) const
 {
+	if (sptr_mod1_.get()) {
+		sptr_mod1_->normalise(ad);
+		sptr_mod2_->normalise(ad);
+		return;
+	}
 	BinNormalisation* norm = norm_.get();
 	norm->apply(*ad.data(), 0, 1);
 }
@@ -427,17 +997,108 @@ PETAttenuationModel::PETAttenuationModel
 	sptr_forw_projector_ = am.projectors_sptr()->get_forward_projector_sptr();
         if (is_null_ptr(sptr_forw_projector_))
           error("PETAttenuationModel: Forward projector not set correctly. Something wrong.");
-	shared_ptr<BinNormalisation>
-		sptr_n(new BinNormalisationFromAttenuationImage
-		(id.data_sptr(), sptr_forw_projector_));
-	norm_ = sptr_n;
+	sptr_image_ = id.data_sptr();
+	sptr_att_norm_.reset(new BinNormalisationFromAttenuationImage
+		(sptr_image_, sptr_forw_projector_));
+	norm_ = sptr_att_norm_;
+	acf_checksum_ = 0;
+}
+
+unsigned long long
+PETAttenuationModel::checksum_(const Image3DF& image)
+{
+	// FNV-1a over the index range, origin and voxel values
+	const unsigned long long prime = 1099511628211ULL;
+	unsigned long long h = 14695981039346656037ULL;
+	BasicCoordinate<3, int> min_indices, max_indices;
+	image.get_regular_range(min_indices, max_indices);
+	for (int i = 1; i <= 3; i++) {
+		h = (h ^ (unsigned int)min_indices[i]) * prime;
+		h = (h ^ (unsigned int)max_indices[i]) * prime;
+		float x = image.get_origin()[i];
+		unsigned int u;
+		memcpy(&u, &x, sizeof(u));
+		h = (h ^ u) * prime;
+	}
+	for (Image3DF::const_full_iterator iter = image.begin_all_const();
+		iter != image.end_all_const(); ++iter) {
+		unsigned int u;
+		memcpy(&u, &*iter, sizeof(u));
+		h = (h ^ u) * prime;
+	}
+	return h;
+}
+
+Succeeded
+PETAttenuationModel::set_up(const shared_ptr<ProjDataInfo>& sptr_pdi)
+{
+	norm_ = sptr_att_norm_;
+	Succeeded s = sptr_att_norm_->set_up(sptr_pdi);
+	if (s != Succeeded::yes) {
+		sptr_acf_.reset();
+		return s;
+	}
+	// the factors depend on the projector computing them as well
+	unsigned long long checksum = checksum_(*sptr_image_);
+	const std::string projector = sptr_forw_projector_->parameter_info();
+	for (size_t i = 0; i < projector.size(); i++)
+		checksum = (checksum ^ (unsigned char)projector[i]) * 1099511628211ULL;
+	if (!sptr_acf_.get() || checksum != acf_checksum_ ||
+		!(*sptr_pdi == *sptr_acf_->get_proj_data_info_sptr())) {
+		SIRF_TIMER("PETAttenuationModel: attenuation factors");
+		PETAcquisitionDataInFile::init();
+		shared_ptr<ExamInfo> sptr_ei(new ExamInfo);
+		shared_ptr<ProjDataInfo> sptr_acf_pdi(sptr_pdi->clone());
+		sptr_acf_.reset(PETAcquisitionData::storage_template()->
+			same_acquisition_data(sptr_ei, sptr_acf_pdi));
+		sptr_acf_->fill(1.0f);
+		shared_ptr<DataSymmetriesForViewSegmentNumbers> symmetries_sptr
+			(sptr_forw_projector_->get_symmetries_used()->clone());
+		sptr_att_norm_->apply(*sptr_acf_->data(), 0, 1, symmetries_sptr);
+		acf_checksum_ = checksum;
+	}
+	norm_.reset(new BinNormalisationFromProjData(sptr_acf_->data()));
+	return norm_->set_up(sptr_pdi);
+}
+
+std::string
+PETAttenuationModel::id() const
+{
+	const Image3DF& image = *sptr_image_;
+	std::ostringstream id;
+	id << std::setprecision(9);
+	id << "attenuation image:\n";
+	BasicCoordinate<3, int> min_indices, max_indices;
+	image.get_regular_range(min_indices, max_indices);
+	id << "index range: " << min_indices << max_indices << '\n';
+	id << "origin: " << image.get_origin() << '\n';
+	const DiscretisedDensityOnCartesianGrid<3, float>* ptr_grid =
+		dynamic_cast<const DiscretisedDensityOnCartesianGrid<3, float>*>
+		(&image);
+	if (ptr_grid)
+		id << "grid spacing: " << ptr_grid->get_grid_spacing() << '\n';
+	id << "values: " << std::hex << std::setw(16) << std::setfill('0')
+		<< checksum_(image) << std::dec << '\n';
+	id << sptr_forw_projector_->parameter_info();
+	return id.str();
+}
+
+bool
+PETAttenuationModel::use_acf_(const PETAcquisitionData& ad) const
+{
+	return sptr_acf_.get() && *ad.get_proj_data_info_sptr() ==
+		*sptr_acf_->get_proj_data_info_sptr();
 }
 
 void
 PETAttenuationModel::unnormalise(PETAcquisitionData& ad) const
 {
 	//std::cout << "in PETAttenuationModel::unnormalise\n";
-	BinNormalisation* norm = norm_.get();
+	if (use_acf_(ad)) {
+		ad.divide(ad, *sptr_acf_);
+		return;
+	}
+	BinNormalisation* norm = sptr_att_norm_.get();
 	shared_ptr<DataSymmetriesForViewSegmentNumbers>
 		symmetries_sptr(sptr_forw_projector_->get_symmetries_used()->clone());
 	norm->undo(*ad.data(), 0, 1, symmetries_sptr);
@@ -446,7 +1107,11 @@ PETAttenuationModel::unnormalise(PETAcquisitionData& ad) const
 void
 PETAttenuationModel::normalise(PETAcquisitionData& ad) const
 {
-	BinNormalisation* norm = norm_.get();
+	if (use_acf_(ad)) {
+		ad.multiply(ad, *sptr_acf_);
+		return;
+	}
+	BinNormalisation* norm = sptr_att_norm_.get();
 	shared_ptr<DataSymmetriesForViewSegmentNumbers>
 		symmetries_sptr(sptr_forw_projector_->get_symmetries_used()->clone());
 	norm->apply(*ad.data(), 0, 1, symmetries_sptr);
@@ -464,6 +1129,161 @@ PETAttenuationModel::normalise(PETAcquisitionData& ad) const
 //	sptr_normalisation_->set_up(sptr_ad->get_proj_data_info_sptr());
 //}
 
+// view-segment numbers of the basic related viewgrams of the projection data
+static std::vector<ViewSegmentNumbers>
+basic_vs_nums(const ProjData& proj_data,
+	const DataSymmetriesForViewSegmentNumbers& symmetries)
+{
+	std::vector<ViewSegmentNumbers> vs_nums;
+	for (int segment_num = proj_data.get_min_segment_num();
+		segment_num <= proj_data.get_max_segment_num(); ++segment_num)
+		for (int view_num = proj_data.get_min_view_num();
+			view_num <= proj_data.get_max_view_num(); ++view_num) {
+			ViewSegmentNumbers vs(view_num, segment_num);
+			if (symmetries.is_basic(vs))
+				vs_nums.push_back(vs);
+		}
+	return vs_nums;
+}
+
+// same subset assignment of views as in STIR projectors
+static bool
+in_subset(const ProjData& proj_data, const ViewSegmentNumbers& vs,
+	int subset_num, int num_subsets)
+{
+	return (vs.view_num() - proj_data.get_min_view_num()) % num_subsets
+		== subset_num;
+}
+
+// views of all related viewgrams projected for the subset, in ascending order
+static std::vector<int>
+subset_view_nums(const ProjData& proj_data,
+	const DataSymmetriesForViewSegmentNumbers& symmetries,
+	int subset_num, int num_subsets)
+{
+	int min_view = proj_data.get_min_view_num();
+	std::vector<bool> in(proj_data.get_num_views(), false);
+	std::vector<ViewSegmentNumbers> vs_nums =
+		basic_vs_nums(proj_data, symmetries);
+	for (size_t i = 0; i < vs_nums.size(); i++) {
+		if (!in_subset(proj_data, vs_nums[i], subset_num, num_subsets))
+			continue;
+		std::vector<ViewSegmentNumbers> related;
+		symmetries.get_related_view_segment_numbers(related, vs_nums[i]);
+		for (size_t j = 0; j < related.size(); j++)
+			in[related[j].view_num() - min_view] = true;
+	}
+	std::vector<int> view_nums;
+	for (size_t v = 0; v < in.size(); v++)
+		if (in[v])
+			view_nums.push_back(min_view + (int)v);
+	return view_nums;
+}
+
+// Calls task(i) for i = 0, ..., n - 1 for the sets of related viewgrams
+// processed by projections: on the SIRF thread pool if STIR projectors are
+// thread-safe (see SIRF_PARALLEL_PROJECTIONS option), serially otherwise.
+static void
+for_each_viewgrams(size_t n, const std::function<void(size_t)>& task)
+{
+#ifdef SIRF_PARALLEL_PROJECTIONS
+	sirf::parallel_for(n, task);
+#else
+	for (size_t i = 0; i < n; i++)
+		task(i);
+#endif
+}
+
+// number of partial back-projection images, each accumulating the
+// back-projections of every num_images-th set of related viewgrams
+static int
+num_backprojection_images(size_t num_vs)
+{
+#ifdef SIRF_PARALLEL_PROJECTIONS
+	return (int)std::max((size_t)1,
+		std::min(num_vs, (size_t)ThreadPool::instance().num_threads()));
+#else
+	return 1;
+#endif
+}
+
+void
+PETAcquisitionModel::set_terms_storage(const std::string& storage)
+{
+	if (storage != "float" && storage != "half" && storage != "uint16") {
+		std::string msg = "unknown terms storage " + storage;
+		THROW(msg.c_str());
+	}
+	if (storage == terms_storage_)
+		return;
+	terms_storage_ = storage;
+	sptr_add_ = stored_term_(sptr_add_);
+	sptr_background_ = stored_term_(sptr_background_);
+	sptr_asm_ = stored_asm_(sptr_asm_);
+	if (sptr_asm_ && sptr_asm_->data() && sptr_acq_template_)
+		sptr_asm_->set_up(sptr_acq_template_->get_proj_data_info_sptr());
+}
+
+shared_ptr<PETAcquisitionData>
+PETAcquisitionModel::stored_term_(shared_ptr<PETAcquisitionData> sptr) const
+{
+	if (!sptr)
+		return sptr;
+	const PETAcquisitionDataReducedPrecision* ptr_rp =
+		dynamic_cast<const PETAcquisitionDataReducedPrecision*>(sptr.get());
+	if (terms_storage_ == "float") {
+		if (!ptr_rp)
+			return sptr;
+		shared_ptr<PETAcquisitionData> sptr_f(sptr->new_acquisition_data());
+		sptr_f->fill(*sptr);
+		return sptr_f;
+	}
+	ProjDataReducedPrecision::Format format = terms_storage_ == "half" ?
+		ProjDataReducedPrecision::HALF : ProjDataReducedPrecision::SCALED_UINT16;
+	if (ptr_rp && ptr_rp->format() == format)
+		return sptr;
+	return shared_ptr<PETAcquisitionData>
+		(new PETAcquisitionDataReducedPrecision(*sptr, format));
+}
+
+shared_ptr<PETAcquisitionSensitivityModel>
+PETAcquisitionModel::stored_asm_
+(shared_ptr<PETAcquisitionSensitivityModel> sptr) const
+{
+	// only normalisation from bin efficiencies is stored by SIRF;
+	// inverse efficiencies of dead bins are huge, hence half (in which
+	// they are infinite) rather than scaled integers (which would lose the
+	// precision of the other bins of their rows)
+	if (sptr && sptr->first_model_sptr()) {
+		shared_ptr<PETAcquisitionSensitivityModel> sptr_mod1 =
+			stored_asm_(sptr->first_model_sptr());
+		shared_ptr<PETAcquisitionSensitivityModel> sptr_mod2 =
+			stored_asm_(sptr->second_model_sptr());
+		if (sptr_mod1 == sptr->first_model_sptr() &&
+			sptr_mod2 == sptr->second_model_sptr())
+			return sptr;
+		return shared_ptr<PETAcquisitionSensitivityModel>
+			(new PETAcquisitionSensitivityModel(sptr_mod1, sptr_mod2));
+	}
+	if (!sptr || !sptr->inverse_efficiencies_sptr())
+		return sptr;
+	shared_ptr<PETAcquisitionData> sptr_ad = sptr->inverse_efficiencies_sptr();
+	const PETAcquisitionDataReducedPrecision* ptr_rp =
+		dynamic_cast<const PETAcquisitionDataReducedPrecision*>(sptr_ad.get());
+	if (terms_storage_ == "float") {
+		if (!ptr_rp)
+			return sptr;
+		shared_ptr<PETAcquisitionData> sptr_f(sptr_ad->new_acquisition_data());
+		sptr_f->fill(*sptr_ad);
+		return PETAcquisitionSensitivityModel::from_inverse_efficiencies(sptr_f);
+	}
+	if (ptr_rp)
+		return sptr;
+	return PETAcquisitionSensitivityModel::from_inverse_efficiencies
+		(shared_ptr<PETAcquisitionData>(new PETAcquisitionDataReducedPrecision
+		(*sptr_ad, ProjDataReducedPrecision::HALF)));
+}
+
 Succeeded 
 PETAcquisitionModel::set_up(
 	shared_ptr<PETAcquisitionData> sptr_acq,
@@ -487,38 +1307,387 @@ void
 PETAcquisitionModel::forward(PETAcquisitionData& ad, const STIRImageData& image,
 	int subset_num, int num_subsets, bool zero)
 {
-	shared_ptr<ProjData> sptr_fd = ad.data();
-	sptr_projectors_->get_forward_projector_sptr()->forward_project
-		(*sptr_fd, image.data(), subset_num, num_subsets, zero);
+	SIRF_TIMER("PETAcquisitionModel::forward");
+	forward_(std::vector<PETAcquisitionData*>(1, &ad),
+		std::vector<const Image3DF*>(1, &image.data()),
+		subset_num, num_subsets, zero);
+	SIRF_COUNT(FORWARD_PROJECTIONS, 1);
+}
 
-	float one = 1.0;
+RelatedViewgrams<float>
+PETAcquisitionModel::bin_efficiencies_(const BinNormalisation& norm,
+	const ProjData& proj_data, const ViewSegmentNumbers& vs,
+	const shared_ptr<DataSymmetriesForViewSegmentNumbers>& sptr_symmetries,
+	std::mutex& norm_mutex)
+{
+	// all supported normalisations are multiplicative, so unnormalising
+	// ones yields the factors by which to unnormalise any viewgrams
+	RelatedViewgrams<float> efficiencies =
+		proj_data.get_empty_related_viewgrams(vs, sptr_symmetries);
+	efficiencies.fill(1.0f);
+	std::lock_guard<std::mutex> lock(norm_mutex);
+	norm.undo(efficiencies, 0, 1);
+	return efficiencies;
+}
 
-	if (sptr_add_.get()) {
-		std::cout << "additive term added...";
-		ad.axpby(&one, ad, &one, *sptr_add_);
-		//ad.axpby(1.0, ad, 1.0, *sptr_add_);
-		std::cout << "ok\n";
-	}
-	else
-		std::cout << "no additive term added\n";
+void
+PETAcquisitionModel::forward_(const std::vector<PETAcquisitionData*>& ads,
+	const std::vector<const Image3DF*>& images,
+	int subset_num, int num_subsets, bool zero)
+{
+	// Projects one set of related viewgrams at a time (for all images) and
+	// applies the additive term, unnormalisation and background term to it
+	// straight away, so that the projection data are read and written only
+	// once. Sets of related viewgrams are projected in parallel; reading and
+	// writing projection data (which STIR does not support concurrently)
+	// is serialised, and so is the computation of the bin efficiencies
+	// (which reads the normalisation's own data), done once per set of
+	// related viewgrams for all images.
+	size_t n = ads.size();
+	if (n < 1)
+		return;
+	const ProjData& proj_data = *ads[0]->data();
+	ForwardProjectorByBin& projector =
+		*sptr_projectors_->get_forward_projector_sptr();
+	shared_ptr<DataSymmetriesForViewSegmentNumbers>
+		sptr_symmetries(projector.get_symmetries_used()->clone());
 
+	const ProjData* add = sptr_add_.get() ? sptr_add_->data().get() : 0;
+	const ProjData* background = 
+		sptr_background_.get() ? sptr_background_->data().get() : 0;
+	const BinNormalisation* norm = 0;
 	PETAcquisitionSensitivityModel* sm = sptr_asm_.get();
-	if (sm && sm->data() && !sm->data()->is_trivial()) {
-		std::cout << "applying unnormalisation...";
-		sptr_asm_->unnormalise(ad);
-		std::cout << "ok\n";
+	if (sm && sm->data() && !sm->data()->is_trivial())
+		norm = sm->data().get();
+	// with subsets, bins outside the subset are zeroed if requested,
+	// as by STIR forward projectors, and the other terms still apply to them
+	zero = zero && num_subsets > 1;
+	bool other_terms = add || norm || background;
+
+	// containers storing only the subset views need nothing else
+	std::vector<bool> subset_only(n);
+	for (size_t k = 0; k < n; k++)
+		subset_only[k] = ads[k]->subset_views() != 0;
+
+	std::vector<ViewSegmentNumbers> vs_nums =
+		basic_vs_nums(proj_data, *sptr_symmetries);
+	std::mutex io_mutex;
+	std::mutex norm_mutex;
+	for_each_viewgrams(vs_nums.size(), [&](size_t i) {
+		const ViewSegmentNumbers& vs = vs_nums[i];
+		bool project = in_subset(proj_data, vs, subset_num, num_subsets);
+		// images whose projection data are to be updated
+		std::vector<size_t> update;
+		for (size_t k = 0; k < n; k++)
+			if (project || (!subset_only[k] && (zero || other_terms)))
+				update.push_back(k);
+		if (update.empty())
+			return;
+		size_t m = update.size();
+		std::vector<RelatedViewgrams<float> > viewgrams(m);
+		{
+			std::lock_guard<std::mutex> lock(io_mutex);
+			for (size_t j = 0; j < m; j++) {
+				const ProjData& pd = *ads[update[j]]->data();
+				if (project || zero)
+					viewgrams[j] = pd.get_empty_related_viewgrams
+					(vs, sptr_symmetries);
+				else
+					viewgrams[j] = pd.get_related_viewgrams
+					(vs, sptr_symmetries);
+			}
+		}
+		if (project) {
+			SIRF_TIMER("PETAcquisitionModel::forward: projection");
+			std::vector<RelatedViewgrams<float>*> ptr_viewgrams(m);
+			std::vector<const Image3DF*> ptr_images(m);
+			for (size_t j = 0; j < m; j++) {
+				ptr_viewgrams[j] = &viewgrams[j];
+				ptr_images[j] = images[update[j]];
+			}
+			forward_project_(ptr_viewgrams, ptr_images);
+		}
+		RelatedViewgrams<float> add_viewgrams;
+		RelatedViewgrams<float> background_viewgrams;
+		if (add || background) {
+			std::lock_guard<std::mutex> lock(io_mutex);
+			if (add)
+				add_viewgrams = add->get_related_viewgrams(vs, sptr_symmetries);
+			if (background)
+				background_viewgrams =
+				background->get_related_viewgrams(vs, sptr_symmetries);
+		}
+		RelatedViewgrams<float> efficiencies;
+		if (norm)
+			efficiencies = bin_efficiencies_(*norm, proj_data, vs,
+				sptr_symmetries, norm_mutex);
+		for (size_t j = 0; j < m; j++) {
+			if (add)
+				viewgrams[j] += add_viewgrams;
+			if (norm)
+				viewgrams[j] *= efficiencies;
+			if (background)
+				viewgrams[j] += background_viewgrams;
+		}
+		std::lock_guard<std::mutex> lock(io_mutex);
+		for (size_t j = 0; j < m; j++)
+			ads[update[j]]->data()->set_related_viewgrams(viewgrams[j]);
+	});
+}
+
+void
+PETAcquisitionModel::forward_project_(
+	const std::vector<RelatedViewgrams<float>*>& viewgrams,
+	const std::vector<const Image3DF*>& images)
+{
+	ForwardProjectorByBin& projector =
+		*sptr_projectors_->get_forward_projector_sptr();
+	for (size_t k = 0; k < images.size(); k++)
+		projector.forward_project(*viewgrams[k], *images[k]);
+}
+
+void
+PETAcquisitionModel::back_project_(const std::vector<Image3DF*>& images,
+	const std::vector<const RelatedViewgrams<float>*>& viewgrams)
+{
+	BackProjectorByBin& projector =
+		*sptr_projectors_->get_back_projector_sptr();
+	for (size_t k = 0; k < images.size(); k++)
+		projector.back_project(*images[k], *viewgrams[k]);
+}
+
+void
+PETAcquisitionModelUsingMatrix::forward_project_(
+	const std::vector<RelatedViewgrams<float>*>& viewgrams,
+	const std::vector<const Image3DF*>& images)
+{
+	size_t n = images.size();
+	if (n < 2) {
+		PETAcquisitionModel::forward_project_(viewgrams, images);
+		return;
 	}
-	else
-		std::cout << "no unnormalisation applied\n";
+	// as STIR's projector using a matrix with cached elements does, but
+	// with each row applied to all images
+	ProjMatrixByBin& matrix = *((ProjectorPairUsingMatrix*)
+		sptr_projectors_.get())->get_proj_matrix_sptr();
+	ProjMatrixElemsForOneBin row;
+	const int num_viewgrams = viewgrams[0]->get_num_viewgrams();
+	for (int v = 0; v < num_viewgrams; v++) {
+		std::vector<Viewgram<float>*> frame_viewgrams(n);
+		for (size_t k = 0; k < n; k++)
+			frame_viewgrams[k] = &*(viewgrams[k]->begin() + v);
+		const Viewgram<float>& viewgram = *frame_viewgrams[0];
+		for (int t = viewgram.get_min_tangential_pos_num();
+			t <= viewgram.get_max_tangential_pos_num(); t++)
+			for (int a = viewgram.get_min_axial_pos_num();
+				a <= viewgram.get_max_axial_pos_num(); a++) {
+				Bin bin(viewgram.get_segment_num(), viewgram.get_view_num(),
+					a, t, 0.0f);
+				matrix.get_proj_matrix_elems_for_one_bin(row, bin);
+				for (size_t k = 0; k < n; k++) {
+					bin.set_bin_value(0.0f);
+					row.forward_project(bin, *images[k]);
+					(*frame_viewgrams[k])[a][t] = bin.get_bin_value();
+				}
+			}
+	}
+}
 
-	if (sptr_background_.get()) {
-		std::cout << "background term added...";
-		ad.axpby(&one, ad, &one, *sptr_background_);
-		//ad.axpby(1.0, ad, 1.0, *sptr_background_);
-		std::cout << "ok\n";
+void
+PETAcquisitionModelUsingMatrix::back_project_(
+	const std::vector<Image3DF*>& images,
+	const std::vector<const RelatedViewgrams<float>*>& viewgrams)
+{
+	size_t n = images.size();
+	if (n < 2) {
+		PETAcquisitionModel::back_project_(images, viewgrams);
+		return;
 	}
-	else
-		std::cout << "no background term added\n";
+	ProjMatrixByBin& matrix = *((ProjectorPairUsingMatrix*)
+		sptr_projectors_.get())->get_proj_matrix_sptr();
+	ProjMatrixElemsForOneBin row;
+	const int num_viewgrams = viewgrams[0]->get_num_viewgrams();
+	for (int v = 0; v < num_viewgrams; v++) {
+		std::vector<const Viewgram<float>*> frame_viewgrams(n);
+		for (size_t k = 0; k < n; k++)
+			frame_viewgrams[k] = &*(viewgrams[k]->begin() + v);
+		const Viewgram<float>& viewgram = *frame_viewgrams[0];
+		for (int t = viewgram.get_min_tangential_pos_num();
+			t <= viewgram.get_max_tangential_pos_num(); t++)
+			for (int a = viewgram.get_min_axial_pos_num();
+				a <= viewgram.get_max_axial_pos_num(); a++) {
+				// bins with no counts in any image need no geometry
+				size_t k = 0;
+				while (k < n && (*frame_viewgrams[k])[a][t] == 0)
+					k++;
+				if (k == n)
+					continue;
+				Bin bin(viewgram.get_segment_num(), viewgram.get_view_num(),
+					a, t, 0.0f);
+				matrix.get_proj_matrix_elems_for_one_bin(row, bin);
+				for (; k < n; k++) {
+					float value = (*frame_viewgrams[k])[a][t];
+					if (value == 0)
+						continue;
+					bin.set_bin_value(value);
+					row.back_project(*images[k], bin);
+				}
+			}
+	}
+}
+
+std::string
+PETAcquisitionModelUsingMatrix::matrix_cache_prefix(const std::string& dir,
+	const RayTracingMatrix& matrix, const ProjDataInfo& pdi,
+	const Image3DF& image)
+{
+	// the matrix is identified by the text describing everything it depends
+	// on, saved along with the matrix and checked on loading
+	std::string key = matrix_cache_key_(matrix, pdi, image);
+	unsigned long long h = 14695981039346656037ULL;
+	for (size_t i = 0; i < key.length(); i++)
+		h = (h ^ (unsigned char)key[i]) * 1099511628211ULL;
+	std::ostringstream prefix;
+	prefix << dir << "/sirf_matrix_" << std::hex << std::setw(16)
+		<< std::setfill('0') << h;
+	return prefix.str();
+}
+
+std::string
+PETAcquisitionModelUsingMatrix::matrix_cache_key_(
+	const RayTracingMatrix& matrix, const ProjDataInfo& pdi,
+	const Image3DF& image)
+{
+	std::ostringstream key;
+	key << std::setprecision(9);
+	key << const_cast<RayTracingMatrix&>(matrix).parameter_info();
+	key << pdi.parameter_info();
+	BasicCoordinate<3, int> min_indices, max_indices;
+	image.get_regular_range(min_indices, max_indices);
+	key << "image index range: " << min_indices << max_indices << '\n';
+	key << "image origin: " << image.get_origin() << '\n';
+	const DiscretisedDensityOnCartesianGrid<3, float>* ptr_grid =
+		dynamic_cast<const DiscretisedDensityOnCartesianGrid<3, float>*>
+		(&image);
+	if (ptr_grid)
+		key << "image grid spacing: " << ptr_grid->get_grid_spacing() << '\n';
+	return key.str();
+}
+
+void
+PETAcquisitionModelUsingMatrix::write_matrix_cache(const std::string& dir,
+	RayTracingMatrix& matrix, shared_ptr<ProjDataInfo> sptr_pdi,
+	shared_ptr<Image3DF> sptr_image)
+{
+	// absolute paths, so that the matrix header refers to the template
+	// files wherever it is read from
+	std::string abs_dir = boost::filesystem::absolute(dir).string();
+	std::string prefix =
+		matrix_cache_prefix(abs_dir, matrix, *sptr_pdi, *sptr_image);
+	matrix.set_up(sptr_pdi, sptr_image);
+	if (write_proj_matrix_by_bin(prefix, matrix, sptr_pdi, *sptr_image)
+		!= Succeeded::yes) {
+		std::string msg = "failed to write matrix cache " + prefix;
+		THROW(msg.c_str());
+	}
+	std::ofstream key((prefix + ".key").c_str());
+	key << matrix_cache_key_(matrix, *sptr_pdi, *sptr_image);
+	if (!key) {
+		std::string msg = "failed to write matrix cache key " + prefix;
+		THROW(msg.c_str());
+	}
+}
+
+bool
+PETAcquisitionModelUsingMatrix::write_matrix(const std::string& dir)
+{
+	RayTracingMatrix* ptr_matrix =
+		dynamic_cast<RayTracingMatrix*>(sptr_matrix_.get());
+	if (!ptr_matrix || !sptr_acq_template_.get() ||
+		!sptr_image_template_.get())
+		return false;
+	if (cached_matrix_(dir, *sptr_acq_template_, *sptr_image_template_).get())
+		return true;
+	boost::filesystem::create_directories(dir);
+	write_matrix_cache(dir, *ptr_matrix,
+		sptr_acq_template_->get_proj_data_info_sptr(),
+		sptr_image_template_->data_sptr());
+	return true;
+}
+
+bool
+PETAcquisitionModelUsingMatrix::use_saved_matrix(const std::string& dir)
+{
+	if (!sptr_acq_template_.get() || !sptr_image_template_.get())
+		return false;
+	shared_ptr<ProjMatrixByBin> sptr;
+	try {
+		sptr = cached_matrix_(dir, *sptr_acq_template_, *sptr_image_template_);
+	}
+	catch (...) {
+	}
+	if (!sptr.get())
+		return false;
+	((ProjectorPairUsingMatrix*)this->sptr_projectors_.get())->
+		set_proj_matrix_sptr(sptr);
+	return true;
+}
+
+shared_ptr<ProjMatrixByBin>
+PETAcquisitionModelUsingMatrix::cached_matrix_(const std::string& dir,
+	const PETAcquisitionData& ad, const STIRImageData& image) const
+{
+	shared_ptr<ProjMatrixByBin> sptr;
+	const RayTracingMatrix* ptr_matrix =
+		dynamic_cast<const RayTracingMatrix*>(sptr_matrix_.get());
+	if (dir.length() < 1 || !ptr_matrix)
+		return sptr;
+	const ProjDataInfo& pdi = *ad.get_proj_data_info_sptr();
+	std::string prefix = matrix_cache_prefix
+		(dir, *ptr_matrix, pdi, image.data());
+	std::ifstream key_file((prefix + ".key").c_str());
+	if (!key_file)
+		return sptr;
+	std::stringstream key;
+	key << key_file.rdbuf();
+	if (key.str() != matrix_cache_key_(*ptr_matrix, pdi, image.data()))
+		return sptr;
+	shared_ptr<ProjMatrixByBinFromFile> sptr_file(new ProjMatrixByBinFromFile);
+	std::string header = prefix + ".hpm";
+	if (!sptr_file->parse(header.c_str()))
+		return sptr;
+	sptr = sptr_file;
+	return sptr;
+}
+
+Succeeded
+PETAcquisitionModelUsingMatrix::set_up(
+	shared_ptr<PETAcquisitionData> sptr_acq,
+	shared_ptr<STIRImageData> sptr_image)
+{
+	if (!sptr_matrix_.get())
+		return Succeeded::no;
+	ProjectorPairUsingMatrix* ptr_projectors =
+		(ProjectorPairUsingMatrix*)this->sptr_projectors_.get();
+	shared_ptr<ProjMatrixByBin> sptr_cached;
+	try {
+		sptr_cached = cached_matrix_(matrix_cache_dir_, *sptr_acq, *sptr_image);
+	}
+	catch (...) {
+		// unusable cache files: compute the matrix as usual
+	}
+	if (sptr_cached.get()) {
+		ptr_projectors->set_proj_matrix_sptr(sptr_cached);
+		try {
+			if (PETAcquisitionModel::set_up(sptr_acq, sptr_image)
+				== Succeeded::yes)
+				return Succeeded::yes;
+		}
+		catch (...) {
+		}
+	}
+	ptr_projectors->set_proj_matrix_sptr(sptr_matrix_);
+	return PETAcquisitionModel::set_up(sptr_acq, sptr_image);
 }
 
 shared_ptr<PETAcquisitionData>
@@ -566,34 +1735,823 @@ PETAcquisitionModel::forward(const STIRImageData& image,
 	return sptr_ad;
 }
 
+shared_ptr<PETAcquisitionData>
+PETAcquisitionModel::forward_subset_views(const STIRImageData& image,
+	int subset_num, int num_subsets)
+{
+	const ProjData& proj_data = *sptr_acq_template_->data();
+	std::vector<int> view_nums = subset_view_nums(proj_data,
+		*sptr_projectors_->get_forward_projector_sptr()->
+		get_symmetries_used(), subset_num, num_subsets);
+	shared_ptr<PETAcquisitionData> sptr_ad(new PETAcquisitionDataSubset
+		(sptr_acq_template_->get_exam_info_sptr(),
+		sptr_acq_template_->get_proj_data_info_sptr(),
+		view_nums));
+	forward(*sptr_ad, image, subset_num, num_subsets);
+	return sptr_ad;
+}
+
 shared_ptr<STIRImageData> 
 PETAcquisitionModel::backward(PETAcquisitionData& ad, 
 	int subset_num, int num_subsets)
 {
-	shared_ptr<STIRImageData> sptr_id;
-	sptr_id = sptr_image_template_->new_image_data();
-	shared_ptr<Image3DF> sptr_im = sptr_id->data_sptr();
+	SIRF_TIMER("PETAcquisitionModel::backward");
+	shared_ptr<STIRImageData> sptr_id = backward_
+		(std::vector<const PETAcquisitionData*>(1, &ad),
+		subset_num, num_subsets)[0];
+	SIRF_COUNT(BACK_PROJECTIONS, 1);
+	return sptr_id;
+}
+
+std::vector<shared_ptr<PETAcquisitionData> >
+PETAcquisitionModel::forward(const std::vector<shared_ptr<STIRImageData> >& images,
+	int subset_num, int num_subsets)
+{
+	SIRF_TIMER("PETAcquisitionModel::forward (batch)");
+	std::vector<shared_ptr<PETAcquisitionData> > ads;
+	std::vector<PETAcquisitionData*> ptr_ads;
+	std::vector<const Image3DF*> ptr_images;
+	for (size_t k = 0; k < images.size(); k++) {
+		shared_ptr<PETAcquisitionData> sptr_ad =
+			sptr_acq_template_->new_acquisition_data();
+		ads.push_back(sptr_ad);
+		ptr_ads.push_back(sptr_ad.get());
+		ptr_images.push_back(&images[k]->data());
+	}
+	forward_(ptr_ads, ptr_images, subset_num, num_subsets, num_subsets > 1);
+	SIRF_COUNT(FORWARD_PROJECTIONS, images.size());
+	return ads;
+}
+
+std::vector<shared_ptr<STIRImageData> >
+PETAcquisitionModel::backward
+(const std::vector<shared_ptr<PETAcquisitionData> >& ad,
+	int subset_num, int num_subsets)
+{
+	SIRF_TIMER("PETAcquisitionModel::backward (batch)");
+	std::vector<const PETAcquisitionData*> ptr_ads;
+	for (size_t k = 0; k < ad.size(); k++)
+		ptr_ads.push_back(ad[k].get());
+	std::vector<shared_ptr<STIRImageData> > images =
+		backward_(ptr_ads, subset_num, num_subsets);
+	SIRF_COUNT(BACK_PROJECTIONS, ad.size());
+	return images;
+}
 
-	//if (sptr_normalisation_.get() && !sptr_normalisation_->is_trivial()) {
+std::vector<shared_ptr<STIRImageData> >
+PETAcquisitionModel::backward_(const std::vector<const PETAcquisitionData*>& ads,
+	int subset_num, int num_subsets)
+{
+	// Back-projects one set of related viewgrams of the subset at a time,
+	// unnormalising it first if needed (by bin efficiencies computed once
+	// per set of related viewgrams for all images of a group). The images are split into groups
+	// (one per thread at most) and the sets of related viewgrams of each
+	// group into parts, each processed by a thread-pool task accumulating
+	// into its own images: the final ones for the first part and partial
+	// ones for the others, summed in a fixed order at the end. Within a
+	// group, each set of related viewgrams is back-projected for all images
+	// in turn (see back_project_).
+	size_t n = ads.size();
+	std::vector<shared_ptr<STIRImageData> > result(n);
+	if (n < 1)
+		return result;
+	const BinNormalisation* norm = 0;
 	PETAcquisitionSensitivityModel* sm = sptr_asm_.get();
-	if (sm && sm->data() && !sm->data()->is_trivial()) {
-		std::cout << "applying unnormalisation...";
-		shared_ptr<PETAcquisitionData> sptr_ad(ad.new_acquisition_data());
-		sptr_ad->fill(ad);
-		sptr_asm_->unnormalise(*sptr_ad);
-		//sptr_normalisation_->undo(*sptr_ad->data(), 0, 1);
-		std::cout << "ok\n";
-		std::cout << "backprojecting...";
-		sptr_projectors_->get_back_projector_sptr()->back_project
-			(*sptr_im, *sptr_ad, subset_num, num_subsets);
-		std::cout << "ok\n";
+	if (sm && sm->data() && !sm->data()->is_trivial())
+		norm = sm->data().get();
+
+	const ProjData& proj_data = *ads[0]->data();
+	BackProjectorByBin& projector =
+		*sptr_projectors_->get_back_projector_sptr();
+	shared_ptr<DataSymmetriesForViewSegmentNumbers>
+		sptr_symmetries(projector.get_symmetries_used()->clone());
+	std::vector<ViewSegmentNumbers> all_vs_nums =
+		basic_vs_nums(proj_data, *sptr_symmetries);
+	std::vector<ViewSegmentNumbers> vs_nums;
+	for (size_t i = 0; i < all_vs_nums.size(); i++)
+		if (in_subset(proj_data, all_vs_nums[i], subset_num, num_subsets))
+			vs_nums.push_back(all_vs_nums[i]);
+
+	size_t num_threads = num_backprojection_images(vs_nums.size());
+	size_t num_groups = std::min(n, num_threads);
+	size_t num_parts = std::max((size_t)1, num_threads / num_groups);
+	// images[k][p] accumulates part p of the back-projection of ads[k]
+	std::vector<std::vector<Image3DF*> > images(n);
+	std::vector<shared_ptr<Image3DF> > partial_images;
+	for (size_t k = 0; k < n; k++) {
+		result[k] = sptr_image_template_->new_image_data();
+		images[k].push_back(result[k]->data_sptr().get());
+		for (size_t p = 1; p < num_parts; p++) {
+			shared_ptr<Image3DF> sptr_im(images[k][0]->get_empty_copy());
+			partial_images.push_back(sptr_im);
+			images[k].push_back(sptr_im.get());
+		}
 	}
+	std::mutex io_mutex;
+	std::mutex norm_mutex;
+	for_each_viewgrams(num_groups*num_parts, [&](size_t task) {
+		size_t g = task / num_parts;
+		size_t p = task % num_parts;
+		size_t first = g*n / num_groups;
+		size_t last = (g + 1)*n / num_groups;
+		size_t m = last - first;
+		std::vector<RelatedViewgrams<float> > viewgrams(m);
+		std::vector<const RelatedViewgrams<float>*> ptr_viewgrams(m);
+		std::vector<Image3DF*> ptr_images(m);
+		for (size_t j = 0; j < m; j++) {
+			ptr_viewgrams[j] = &viewgrams[j];
+			ptr_images[j] = images[first + j][p];
+		}
+		for (size_t i = p; i < vs_nums.size(); i += num_parts) {
+			{
+				std::lock_guard<std::mutex> lock(io_mutex);
+				for (size_t j = 0; j < m; j++)
+					viewgrams[j] = ads[first + j]->data()->get_related_viewgrams
+						(vs_nums[i], sptr_symmetries);
+			}
+			if (norm) {
+				RelatedViewgrams<float> efficiencies = bin_efficiencies_
+					(*norm, proj_data, vs_nums[i], sptr_symmetries, norm_mutex);
+				for (size_t j = 0; j < m; j++)
+					viewgrams[j] *= efficiencies;
+			}
+			SIRF_TIMER("PETAcquisitionModel::backward: projection");
+			back_project_(ptr_images, ptr_viewgrams);
+		}
+	});
+	for (size_t k = 0; k < n; k++)
+		for (size_t p = 1; p < num_parts; p++)
+			*images[k][0] += *images[k][p];
+
+	return result;
+}
+
+std::string
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+key_hash_(const std::string& key)
+{
+	unsigned long long h = 14695981039346656037ULL;
+	for (size_t i = 0; i < key.length(); i++)
+		h = (h ^ (unsigned char)key[i]) * 1099511628211ULL;
+	std::ostringstream hash;
+	hash << std::hex << std::setw(16) << std::setfill('0') << h;
+	return hash.str();
+}
+
+std::string
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+sensitivity_id() const
+{
+	return sensitivity_key_.length() > 0 ?
+		key_hash_(sensitivity_key_) : sensitivity_key_;
+}
+
+std::string
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+sensitivity_id(const Image3DF& image)
+{
+	if (is_null_ptr(this->projector_pair_ptr) ||
+		is_null_ptr(this->proj_data_sptr))
+		return "";
+	std::string key = sensitivity_cache_key_(image);
+	return key.length() > 0 ? key_hash_(key) : key;
+}
+
+std::string
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+sensitivity_cache_key_(const Image3DF& image)
+{
+	std::ostringstream key;
+	key << std::setprecision(9);
+	key << this->projector_pair_ptr->parameter_info();
+	const ProjData& proj_data = *this->proj_data_sptr;
+	key << proj_data.get_proj_data_info_sptr()->parameter_info();
+	key << "max segment number: " << this->max_segment_num_to_process << '\n';
+	key << "number of subsets: " << this->num_subsets << '\n';
+	key << "subset sensitivities: " << this->use_subset_sensitivities << '\n';
+	BasicCoordinate<3, int> min_indices, max_indices;
+	image.get_regular_range(min_indices, max_indices);
+	key << "image index range: " << min_indices << max_indices << '\n';
+	key << "image origin: " << image.get_origin() << '\n';
+	const DiscretisedDensityOnCartesianGrid<3, float>* ptr_grid =
+		dynamic_cast<const DiscretisedDensityOnCartesianGrid<3, float>*>
+		(&image);
+	if (ptr_grid)
+		key << "image grid spacing: " << ptr_grid->get_grid_spacing() << '\n';
+
+	shared_ptr<BinNormalisation> norm = this->normalisation_sptr;
+	if (is_null_ptr(norm) || norm->is_trivial())
+		return key.str();
+	// the normalisation is identified by what its model was created from;
+	// one set otherwise would have to be applied to be identified
+	std::string norm_id;
+	if (sptr_asm_.get() && norm == sptr_asm_norm_)
+		norm_id = sptr_asm_->id();
+	if (norm_id.length() < 1)
+		return "";
+	key << "normalisation:\n" << norm_id;
+	// the normalisation is applied for the start and end times of the
+	// frame, e.g. to correct for decay or dead time; the key is computed
+	// before set_up reads the frame definitions, so they are read here
+	const TimeFrameDefinitions frame_defs =
+		this->frame_definition_filename.size() > 0 ?
+		TimeFrameDefinitions(this->frame_definition_filename) :
+		this->frame_defs;
+	key << "frame number: " << this->frame_num << '\n';
+	if (this->frame_num >= 1 &&
+		this->frame_num <= (int)frame_defs.get_num_frames())
+		key << "frame times: " << frame_defs.get_start_time(this->frame_num)
+			<< ' ' << frame_defs.get_end_time(this->frame_num) << '\n';
+	const TimeFrameDefinitions& data_frames =
+		proj_data.get_exam_info_sptr()->get_time_frame_definitions();
+	for (unsigned int f = 1; f <= data_frames.get_num_frames(); f++)
+		key << "data frame times: " << data_frames.get_start_time(f)
+			<< ' ' << data_frames.get_end_time(f) << '\n';
+	return key.str();
+}
+
+void
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+trim_sensitivity_cache_(const std::string& dir, unsigned long long max_size,
+	const std::string& keep)
+{
+	// removes least recently used entries (by the time of their key file)
+	// until the cache fits its size; filesystem errors are ignored
+	namespace fs = boost::filesystem;
+	struct Entry {
+		std::time_t time;
+		fs::path path;
+		unsigned long long size;
+		bool operator<(const Entry& other) const
+		{
+			return time < other.time;
+		}
+	};
+	boost::system::error_code ec;
+	std::vector<Entry> entries;
+	unsigned long long total = 0;
+	for (fs::directory_iterator it(dir, ec), end; !ec && it != end;
+		it.increment(ec)) {
+		Entry entry;
+		entry.path = it->path();
+		if (!fs::is_directory(entry.path, ec) ||
+			entry.path.filename().string().compare(0, 17, "sirf_sensitivity_"))
+			continue;
+		entry.size = 0;
+		boost::system::error_code fec;
+		for (fs::directory_iterator f(entry.path, fec), fend; !fec && f != fend;
+			f.increment(fec))
+			if (fs::is_regular_file(f->path(), fec))
+				entry.size += fs::file_size(f->path(), fec);
+		entry.time = fs::last_write_time(entry.path / "key", fec);
+		if (fec)
+			entry.time = 0;
+		entries.push_back(entry);
+		total += entry.size;
+	}
+	std::sort(entries.begin(), entries.end());
+	for (size_t i = 0; i < entries.size() && total > max_size; i++) {
+		if (entries[i].path.string() == keep)
+			continue;
+		fs::remove_all(entries[i].path, ec);
+		if (!ec)
+			total -= entries[i].size;
+	}
+}
+
+Succeeded
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::set_up
+(shared_ptr<Image3DF> const& target_sptr)
+{
+	// workers forked earlier would not see the new settings
+	workers_.reset();
+	sensitivity_key_ = "";
+	if (!is_null_ptr(this->projector_pair_ptr) &&
+		!is_null_ptr(this->proj_data_sptr))
+		sensitivity_key_ = sensitivity_cache_key_(*target_sptr);
+	Succeeded s = set_up_sensitivities_(target_sptr);
+	if (s != Succeeded::yes)
+		sensitivity_key_ = "";
+	// the workers are forked here, with the state just set up, rather than
+	// in the middle of a reconstruction
+	if (s == Succeeded::yes && num_processes_ > 1 && ProcessPool::available())
+		start_workers_(*target_sptr);
+	return s;
+}
+
+Succeeded
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+set_up_sensitivities_(shared_ptr<Image3DF> const& target_sptr)
+{
+	typedef PoissonLogLikelihoodWithLinearModelForMeanAndProjData<Image3DF>
+		Base;
+	const std::string& key = sensitivity_key_;
+	if (sensitivity_cache_dir_.length() < 1 || !this->recompute_sensitivity ||
+		this->sensitivity_filename.length() > 0 ||
+		this->subsensitivity_filenames.length() > 0 || key.length() < 1)
+		return Base::set_up(target_sptr);
+
+	namespace fs = boost::filesystem;
+	fs::path entry = fs::path(sensitivity_cache_dir_) /
+		("sirf_sensitivity_" + key_hash_(key));
+	fs::path key_path = entry / "key";
+
+	// the (subset) sensitivities are read by STIR from these files, or
+	// written to them below
+	const bool subsets = this->use_subset_sensitivities;
+	const int num_files = subsets ? this->num_subsets : 1;
+	std::vector<fs::path> files;
+	for (int s = 0; s < num_files; s++) {
+		std::ostringstream file;
+		if (subsets)
+			file << "subsensitivity_" << s << ".hv";
+		else
+			file << "sensitivity.hv";
+		files.push_back(entry / file.str());
+	}
+	bool cached = false;
+	std::ifstream key_file(key_path.string().c_str());
+	if (key_file) {
+		std::stringstream cached_key;
+		cached_key << key_file.rdbuf();
+		cached = cached_key.str() == key;
+		for (int s = 0; cached && s < num_files; s++)
+			cached = fs::exists(files[s]);
+	}
+	key_file.close();
+	if (!cached) {
+		Succeeded s = Base::set_up(target_sptr);
+		if (s == Succeeded::yes)
+			write_sensitivity_cache_(entry.string(), key);
+		return s;
+	}
+
+	std::string filename =
+		(entry / (subsets ? "subsensitivity_%d.hv" : "sensitivity.hv")).string();
+	if (subsets)
+		this->subsensitivity_filenames = filename;
+	else
+		this->sensitivity_filename = filename;
+	this->recompute_sensitivity = false;
+	Succeeded s = Succeeded::no;
+	try {
+		s = Base::set_up(target_sptr);
+	}
+	catch (...) {
+		this->subsensitivity_filenames = "";
+		this->sensitivity_filename = "";
+		this->recompute_sensitivity = true;
+		throw;
+	}
+	this->subsensitivity_filenames = "";
+	this->sensitivity_filename = "";
+	this->recompute_sensitivity = true;
+	if (s == Succeeded::yes) {
+		boost::system::error_code ec;
+		fs::last_write_time(key_path, std::time(0), ec);
+	}
+	return s;
+}
+
+void
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+write_sensitivity_cache_(const std::string& dir, const std::string& key)
+{
+	// writes the sensitivities computed by set_up, in Interfile format
+	// whatever STIR's default output format, then the key, so that an
+	// entry with a key is complete; failures only leave the entry unused
+	namespace fs = boost::filesystem;
+	boost::system::error_code ec;
+	fs::create_directories(dir, ec);
+	bool written = !ec;
+	fs::remove(fs::path(dir) / "key", ec);
+	InterfileOutputFileFormat format;
+	if (this->use_subset_sensitivities)
+		for (int s = 0; written && s < this->num_subsets; s++) {
+			std::ostringstream file;
+			file << "subsensitivity_" << s << ".hv";
+			std::string filename = (fs::path(dir) / file.str()).string();
+			written = format.write_to_file
+				(filename, this->get_subset_sensitivity(s)) == Succeeded::yes;
+		}
 	else {
-		std::cout << "backprojecting...";
-		sptr_projectors_->get_back_projector_sptr()->back_project
-			(*sptr_im, ad, subset_num, num_subsets);
-		std::cout << "ok\n";
+		std::string filename = (fs::path(dir) / "sensitivity.hv").string();
+		written = format.write_to_file
+			(filename, this->get_sensitivity()) == Succeeded::yes;
+	}
+	if (written) {
+		std::ofstream out((fs::path(dir) / "key").string().c_str());
+		out << key;
 	}
+	trim_sensitivity_cache_(sensitivity_cache_dir_,
+		(unsigned long long)std::max(sensitivity_cache_size_, 0) << 20, dir);
+}
 
-	return sptr_id;
+void
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+actual_compute_subset_gradient_without_penalty(Image3DF& gradient,
+	const Image3DF& current_estimate, const int subset_num,
+	const bool add_sensitivity)
+{
+	typedef PoissonLogLikelihoodWithLinearModelForMeanAndProjData<Image3DF>
+		Base;
+	// the sensitivity term is left to STIR
+	if (num_processes_ < 2 || !add_sensitivity || !ProcessPool::available()) {
+		Base::actual_compute_subset_gradient_without_penalty
+			(gradient, current_estimate, subset_num, add_sensitivity);
+		return;
+	}
+	if (!workers_.get() ||
+		!current_estimate.has_same_characteristics(*sptr_worker_estimate_))
+		start_workers_(current_estimate);
+
+	SIRF_TIMER("PoissonLogLikelihood: subset gradient in worker processes");
+	size_t n = current_estimate.size_all();
+	float* shared = (float*)workers_->shared_memory();
+	std::copy(current_estimate.begin_all(), current_estimate.end_all(),
+		shared);
+	workers_->run(subset_num);
+
+	// the sum of the workers' parts, each stored after the estimate
+	int num_workers = workers_->num_workers();
+	std::vector<float> sum(n);
+	parallel_for_blocks(n, (size_t)1 << 16, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			float s = 0;
+			for (int w = 1; w <= num_workers; w++)
+				s += shared[w*n + i];
+			sum[i] = s;
+		}
+	});
+	std::copy(sum.begin(), sum.end(), gradient.begin_all());
+}
+
+const PETAcquisitionDataSparse*
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+sparse_acquisition_data_() const
+{
+	const PETAcquisitionDataSparse* ptr_ad =
+		dynamic_cast<const PETAcquisitionDataSparse*>(sptr_ad_.get());
+	if (!ptr_ad || !sptr_am_.get() || this->proj_data_sptr != ptr_ad->data())
+		return 0;
+	// the mean must be that of STIR
+	AcqMod3DF& am = *sptr_am_;
+	if (this->projector_pair_ptr != am.projectors_sptr() ||
+		am.background_term_sptr().get())
+		return 0;
+	shared_ptr<ProjData> sptr_add;
+	if (am.additive_term_sptr().get())
+		sptr_add = am.additive_term_sptr()->data();
+	if (this->additive_proj_data_sptr != sptr_add)
+		return 0;
+	if (sptr_asm_norm_.get() ? this->normalisation_sptr != sptr_asm_norm_ :
+		!is_null_ptr(this->normalisation_sptr) &&
+		!this->normalisation_sptr->is_trivial())
+		return 0;
+	// (max_segment_num_to_process -1 stands for all segments)
+	if (this->zero_seg0_end_planes ||
+		(this->max_segment_num_to_process >= 0 &&
+		this->max_segment_num_to_process < ptr_ad->get_max_segment_num()))
+		return 0;
+	return ptr_ad;
+}
+
+double
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+actual_compute_objective_function_without_penalty
+(const Image3DF& current_estimate, const int subset_num)
+{
+	typedef PoissonLogLikelihoodWithLinearModelForMeanAndProjData<Image3DF>
+		Base;
+	const PETAcquisitionDataSparse* ptr_ad = sparse_acquisition_data_();
+	if (!ptr_ad)
+		return Base::actual_compute_objective_function_without_penalty
+			(current_estimate, subset_num);
+	SIRF_TIMER("PoissonLogLikelihood: value from sparse data");
+	STIRImageData image(current_estimate);
+	// the mean takes memory proportional to the subset size
+	shared_ptr<PETAcquisitionData> sptr_mean =
+		sptr_am_->forward_subset_views(image, subset_num, this->num_subsets);
+	return ptr_ad->log_likelihood(*sptr_mean);
+}
+
+void
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+start_workers_(const Image3DF& image)
+{
+	workers_.reset();
+	sptr_worker_estimate_.reset(image.clone());
+	sptr_worker_gradient_.reset(image.get_empty_copy());
+	int num_workers = num_processes_;
+	size_t size = (num_workers + 1)*image.size_all()*sizeof(float);
+	workers_.reset(new ProcessPool(num_workers, size,
+		[this](int worker, int subset_num, void* shared) {
+		worker_gradient_(worker, subset_num, (float*)shared);
+	}));
+}
+
+void
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+zero_end_planes_(RelatedViewgrams<float>& viewgrams)
+{
+	const int min_a = viewgrams.get_min_axial_pos_num();
+	const int max_a = viewgrams.get_max_axial_pos_num();
+	for (RelatedViewgrams<float>::iterator iter = viewgrams.begin();
+		iter != viewgrams.end(); ++iter) {
+		(*iter)[min_a].fill(0.0f);
+		(*iter)[max_a].fill(0.0f);
+	}
+}
+
+void
+xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF::
+worker_gradient_(int worker, int subset_num, float* shared)
+{
+	// runs in worker process: back-projects the ratios of measured to
+	// estimated data for every num_processes-th set of related viewgrams
+	// of the subset, as STIR does for all of them
+	Image3DF& estimate = *sptr_worker_estimate_;
+	Image3DF& gradient = *sptr_worker_gradient_;
+	size_t n = estimate.size_all();
+	std::copy(shared, shared + n, estimate.begin_all());
+	gradient.fill(0.0f);
+
+	const ProjData& proj_data = *this->proj_data_sptr;
+	const ProjData* add = is_null_ptr(this->additive_proj_data_sptr) ?
+		0 : this->additive_proj_data_sptr.get();
+	const BinNormalisation* norm = 0;
+	if (!is_null_ptr(this->normalisation_sptr) &&
+		!this->normalisation_sptr->is_trivial())
+		norm = this->normalisation_sptr.get();
+	const double start_time = this->frame_defs.get_start_time(this->frame_num);
+	const double end_time = this->frame_defs.get_end_time(this->frame_num);
+	ForwardProjectorByBin& forward_projector =
+		*this->projector_pair_ptr->get_forward_projector_sptr();
+	BackProjectorByBin& back_projector =
+		*this->projector_pair_ptr->get_back_projector_sptr();
+	shared_ptr<DataSymmetriesForViewSegmentNumbers> sptr_symmetries
+		(this->projector_pair_ptr->get_symmetries_used()->clone());
+
+	std::vector<ViewSegmentNumbers> vs_nums =
+		basic_vs_nums(proj_data, *sptr_symmetries);
+	int j = 0;
+	for (size_t i = 0; i < vs_nums.size(); i++) {
+		const ViewSegmentNumbers& vs = vs_nums[i];
+		if (std::abs(vs.segment_num()) > this->max_segment_num_to_process ||
+			!in_subset(proj_data, vs, subset_num, this->num_subsets))
+			continue;
+		if (j++ % num_processes_ != worker)
+			continue;
+		// segment 0 end planes are zeroed if requested, as by STIR
+		const bool zero_end_planes =
+			this->zero_seg0_end_planes && vs.segment_num() == 0;
+		RelatedViewgrams<float> measured =
+			proj_data.get_related_viewgrams(vs, sptr_symmetries);
+		if (zero_end_planes)
+			zero_end_planes_(measured);
+		RelatedViewgrams<float> estimated = measured.get_empty_copy();
+		forward_projector.forward_project(estimated, estimate);
+		if (add) {
+			RelatedViewgrams<float> add_viewgrams =
+				add->get_related_viewgrams(vs, sptr_symmetries);
+			if (zero_end_planes)
+				zero_end_planes_(add_viewgrams);
+			estimated += add_viewgrams;
+		}
+		RelatedViewgrams<float> mult;
+		if (norm) {
+			mult = measured.get_empty_copy();
+			mult.fill(1.0f);
+			norm->undo(mult, start_time, end_time);
+			estimated *= mult;
+		}
+		int count = 0;
+		int count2 = 0;
+		divide_and_truncate(measured, estimated, 0, count, count2);
+		if (norm)
+			measured *= mult;
+		back_projector.back_project(gradient, measured);
+	}
+	std::copy(gradient.begin_all(), gradient.end_all(),
+		shared + (1 + worker)*n);
+}
+
+// checkpoint state file: "key: value" lines
+static std::map<std::string, std::string>
+read_checkpoint_state(const std::string& filename)
+{
+	std::map<std::string, std::string> state;
+	std::ifstream in(filename.c_str());
+	std::string line;
+	while (std::getline(in, line)) {
+		size_t pos = line.find(": ");
+		if (pos != std::string::npos)
+			state[line.substr(0, pos)] = line.substr(pos + 2);
+	}
+	return state;
+}
+
+static void
+write_checkpoint_image(const std::string& filename, const Image3DF& image)
+{
+	InterfileOutputFileFormat format;
+	if (format.write_to_file(filename, image) != Succeeded::yes) {
+		std::string msg = "failed to write checkpoint image " + filename;
+		THROW(msg.c_str());
+	}
+}
+
+static bool
+starts_with(const std::string& s, const std::string& prefix)
+{
+	return s.compare(0, prefix.length(), prefix) == 0;
+}
+
+void
+xSTIR_IterativeReconstruction3DF::write_checkpoint(const std::string& dir,
+	const Image3DF& image, bool with_matrix)
+{
+	namespace fs = boost::filesystem;
+	fs::create_directories(dir);
+	fs::path state_path = fs::path(dir) / "checkpoint";
+	std::map<std::string, std::string> old_state =
+		read_checkpoint_state(state_path.string());
+	// files of each checkpoint are numbered, so that those of the previous
+	// one stay valid until the new state file replaces the old one
+	int generation = atoi(old_state["generation"].c_str()) + 1;
+	std::ostringstream estimate;
+	estimate << "estimate_" << generation << ".hv";
+	write_checkpoint_image((fs::path(dir) / estimate.str()).string(), image);
+
+	PoissonLogLhLinModMean3DF* ptr_fun = dynamic_cast<PoissonLogLhLinModMean3DF*>
+		(this->objective_function_sptr.get());
+	PoissonLogLhLinModMeanProjData3DF* ptr_fun_x =
+		dynamic_cast<PoissonLogLhLinModMeanProjData3DF*>(ptr_fun);
+	std::string sensitivities;
+	std::string sensitivity_id;
+	int sensitivity_generation = 0;
+	bool subsets = ptr_fun && ptr_fun->get_use_subset_sensitivities();
+	if (ptr_fun_x)
+		sensitivity_id = ptr_fun_x->sensitivity_id();
+	if (ptr_fun && sensitivity_id.length() > 0 &&
+		old_state["sensitivity id"] == sensitivity_id &&
+		old_state["subset sensitivities"] == (subsets ? "1" : "0")) {
+		sensitivities = old_state["sensitivities"];
+		sensitivity_generation =
+			atoi(old_state["sensitivity generation"].c_str());
+	}
+	else if (ptr_fun) {
+		sensitivity_generation = generation;
+		std::ostringstream name;
+		name << "sensitivity_" << generation;
+		if (subsets) {
+			for (int s = 0; s < this->num_subsets; s++) {
+				std::ostringstream file;
+				file << name.str() << '_' << s << ".hv";
+				write_checkpoint_image((fs::path(dir) / file.str()).string(),
+					ptr_fun->get_subset_sensitivity(s));
+			}
+			sensitivities = name.str() + "_%d.hv";
+		}
+		else {
+			sensitivities = name.str() + ".hv";
+			write_checkpoint_image((fs::path(dir) / sensitivities).string(),
+				ptr_fun->get_subset_sensitivity(0));
+		}
+	}
+	if (with_matrix && ptr_fun_x) {
+		AcqModUsingMatrix3DF* ptr_am = dynamic_cast<AcqModUsingMatrix3DF*>
+			(ptr_fun_x->acquisition_model_sptr().get());
+		if (ptr_am)
+			ptr_am->write_matrix((fs::path(dir) / "matrix").string());
+	}
+
+	std::ostringstream state;
+	state << "generation: " << generation << '\n';
+	state << "subiteration: " << this->subiteration_num << '\n';
+	state << "start subiteration: " << this->start_subiteration_num << '\n';
+	state << "start subset: " << this->start_subset_num << '\n';
+	state << "number of subsets: " << this->num_subsets << '\n';
+	state << "estimate: " << estimate.str() << '\n';
+	if (sensitivities.length() > 0) {
+		state << "sensitivities: " << sensitivities << '\n';
+		state << "sensitivity generation: " << sensitivity_generation << '\n';
+		state << "subset sensitivities: " << (subsets ? 1 : 0) << '\n';
+		state << "sensitivity id: " << sensitivity_id << '\n';
+	}
+	fs::path tmp_path = fs::path(dir) / "checkpoint.tmp";
+	std::ofstream out(tmp_path.string().c_str());
+	out << state.str();
+	out.close();
+	if (!out) {
+		std::string msg = "failed to write checkpoint state to " + dir;
+		THROW(msg.c_str());
+	}
+	fs::rename(tmp_path, state_path);
+
+	// files of earlier checkpoints
+	std::ostringstream current_estimate;
+	current_estimate << "estimate_" << generation << '.';
+	std::ostringstream current_sensitivity;
+	current_sensitivity << "sensitivity_" << sensitivity_generation;
+	boost::system::error_code ec;
+	std::vector<fs::path> old_files;
+	for (fs::directory_iterator it(dir, ec), end; !ec && it != end;
+		it.increment(ec)) {
+		std::string name = it->path().filename().string();
+		if ((starts_with(name, "estimate_") &&
+			!starts_with(name, current_estimate.str())) ||
+			(starts_with(name, "sensitivity_") &&
+			(sensitivities.length() < 1 ||
+			(!starts_with(name, current_sensitivity.str() + '_') &&
+			!starts_with(name, current_sensitivity.str() + '.')))))
+			old_files.push_back(it->path());
+	}
+	for (size_t i = 0; i < old_files.size(); i++)
+		fs::remove(old_files[i], ec);
+}
+
+Succeeded
+xSTIR_IterativeReconstruction3DF::resume(const std::string& dir,
+	shared_ptr<Image3DF> sptr_image)
+{
+	namespace fs = boost::filesystem;
+	std::map<std::string, std::string> state =
+		read_checkpoint_state((fs::path(dir) / "checkpoint").string());
+	if (state["estimate"].length() < 1) {
+		std::string msg = "no checkpoint found in " + dir;
+		THROW(msg.c_str());
+	}
+	if (atoi(state["number of subsets"].c_str()) != this->num_subsets)
+		THROW("checkpoint saved with a different number of subsets");
+	shared_ptr<Image3DF> sptr_estimate =
+		read_from_file<Image3DF>((fs::path(dir) / state["estimate"]).string());
+	if (!sptr_estimate->has_same_characteristics(*sptr_image))
+		THROW("image geometry differs from that of the checkpoint");
+
+	PoissonLogLhLinModMean3DF* ptr_fun = dynamic_cast<PoissonLogLhLinModMean3DF*>
+		(this->objective_function_sptr.get());
+	PoissonLogLhLinModMeanProjData3DF* ptr_fun_x =
+		dynamic_cast<PoissonLogLhLinModMeanProjData3DF*>(ptr_fun);
+	bool subsets = ptr_fun && ptr_fun->get_use_subset_sensitivities();
+	// the saved sensitivities are read only if they were computed for the
+	// current set-up, otherwise setup recomputes them; the objective
+	// function gets the number of subsets set by setup for its id
+	std::string sensitivity_id;
+	if (ptr_fun_x) {
+		ptr_fun_x->set_num_subsets(this->num_subsets);
+		sensitivity_id = ptr_fun_x->sensitivity_id(*sptr_image);
+	}
+	bool read_sensitivities = ptr_fun && state["sensitivities"].length() > 0 &&
+		state["subset sensitivities"] == (subsets ? "1" : "0") &&
+		sensitivity_id.length() > 0 &&
+		state["sensitivity id"] == sensitivity_id;
+	if (ptr_fun && state["sensitivities"].length() > 0 && !read_sensitivities)
+		std::cout << "sensitivities saved in " << dir
+			<< " do not match the current set-up, recomputing\n";
+	if (read_sensitivities) {
+		std::string filename =
+			fs::absolute(fs::path(dir) / state["sensitivities"]).string();
+		if (subsets)
+			ptr_fun->set_subsensitivity_filenames(filename);
+		else
+			ptr_fun->set_sensitivity_filename(filename);
+		ptr_fun->set_recompute_sensitivity(false);
+	}
+	if (ptr_fun_x && fs::exists(fs::path(dir) / "matrix")) {
+		AcqModUsingMatrix3DF* ptr_am = dynamic_cast<AcqModUsingMatrix3DF*>
+			(ptr_fun_x->acquisition_model_sptr().get());
+		if (ptr_am)
+			ptr_am->use_saved_matrix((fs::path(dir) / "matrix").string());
+	}
+	this->set_start_subset_num(atoi(state["start subset"].c_str()));
+
+	Succeeded s = Succeeded::no;
+	try {
+		if (!post_process())
+			s = setup(sptr_image);
+	}
+	catch (...) {
+		if (read_sensitivities) {
+			ptr_fun->set_subsensitivity_filenames("");
+			ptr_fun->set_sensitivity_filename("");
+			ptr_fun->set_recompute_sensitivity(true);
+		}
+		throw;
+	}
+	if (read_sensitivities) {
+		ptr_fun->set_subsensitivity_filenames("");
+		ptr_fun->set_sensitivity_filename("");
+		ptr_fun->set_recompute_sensitivity(true);
+	}
+	if (s != Succeeded::yes)
+		return s;
+	this->subiteration_num = atoi(state["subiteration"].c_str());
+	// the subsets are chosen relative to the start subiteration
+	if (state["start subiteration"].length() > 0)
+		this->set_start_subiteration_num
+		(atoi(state["start subiteration"].c_str()));
+	std::copy(sptr_estimate->begin_all(), sptr_estimate->end_all(),
+		sptr_image->begin_all());
+	return s;
 }
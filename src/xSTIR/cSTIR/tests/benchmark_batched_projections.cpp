@@ -0,0 +1,123 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+Times forward and back projections of a series of images (e.g. time frames)
+by a ray tracing matrix acquisition model, one image at a time and batched,
+and reports the relative difference between the two results.
+
+Usage: benchmark_batched_projections [frames [span]]
+(by default, there are 20 frames and span is 11)
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "stir/common.h"
+
+#include "sirf/STIR/stir_x.h"
+
+#include "test_utilities.h"
+
+using namespace stir;
+using namespace sirf;
+
+int main(int argc, char* argv[])
+{
+	try {
+		int num_frames = 20;
+		int span = 11;
+		if (argc > 1)
+			num_frames = std::atoi(argv[1]);
+		if (argc > 2)
+			span = std::atoi(argv[2]);
+		if (num_frames < 1)
+			num_frames = 1;
+
+		PETAcquisitionDataInMemory::set_as_template();
+		shared_ptr<ExamInfo> sptr_ei(new ExamInfo);
+		shared_ptr<PETAcquisitionData> sptr_ad
+			(new PETAcquisitionDataInMemory(sptr_ei, "Siemens mMR", span));
+		shared_ptr<STIRImageData> sptr_id
+			(new STIRImageData(*sptr_ad->get_proj_data_info_sptr()));
+		sptr_id->fill(1.0f);
+
+		shared_ptr<RayTracingMatrix> sptr_matrix(new RayTracingMatrix);
+		sptr_matrix->set_num_tangential_LORs(2);
+		PETAcquisitionModelUsingMatrix am;
+		am.set_matrix(sptr_matrix);
+		if (am.set_up(sptr_ad, sptr_id) != Succeeded::yes) {
+			std::cout << "acquisition model set-up failed\n";
+			return 1;
+		}
+		// compute the matrix elements before timing
+		am.forward(*sptr_id);
+
+		// frames with different uniform activities
+		std::vector<shared_ptr<STIRImageData> > frames;
+		for (int f = 0; f < num_frames; f++) {
+			shared_ptr<STIRImageData> sptr_frame(sptr_id->clone());
+			sptr_frame->fill(1.0f + f);
+			frames.push_back(sptr_frame);
+		}
+
+		Clock::time_point start = Clock::now();
+		std::vector<shared_ptr<PETAcquisitionData> > fwd;
+		for (int f = 0; f < num_frames; f++)
+			fwd.push_back(am.forward(*frames[f]));
+		double t_fwd = seconds_since(start);
+		start = Clock::now();
+		std::vector<shared_ptr<STIRImageData> > bck;
+		for (int f = 0; f < num_frames; f++)
+			bck.push_back(am.backward(*fwd[f]));
+		double t_bck = seconds_since(start);
+
+		start = Clock::now();
+		std::vector<shared_ptr<PETAcquisitionData> > fwd_batch =
+			am.forward(frames);
+		double t_fwd_batch = seconds_since(start);
+		start = Clock::now();
+		std::vector<shared_ptr<STIRImageData> > bck_batch = am.backward(fwd);
+		double t_bck_batch = seconds_since(start);
+
+		float fwd_diff = 0;
+		float bck_diff = 0;
+		for (int f = 0; f < num_frames; f++) {
+			fwd_diff = std::max(fwd_diff,
+				relative_difference(*fwd_batch[f], *fwd[f]));
+			bck_diff = std::max(bck_diff,
+				relative_difference(*bck_batch[f], *bck[f]));
+		}
+		std::cout << num_frames << " frames\n";
+		std::cout << "            one at a time (s)  batched (s)"
+			"  speed-up  max relative difference\n";
+		std::cout << "forward   " << t_fwd << "  " << t_fwd_batch << "  "
+			<< t_fwd / t_fwd_batch << "  " << fwd_diff << '\n';
+		std::cout << "backward  " << t_bck << "  " << t_bck_batch << "  "
+			<< t_bck / t_bck_batch << "  " << bck_diff << '\n';
+		return 0;
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << '\n';
+		return 1;
+	}
+}
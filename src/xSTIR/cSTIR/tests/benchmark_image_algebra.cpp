@@ -0,0 +1,170 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+Times STIRImageData dot, norm, axpby, multiply and divide on 344x344x127
+images (the size of Siemens mMR reconstructions) for 1, 2, 4, ..., N threads,
+and compares the results with those of a plain serial loop over the image
+voxels: the elementwise results are expected to be identical, while dot and
+norm, summed in a different order, differ by rounding errors only.
+
+Usage: benchmark_image_algebra [N [repetitions]]
+(by default, N is the default number of SIRF threads and repetitions is 10)
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include "stir/common.h"
+#include "stir/IndexRange3D.h"
+
+#include "sirf/common/thread_pool.h"
+#include "sirf/STIR/stir_data_containers.h"
+
+#include "test_utilities.h"
+
+using namespace stir;
+using namespace sirf;
+
+// number of voxels of a and b that differ
+static size_t num_different(const Image3DF& a, const Image3DF& b)
+{
+	size_t n = 0;
+	Image3DF::const_full_iterator ia = a.begin_all();
+	Image3DF::const_full_iterator ib = b.begin_all();
+	for (; ia != a.end_all() && ib != b.end_all(); ++ia, ++ib)
+		if (*ia != *ib)
+			n++;
+	return n;
+}
+
+int main(int argc, char* argv[])
+{
+	try {
+		int max_threads = ThreadPool::default_num_threads();
+		int repetitions = 10;
+		if (argc > 1)
+			max_threads = std::atoi(argv[1]);
+		if (argc > 2)
+			repetitions = std::atoi(argv[2]);
+		if (max_threads < 1)
+			max_threads = 1;
+		if (repetitions < 1)
+			repetitions = 1;
+
+		Voxels3DF voxels(IndexRange3D(0, 126, -172, 171, -172, 171),
+			CartesianCoordinate3D<float>(0, 0, 0),
+			CartesianCoordinate3D<float>(2.03125f, 2.08626f, 2.08626f));
+		STIRImageData x(voxels);
+		STIRImageData y(voxels);
+		STIRImageData z(voxels);
+		std::mt19937 gen(1);
+		std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+		Image3DF::full_iterator ix = x.data().begin_all();
+		Image3DF::full_iterator iy = y.data().begin_all();
+		for (; ix != x.data().end_all(); ++ix, ++iy) {
+			*ix = uniform(gen);
+			*iy = uniform(gen);
+		}
+		*y.data().begin_all() = 0.0f; // exercise the divide threshold
+
+		// reference results by serial loops over the voxels
+		const float a = 0.3f;
+		const float b = -1.7f;
+		STIRImageData ref_axpby(voxels);
+		STIRImageData ref_multiply(voxels);
+		STIRImageData ref_divide(voxels);
+		float vmax = 0.0f;
+		for (iy = y.data().begin_all(); iy != y.data().end_all(); ++iy)
+			vmax = std::max(vmax, std::abs(*iy));
+		float vmin = 1e-6*vmax;
+		double ref_dot = 0.0;
+		double ref_norm = 0.0;
+		Image3DF::full_iterator i1 = ref_axpby.data().begin_all();
+		Image3DF::full_iterator i2 = ref_multiply.data().begin_all();
+		Image3DF::full_iterator i3 = ref_divide.data().begin_all();
+		ix = x.data().begin_all();
+		iy = y.data().begin_all();
+		for (; ix != x.data().end_all(); ++ix, ++iy, ++i1, ++i2, ++i3) {
+			*i1 = a * (*ix) + b * (*iy);
+			*i2 = (*ix) * (*iy);
+			float vy = *iy;
+			if (vy >= 0 && vy < vmin)
+				vy = vmin;
+			else if (vy < 0 && vy > -vmin)
+				vy = -vmin;
+			*i3 = (*ix) / vy;
+			ref_dot += (double)(*ix) * (*iy);
+			ref_norm += (double)(*ix) * (*ix);
+		}
+		ref_norm = std::sqrt(ref_norm);
+
+		std::cout << "time per call (ms), relative difference (dot, norm) or"
+			" number of voxels differing (others) from the serial loop"
+			" in brackets\n";
+		std::cout << "threads  dot  norm  axpby  multiply  divide\n";
+		for (int nt = 1;; nt = std::min(2 * nt, max_threads)) {
+			ThreadPool::instance().set_num_threads(nt);
+			float dot;
+			float norm;
+			Clock::time_point start = Clock::now();
+			for (int r = 0; r < repetitions; r++)
+				x.dot(y, &dot);
+			double t_dot = seconds_since(start);
+			double d_dot = std::abs(dot - ref_dot) / std::abs(ref_dot);
+			start = Clock::now();
+			for (int r = 0; r < repetitions; r++)
+				norm = x.norm();
+			double t_norm = seconds_since(start);
+			double d_norm = std::abs(norm - ref_norm) / ref_norm;
+			start = Clock::now();
+			for (int r = 0; r < repetitions; r++)
+				z.axpby(&a, x, &b, y);
+			double t_axpby = seconds_since(start);
+			size_t d_axpby = num_different(z.data(), ref_axpby.data());
+			start = Clock::now();
+			for (int r = 0; r < repetitions; r++)
+				z.multiply(x, y);
+			double t_multiply = seconds_since(start);
+			size_t d_multiply = num_different(z.data(), ref_multiply.data());
+			start = Clock::now();
+			for (int r = 0; r < repetitions; r++)
+				z.divide(x, y);
+			double t_divide = seconds_since(start);
+			size_t d_divide = num_different(z.data(), ref_divide.data());
+			double ms = 1e3 / repetitions;
+			std::cout << nt << "  " << t_dot*ms << " (" << d_dot << ")"
+				<< "  " << t_norm*ms << " (" << d_norm << ")"
+				<< "  " << t_axpby*ms << " (" << d_axpby << ")"
+				<< "  " << t_multiply*ms << " (" << d_multiply << ")"
+				<< "  " << t_divide*ms << " (" << d_divide << ")\n";
+			if (nt >= max_threads)
+				break;
+		}
+		return 0;
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << '\n';
+		return 1;
+	}
+}
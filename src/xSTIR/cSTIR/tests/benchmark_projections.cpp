@@ -0,0 +1,104 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+Times forward and back projections by a ray tracing matrix acquisition model
+for 1, 2, 4, ..., N threads and reports the relative difference from the
+results obtained with one thread.
+
+Usage: benchmark_projections [N [span]]
+(by default, N is the default number of SIRF threads and span is 11)
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "stir/common.h"
+
+#include "sirf/common/thread_pool.h"
+#include "sirf/STIR/stir_x.h"
+
+#include "test_utilities.h"
+
+using namespace stir;
+using namespace sirf;
+
+int main(int argc, char* argv[])
+{
+	try {
+		int max_threads = ThreadPool::default_num_threads();
+		int span = 11;
+		if (argc > 1)
+			max_threads = std::atoi(argv[1]);
+		if (argc > 2)
+			span = std::atoi(argv[2]);
+		if (max_threads < 1)
+			max_threads = 1;
+
+		PETAcquisitionDataInMemory::set_as_template();
+		shared_ptr<ExamInfo> sptr_ei(new ExamInfo);
+		shared_ptr<PETAcquisitionData> sptr_ad
+			(new PETAcquisitionDataInMemory(sptr_ei, "Siemens mMR", span));
+		shared_ptr<STIRImageData> sptr_id
+			(new STIRImageData(*sptr_ad->get_proj_data_info_sptr()));
+		sptr_id->fill(1.0f);
+
+		shared_ptr<RayTracingMatrix> sptr_matrix(new RayTracingMatrix);
+		sptr_matrix->set_num_tangential_LORs(2);
+		PETAcquisitionModelUsingMatrix am;
+		am.set_matrix(sptr_matrix);
+		if (am.set_up(sptr_ad, sptr_id) != Succeeded::yes) {
+			std::cout << "acquisition model set-up failed\n";
+			return 1;
+		}
+		// compute the matrix elements before timing
+		am.forward(*sptr_id);
+
+		shared_ptr<PETAcquisitionData> sptr_fwd1;
+		shared_ptr<STIRImageData> sptr_bck1;
+		std::cout << "threads  forward (s)  backward (s)"
+			<< "  forward diff  backward diff\n";
+		for (int nt = 1;; nt = std::min(2 * nt, max_threads)) {
+			ThreadPool::instance().set_num_threads(nt);
+			Clock::time_point start = Clock::now();
+			shared_ptr<PETAcquisitionData> sptr_fwd = am.forward(*sptr_id);
+			double t_fwd = seconds_since(start);
+			start = Clock::now();
+			shared_ptr<STIRImageData> sptr_bck = am.backward(*sptr_fwd);
+			double t_bck = seconds_since(start);
+			// serial results, kept unchanged as the reference
+			if (nt == 1) {
+				sptr_fwd1 = sptr_fwd->clone();
+				sptr_bck1 = sptr_bck->clone();
+			}
+			std::cout << nt << "  " << t_fwd << "  " << t_bck << "  "
+				<< relative_difference(*sptr_fwd, *sptr_fwd1) << "  "
+				<< relative_difference(*sptr_bck, *sptr_bck1) << '\n';
+			if (nt >= max_threads)
+				break;
+		}
+		return 0;
+	}
+	catch (std::exception& e) {
+		std::cout << e.what() << '\n';
+		return 1;
+	}
+}
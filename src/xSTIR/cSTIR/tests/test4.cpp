@@ -1,12 +1,19 @@
 #include <iostream>
+#include <cmath>
 #include <cstdlib>
+#include <vector>
+
+#include <boost/filesystem.hpp>
 
 #include "stir/common.h"
 #include "stir/IO/stir_ecat_common.h"
+#include "stir/IndexRange3D.h"
 
 #include "sirf/STIR/stir_x.h"
 #include "sirf/common/getenv.h"
 
+#include "test_utilities.h"
+
 using namespace stir;
 using namespace ecat;
 using namespace sirf;
@@ -42,10 +49,228 @@ int test4()
 	}
 }
 
+// acquisition data in memory for a small mMR template, a uniform image and
+// a ray tracing acquisition model set up for them
+static bool set_up_small_model(shared_ptr<PETAcquisitionData>& sptr_ad,
+	shared_ptr<STIRImageData>& sptr_id,
+	shared_ptr<PETAcquisitionModelUsingMatrix>& sptr_am)
+{
+	std::string SIRF_path = sirf::getenv("SIRF_PATH");
+	if (SIRF_path.length() < 1) {
+		std::cout << "SIRF_PATH not defined, cannot find data" << std::endl;
+		return false;
+	}
+
+	std::string path = SIRF_path + "/data/examples/PET/mMR/";
+	string f_template = path + "mMR_template_span11_small.hs";
+
+	PETAcquisitionDataInMemory::set_as_template();
+	PETAcquisitionDataInFile acq_template(f_template.c_str());
+	sptr_ad.reset(new PETAcquisitionDataInMemory
+		(acq_template.get_exam_info_sptr(),
+		acq_template.get_proj_data_info_sptr()));
+	Voxels3DF voxels(IndexRange3D(0, 126, -40, 39, -40, 39),
+		CartesianCoordinate3D<float>(0, 0, 0),
+		CartesianCoordinate3D<float>(2.03125f, 4.17252f, 4.17252f));
+	sptr_id.reset(new STIRImageData(voxels));
+	sptr_id->fill(1.0f);
+
+	shared_ptr<RayTracingMatrix> sptr_matrix(new RayTracingMatrix);
+	sptr_matrix->set_num_tangential_LORs(2);
+	sptr_am.reset(new PETAcquisitionModelUsingMatrix);
+	sptr_am->set_matrix(sptr_matrix);
+	return sptr_am->set_up(sptr_ad, sptr_id) == Succeeded::yes;
+}
+
+// a unique directory in the system temporary directory, removed with all its
+// contents when going out of scope
+struct TemporaryDirectory {
+	boost::filesystem::path path;
+	TemporaryDirectory() : path(boost::filesystem::temp_directory_path() /
+		boost::filesystem::unique_path("sirf_%%%%-%%%%-%%%%"))
+	{
+		boost::filesystem::create_directories(path);
+	}
+	~TemporaryDirectory()
+	{
+		boost::system::error_code ec;
+		boost::filesystem::remove_all(path, ec);
+	}
+};
+
+// a reconstruction is checkpointed after its first subiteration and resumed
+// by a new one, which must start from the saved estimate and subiteration
+// and then continue as the original one does
+int test_checkpoint()
+{
+	try {
+
+		shared_ptr<PETAcquisitionData> sptr_ad;
+		shared_ptr<STIRImageData> sptr_id;
+		shared_ptr<PETAcquisitionModelUsingMatrix> sptr_am;
+		if (!set_up_small_model(sptr_ad, sptr_id, sptr_am))
+			return 1;
+		// measured data: projection of a uniform image
+		sptr_ad = sptr_am->forward(*sptr_id);
+
+		TemporaryDirectory tmp;
+		const std::string dir = (tmp.path / "checkpoint").string();
+		const std::string prefix = (tmp.path / "output").string();
+		shared_ptr<OSMAPOSLReconstruction3DF> sptr_recon[2];
+		for (int i = 0; i < 2; i++) {
+			shared_ptr<PoissonLogLhLinModMeanProjData3DF>
+				sptr_fun(new PoissonLogLhLinModMeanProjData3DF);
+			sptr_fun->set_acquisition_data(sptr_ad);
+			sptr_fun->set_acquisition_model(sptr_am);
+			sptr_recon[i].reset(new OSMAPOSLReconstruction3DF);
+			sptr_recon[i]->set_num_subsets(4);
+			sptr_recon[i]->set_num_subiterations(4);
+			sptr_recon[i]->set_save_interval(4);
+			sptr_recon[i]->set_output_filename_prefix(prefix);
+			sptr_recon[i]->set_objective_function_sptr(sptr_fun);
+		}
+		xSTIR_IterativeReconstruction3DF& recon =
+			*(xSTIR_IterativeReconstruction3DF*)sptr_recon[0].get();
+		xSTIR_IterativeReconstruction3DF& resumed =
+			*(xSTIR_IterativeReconstruction3DF*)sptr_recon[1].get();
+
+		shared_ptr<STIRImageData> sptr_x(sptr_id->clone());
+		if (sptr_recon[0]->set_up(sptr_x) != Succeeded::yes)
+			return 1;
+		sptr_recon[0]->update(sptr_x);
+		recon.write_checkpoint(dir, sptr_x->data());
+		shared_ptr<STIRImageData> sptr_saved(sptr_x->clone());
+		int subiteration = recon.subiteration();
+		sptr_recon[0]->update(sptr_x);
+
+		shared_ptr<STIRImageData> sptr_y(sptr_id->clone());
+		sptr_y->fill(0.0f);
+		if (resumed.resume(dir, sptr_y->data_sptr()) != Succeeded::yes)
+			return 1;
+		if (resumed.subiteration() != subiteration ||
+			resumed.get_start_subiteration_num() !=
+			recon.get_start_subiteration_num()) {
+			std::cout << "subiteration not restored" << std::endl;
+			return 1;
+		}
+		if (relative_difference(*sptr_y, *sptr_saved) != 0) {
+			std::cout << "estimate not restored" << std::endl;
+			return 1;
+		}
+		sptr_recon[1]->update(sptr_y);
+		float diff = relative_difference(*sptr_y, *sptr_x);
+		if (diff > 1e-5) {
+			std::cout << "resumed reconstruction differs by " << diff
+				<< std::endl;
+			return 1;
+		}
+		return 0;
+	}
+	catch (...)
+	{
+		return 1;
+	}
+}
+
+// the objective function value computed from the non-zero bins of sparse
+// acquisition data must be that computed by STIR from the same data stored
+// densely
+int test_sparse_log_likelihood()
+{
+	try {
+		shared_ptr<PETAcquisitionData> sptr_ad;
+		shared_ptr<STIRImageData> sptr_id;
+		shared_ptr<PETAcquisitionModelUsingMatrix> sptr_am;
+		if (!set_up_small_model(sptr_ad, sptr_id, sptr_am))
+			return 1;
+		// measured data: every 7th bin of the projection of a uniform
+		// image, rounded, the others zero
+		sptr_ad = sptr_am->forward(*sptr_id);
+		std::vector<float> y(sptr_ad->data()->size_all());
+		sptr_ad->copy_to(&y[0]);
+		for (size_t i = 0; i < y.size(); i++)
+			y[i] = i % 7 ? 0.0f : std::floor(y[i] + 0.5f);
+		sptr_ad->fill_from(&y[0]);
+		shared_ptr<PETAcquisitionData>
+			sptr_sparse(new PETAcquisitionDataSparse(*sptr_ad));
+
+		shared_ptr<STIRImageData> sptr_x(sptr_id->clone());
+		sptr_x->fill(0.5f);
+		// with subsets, the sparse data value is computed from the
+		// forward projections of the subset views
+		for (int num_subsets = 1; num_subsets <= 4; num_subsets += 3) {
+			double value[2];
+			for (int i = 0; i < 2; i++) {
+				PoissonLogLhLinModMeanProjData3DF fun;
+				fun.set_acquisition_data(i ? sptr_sparse : sptr_ad);
+				fun.set_acquisition_model(sptr_am);
+				fun.set_num_subsets(num_subsets);
+				if (fun.set_up(sptr_x->data_sptr()) != Succeeded::yes)
+					return 1;
+				value[i] = fun.compute_objective_function(sptr_x->data());
+			}
+			if (std::abs(value[1] - value[0]) > 1e-5*std::abs(value[0])) {
+				std::cout << "sparse data value " << value[1]
+					<< " differs from dense data value " << value[0]
+					<< " (" << num_subsets << " subsets)" << std::endl;
+				return 1;
+			}
+		}
+		return 0;
+	}
+	catch (...)
+	{
+		return 1;
+	}
+}
+
+// the forward projection stored for the views of a subset only must be
+// that of the subset stored in full size
+int test_subset_views()
+{
+	try {
+		shared_ptr<PETAcquisitionData> sptr_ad;
+		shared_ptr<STIRImageData> sptr_id;
+		shared_ptr<PETAcquisitionModelUsingMatrix> sptr_am;
+		if (!set_up_small_model(sptr_ad, sptr_id, sptr_am))
+			return 1;
+		const int num_subsets = 4;
+		for (int s = 0; s < num_subsets; s++) {
+			shared_ptr<PETAcquisitionData> sptr_full =
+				sptr_am->forward(*sptr_id, s, num_subsets);
+			shared_ptr<PETAcquisitionData> sptr_views =
+				sptr_am->forward_subset_views(*sptr_id, s, num_subsets);
+			if (sptr_views->buffer_size() >=
+				(size_t)sptr_full->data()->size_all()) {
+				std::cout << "subset " << s
+					<< " views are not stored in less memory" << std::endl;
+				return 1;
+			}
+			float diff = relative_difference(*sptr_views, *sptr_full);
+			if (diff > 1e-6) {
+				std::cout << "subset " << s << " views differ from the subset "
+					<< "forward projection by " << diff << std::endl;
+				return 1;
+			}
+		}
+		return 0;
+	}
+	catch (...)
+	{
+		return 1;
+	}
+}
+
 //int test5();
 
 int main()
 {
-	return test4();
+	if (test4())
+		return 1;
+	if (test_checkpoint())
+		return 1;
+	if (test_sparse_log_likelihood())
+		return 1;
+	return test_subset_views();
 	//return test5();
 }
\ No newline at end of file
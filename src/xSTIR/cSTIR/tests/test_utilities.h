@@ -0,0 +1,50 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+Helpers shared by the cSTIR tests and benchmarks.
+*/
+
+#ifndef SIRF_STIR_TEST_UTILITIES
+#define SIRF_STIR_TEST_UTILITIES
+
+#include <chrono>
+
+#include "stir/common.h"
+
+typedef std::chrono::steady_clock Clock;
+
+inline double seconds_since(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// ||x - y|| / ||y|| for STIRImageData or PETAcquisitionData
+template<class Data>
+inline float relative_difference(const Data& x, const Data& y)
+{
+	stir::shared_ptr<Data> sptr_d(x.clone());
+	float one = 1.0f;
+	float minus_one = -1.0f;
+	sptr_d->axpby(&one, x, &minus_one, y);
+	return sptr_d->norm() / y.norm();
+}
+
+#endif
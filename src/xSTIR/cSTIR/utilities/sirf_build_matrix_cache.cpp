@@ -0,0 +1,149 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2020 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup STIR Extensions
+\brief Compute a ray tracing matrix and save it in the matrix cache.
+
+The saved matrix is loaded by PETAcquisitionModelUsingMatrix::set_up for
+acquisition data and images of the same geometry as the templates, provided
+the model's matrix has the same parameters and its matrix cache directory is
+the one the matrix was saved in.
+
+\author CCP PETMR
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "sirf/common/getenv.h"
+#include "sirf/STIR/stir_x.h"
+
+using namespace sirf;
+
+/// print usage
+void print_usage()
+{
+    std::cout << "\n*** sirf_build_matrix_cache usage ***\n";
+
+    // Required flags
+    std::cout << "\n  Required flags:\n";
+    std::cout << "    -acq:\t\ttemplate acquisition data\n";
+    std::cout << "    -img:\t\ttemplate image\n";
+
+    // Optional flags
+    std::cout << "\n  Optional flags:\n";
+    std::cout << "    -dir:\t\tcache directory (default: $SIRF_MATRIX_CACHE_DIR, or else .)\n";
+    std::cout << "    -num_tangential_LORs:\tnumber of LORs per bin (default: 2)\n";
+}
+
+/// throw error
+void err(const std::string message)
+{
+    std::cerr << "\n" << message << "\n";
+    exit(EXIT_FAILURE);
+}
+
+/// main
+int main(int argc, char* argv[])
+{
+    try {
+        std::string acq_filename = "", img_filename = "";
+        std::string dir = sirf::getenv("SIRF_MATRIX_CACHE_DIR");
+        if (dir.size() == 0)
+            dir = ".";
+        // same default as for RayTracingMatrix objects created by SIRF
+        int num_tangential_LORs = 2;
+
+        // Loop over all input arguments (ignore first argument (name of executable))
+        argc--; argv++;
+        while (argc>0) {
+
+            // help
+            if (strcmp(argv[0], "-h") == 0) {
+                print_usage();
+                exit(EXIT_SUCCESS);
+            }
+
+            // acquisition data template
+            if (strcmp(argv[0], "-acq") == 0) {
+                if (argc<2)
+                    err("Option '-acq' expects a (filename) argument.");
+                acq_filename = argv[1];
+                argc-=2; argv+=2;
+            }
+            // image template
+            else if (strcmp(argv[0], "-img") == 0) {
+                if (argc<2)
+                    err("Option '-img' expects a (filename) argument.");
+                img_filename = argv[1];
+                argc-=2; argv+=2;
+            }
+            // cache directory
+            else if (strcmp(argv[0], "-dir") == 0) {
+                if (argc<2)
+                    err("Option '-dir' expects a (directory) argument.");
+                dir = argv[1];
+                argc-=2; argv+=2;
+            }
+            // number of tangential LORs
+            else if (strcmp(argv[0], "-num_tangential_LORs") == 0) {
+                if (argc<2)
+                    err("Option '-num_tangential_LORs' expects a (numerical) argument.");
+                num_tangential_LORs = atoi(argv[1]);
+                argc-=2; argv+=2;
+            }
+
+            // Unknown argument
+            else
+                err("Unknown option '" + std::string(argv[0]) + "'.");
+        }
+
+        // Check filenames aren't blank
+        if (acq_filename.size() == 0)
+            err("Error: -acq required.");
+        if (img_filename.size() == 0)
+            err("Error: -img required.");
+
+        PETAcquisitionDataInFile::init();
+        PETAcquisitionDataInFile acq(acq_filename.c_str());
+        STIRImageData img(img_filename);
+
+        RayTracingMatrix matrix;
+        matrix.set_num_tangential_LORs(num_tangential_LORs);
+        PETAcquisitionModelUsingMatrix::write_matrix_cache
+            (dir, matrix, acq.get_proj_data_info_sptr(), img.data_sptr());
+
+        std::cout << "\nMatrix saved as "
+            << PETAcquisitionModelUsingMatrix::matrix_cache_prefix
+            (dir, matrix, *acq.get_proj_data_info_sptr(), img.data())
+            << ".*\n";
+    }
+
+    // If there was an error
+    catch(const std::exception &error) {
+        std::cerr << "\nError encountered:\n\t" << error.what() << "\n\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
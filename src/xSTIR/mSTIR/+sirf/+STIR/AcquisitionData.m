@@ -37,11 +37,25 @@ classdef AcquisitionData < sirf.SIRF.DataContainer
 %           scheme = 'memory':
 %               all acquisition data generated from now on will be kept in
 %               RAM (avoid if data is very large)
+%           scheme = 'mmap':
+%               all acquisition data generated from now on will be kept in
+%               scratch files mapped to memory, paged in and out by the
+%               operating system as needed (see set_scratch_directory)
             h = calllib...
                 ('mstir', 'mSTIR_setAcquisitionsStorageScheme', scheme);
             sirf.Utilities.check_status('AcquisitionData', h);
             sirf.Utilities.delete(h)
         end
+        function set_scratch_directory(dir)
+%***SIRF*** Sets the directory for the scratch files of the 'mmap' scheme.
+%           A directory on a fast device (tmpfs, NVMe) is recommended.
+%           By default, the directory specified by the environment variable
+%           SIRF_SCRATCH_DIR is used, or else the current directory.
+            h = calllib...
+                ('mstir', 'mSTIR_setAcquisitionsScratchDirectory', dir);
+            sirf.Utilities.check_status('AcquisitionData', h);
+            sirf.Utilities.delete(h)
+        end
         function scheme = get_storage_scheme()
 %***SIRF*** Returns current acquisition storage scheme name
             h = calllib...
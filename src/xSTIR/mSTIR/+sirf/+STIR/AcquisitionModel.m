@@ -73,6 +73,16 @@ classdef AcquisitionModel < handle
             sirf.STIR.setParameter(self.handle_, 'AcquisitionModel', ...
                 'asm', asm, 'h');
         end
+        function set_terms_storage(self, storage)
+%***SIRF*** sets the storage format of the additive and background terms
+%         and of the normalisation: 'float' (default), 'half' (16-bit
+%         floating point) or 'uint16' (16-bit integers scaled per row
+%         of tangential positions); in the latter two cases normalisation
+%         from bin efficiencies is stored as 'half'. Only these 16-bit
+%         copies are kept, which halves the memory the terms take.
+            sirf.STIR.setParameter(self.handle_, 'AcquisitionModel', ...
+                'terms_storage', storage, 'c');
+        end
         function set_up(self, acq_templ, img_templ)
 %***SIRF*** sets up the object with appropriate geometric information.
 %         This function needs to be called before performing forward- or 
@@ -108,6 +118,19 @@ classdef AcquisitionModel < handle
                 self.handle_, x.handle_, subset_num, num_subsets);
             sirf.Utilities.check_status([self.name ':forward'], ad.handle_)
         end
+        function ad = forward_subset_views(self, x, subset_num, num_subsets)
+%***SIRF*** computes the forward projection of x for the views of a subset,
+%         stored for these views only; the other views read as zeros.
+%         Usage: 
+%             acq_data = forward_subset_views(image, subset_num, num_subsets);
+%         x:  an ImageData object.
+            sirf.Utilities.assert_validity(x, 'ImageData')
+            ad = sirf.STIR.AcquisitionData();
+            ad.handle_ = calllib('mstir', 'mSTIR_acquisitionModelFwdSubsetViews',...
+                self.handle_, x.handle_, subset_num, num_subsets);
+            sirf.Utilities.check_status...
+                ([self.name ':forward_subset_views'], ad.handle_)
+        end
         function image = backward(self, y, subset_num, num_subsets)
 %***SIRF*** returns the backprojection of y (see AcquisitionModel)
 %         y:  an AcquisitionData object.
@@ -122,5 +145,58 @@ classdef AcquisitionModel < handle
             sirf.Utilities.check_status...
                 ([self.name ':backward'], image.handle_)
         end
+        function ads = forward_batch(self, images, subset_num, num_subsets)
+%***SIRF*** returns the forward projections of images, which must have the
+%         same geometry, as a cell array; the geometry of each bin is
+%         computed once for all images (see forward).
+%         images:  a cell array of ImageData objects.
+            if nargin < 4
+                subset_num = 0;
+                num_subsets = 1;
+            end
+            handles = sirf.SIRF.DataHandleVector();
+            for k = 1 : numel(images)
+                sirf.Utilities.assert_validity(images{k}, 'ImageData')
+                handles.push_back(images{k}.handle_)
+            end
+            batch = calllib('mstir', 'mSTIR_acquisitionModelFwdBatch',...
+                self.handle_, handles.handle_, subset_num, num_subsets);
+            sirf.Utilities.check_status([self.name ':forward_batch'], batch)
+            ads = cell(1, numel(images));
+            for k = 1 : numel(images)
+                ads{k} = sirf.STIR.AcquisitionData();
+                ads{k}.handle_ = calllib...
+                    ('mstir', 'mSTIR_acquisitionDataBatchItem', batch, k - 1);
+                sirf.Utilities.check_status...
+                    ([self.name ':forward_batch'], ads{k}.handle_)
+            end
+            sirf.Utilities.delete(batch)
+        end
+        function images = backward_batch(self, ads, subset_num, num_subsets)
+%***SIRF*** returns the backprojections of ads, which must have the same
+%         geometry, as a cell array (see forward_batch).
+%         ads:  a cell array of AcquisitionData objects.
+            if nargin < 4
+                subset_num = 0;
+                num_subsets = 1;
+            end
+            handles = sirf.SIRF.DataHandleVector();
+            for k = 1 : numel(ads)
+                sirf.Utilities.assert_validity(ads{k}, 'AcquisitionData')
+                handles.push_back(ads{k}.handle_)
+            end
+            batch = calllib('mstir', 'mSTIR_acquisitionModelBwdBatch',...
+                self.handle_, handles.handle_, subset_num, num_subsets);
+            sirf.Utilities.check_status([self.name ':backward_batch'], batch)
+            images = cell(1, numel(ads));
+            for k = 1 : numel(ads)
+                images{k} = sirf.STIR.ImageData();
+                images{k}.handle_ = calllib...
+                    ('mstir', 'mSTIR_imageDataBatchItem', batch, k - 1);
+                sirf.Utilities.check_status...
+                    ([self.name ':backward_batch'], images{k}.handle_)
+            end
+            sirf.Utilities.delete(batch)
+        end
     end
 end
\ No newline at end of file
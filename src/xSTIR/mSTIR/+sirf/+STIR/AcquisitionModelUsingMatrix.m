@@ -52,5 +52,15 @@ classdef AcquisitionModelUsingMatrix < sirf.STIR.AcquisitionModel
             sirf.STIR.setParameter...
                 (self.handle_, self.name, 'matrix', matrix, 'h')
         end
+        function set_matrix_cache_directory(self, dir)
+%***SIRF*** set_matrix_cache_directory(dir) sets the directory with ray
+%         tracing matrices saved by the utility sirf_build_matrix_cache;
+%         if it has the matrix for the geometry at hand, set_up loads it
+%         instead of computing its elements. The default is the value of
+%         the environment variable SIRF_MATRIX_CACHE_DIR; empty dir
+%         disables the cache.
+            sirf.STIR.setParameter...
+                (self.handle_, self.name, 'matrix_cache_directory', dir, 'c')
+        end
     end
 end
\ No newline at end of file
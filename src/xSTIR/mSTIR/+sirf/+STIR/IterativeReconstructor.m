@@ -182,6 +182,34 @@ classdef IterativeReconstructor < sirf.STIR.Reconstructor
             sirf.Utilities.delete(h)
             %calllib('mutilities', 'mDeleteDataHandle', h)
         end
+        function write_checkpoint(self, dir, with_matrix)
+%***SIRF*** write_checkpoint(dir, with_matrix) saves the current estimate,
+%         subiteration number and sensitivity images (and, if with_matrix
+%         is true, the ray tracing matrix) in directory dir.
+            if isempty(self.image)
+                error([self.IR ':write_checkpoint'], ...
+                    'current estimate not set')
+            end
+            if nargin < 3
+                with_matrix = false;
+            end
+            h = calllib('mstir', 'mSTIR_writeReconstructionCheckpoint',...
+                self.handle_, self.image.handle_, dir, int32(with_matrix));
+            sirf.Utilities.check_status([self.IR ':write_checkpoint'], h)
+            sirf.Utilities.delete(h)
+        end
+        function resume(self, dir, image)
+%***SIRF*** resume(dir, image) sets up the reconstructor (instead of
+%         set_up) to continue from the checkpoint in directory dir;
+%         image is filled with the saved estimate and becomes the current
+%         estimate.
+            sirf.Utilities.assert_validity(image, 'ImageData')
+            h = calllib('mstir', 'mSTIR_resumeReconstruction',...
+                self.handle_, image.handle_, dir);
+            sirf.Utilities.check_status([self.IR ':resume'], h)
+            sirf.Utilities.delete(h)
+            self.image = image;
+        end
 %         function reconstruct(self, image)
 % %***SIRF*** Reconstruct the image 
 % %         by applying currently set range of
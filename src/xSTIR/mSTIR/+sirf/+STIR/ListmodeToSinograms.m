@@ -11,6 +11,19 @@ classdef ListmodeToSinograms < handle
 %     - `store_prompts`=`true`, `store_delayeds`=`true`: prompts-delayeds stored
 %     Clearly, enabling the `store_delayeds` option only makes sense if the
 %     data was acquired accordingly.
+%     The conversion flag `parallel_unlisting` (`true` by default) makes
+%     process() bin the events on several threads, with the same result
+%     (if it is off, STIR's serial conversion is used).
+%     All time frames set by set_time_frames() are converted in one pass
+%     over the listmode data; with the flag `separate_delayeds` on (and
+%     `store_delayeds` on), the delayeds are stored separately rather than
+%     subtracted from the prompts (see get_frames()).
+%     With the flag `accumulate_fan_sums` on (the default), process() also
+%     accumulates the delayeds fan sums used by estimate_randoms(), which
+%     then does not need to read the listmode data again.
+%     With the flag `sparse_output` on, the sinograms returned by
+%     get_output() store only their non-zero bins, which for short time
+%     frames takes much less memory.
 %   - estimate_randoms() can be used to get a relatively noiseless estimate of the 
 %     random coincidences. 
 % Currently, the randoms are estimated from the delayed coincidences using the
@@ -87,6 +100,22 @@ classdef ListmodeToSinograms < handle
             sirf.Utilities.check_status([self.name_ ':set_interval'], h);
             sirf.Utilities.delete(h)
         end
+        function set_time_frames(self, frames)
+            %***SIRF*** Sets the time intervals of the frames to convert.
+            % frames: n-by-2 array of [start stop] intervals, sorted by time
+            % and not overlapping.
+            assert(size(frames, 2) == 2, 'time frames must be [start stop] pairs')
+            n = size(frames, 1);
+            ptr = libpointer('doublePtr', double(reshape(frames', 1, 2*n)));
+            h = calllib('mstir', 'mSTIR_setListmodeToSinogramsFrames', ...
+                self.handle_, n, ptr);
+            sirf.Utilities.check_status([self.name_ ':set_time_frames'], h);
+            sirf.Utilities.delete(h)
+        end
+        function n = get_num_frames(self)
+            %***SIRF*** Returns the number of time frames to convert.
+            n = sirf.STIR.parameter(self.handle_, self.name_, 'num_frames', 'i');
+        end
         function flag_on(self, flag)
             %***SIRF*** Switches on (sets to 'true') a conversion flag 
             % (see conversion flags description above).
@@ -124,6 +153,26 @@ classdef ListmodeToSinograms < handle
             assert(~isempty(self.output_), 'Conversion to sinograms not done')
             output = self.output_;
         end
+        function frames = get_frames(self, delayeds)
+            %***SIRF*** Returns the sinograms of all time frames as a cell
+            % array of AcquisitionData objects, stored as per the current
+            % storage scheme. If delayeds is true, returns the delayeds
+            % sinograms (requires the flags store_delayeds and
+            % separate_delayeds on).
+            assert(~isempty(self.output_), 'Conversion to sinograms not done')
+            if nargin < 2
+                delayeds = false;
+            end
+            n = self.get_num_frames();
+            frames = cell(1, n);
+            for f = 1 : n
+                ad = sirf.STIR.AcquisitionData();
+                ad.handle_ = calllib('mstir', 'mSTIR_listmodeToSinogramsFrame', ...
+                    self.handle_, f, int32(delayeds));
+                sirf.Utilities.check_status([self.name_ ':get_frames'], ad.handle_);
+                frames{f} = ad;
+            end
+        end
         function randoms = estimate_randoms(self)
             %***SIRF*** Estimates randoms.
             randoms = sirf.STIR.AcquisitionData();
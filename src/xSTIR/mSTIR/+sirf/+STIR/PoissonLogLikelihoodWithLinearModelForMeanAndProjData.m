@@ -85,5 +85,27 @@ classdef PoissonLogLikelihoodWithLinearModelForMeanAndProjData < ...
 %             sirf.STIR.setParameter(self.handle_, self.name,...
 %                 'proj_data_sptr', acq_data, 'h')
         end
+        function set_sensitivity_cache_directory(self, dir)
+%***SIRF*** set_sensitivity_cache_directory(dir) sets the directory where
+%         sensitivity images computed by set_up are kept and reused by
+%         set-ups with the same projectors, acquisition data geometry,
+%         normalisation, image geometry and subsets;
+%         an empty string disables the cache.
+            sirf.STIR.setParameter(self.handle_, self.name,...
+                'sensitivity_cache_directory', dir, 'c')
+        end
+        function set_sensitivity_cache_size(self, size)
+%***SIRF*** set_sensitivity_cache_size(size) sets the sensitivity cache
+%         size in MB; least recently used sensitivity images are removed
+%         when it is exceeded.
+            sirf.STIR.setParameter(self.handle_, self.name,...
+                'sensitivity_cache_size', size, 'i')
+        end
+        function set_num_processes(self, num)
+%***SIRF*** set_num_processes(num) sets the number of worker processes
+%         computing subset gradients (POSIX systems only).
+            sirf.STIR.setParameter(self.handle_, self.name,...
+                'num_processes', num, 'i')
+        end
     end
 end
@@ -51,6 +51,9 @@ EXPORTED_FUNCTION 	void* mSTIR_parameter(const void* ptr, const char* obj, const
 EXPORTED_FUNCTION 	void* mSTIR_setListmodeToSinogramsInterval (void* ptr_acq, PTR_FLOAT ptr_data) {
 	return cSTIR_setListmodeToSinogramsInterval (ptr_acq, ptr_data);
 }
+EXPORTED_FUNCTION 	void* mSTIR_setListmodeToSinogramsFrames (void* ptr_lm2s, int num_frames, PTR_DOUBLE ptr_data) {
+	return cSTIR_setListmodeToSinogramsFrames (ptr_lm2s, num_frames, ptr_data);
+}
 EXPORTED_FUNCTION 	void* mSTIR_setListmodeToSinogramsFlag (void* ptr_lm2s, const char* flag, int v) {
 	return cSTIR_setListmodeToSinogramsFlag (ptr_lm2s, flag, v);
 }
@@ -60,6 +63,9 @@ EXPORTED_FUNCTION 	void* mSTIR_setupListmodeToSinogramsConverter(void* ptr) {
 EXPORTED_FUNCTION 	void* mSTIR_convertListmodeToSinograms(void* ptr) {
 	return cSTIR_convertListmodeToSinograms(ptr);
 }
+EXPORTED_FUNCTION 	void* mSTIR_listmodeToSinogramsFrame(void* ptr, int frame_num, int delayeds) {
+	return cSTIR_listmodeToSinogramsFrame(ptr, frame_num, delayeds);
+}
 EXPORTED_FUNCTION 	void* mSTIR_computeRandoms(void* ptr) {
 	return cSTIR_computeRandoms(ptr);
 }
@@ -90,15 +96,33 @@ EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelFwd(void* ptr_am, void* ptr_im,
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelFwdReplace (void* ptr_am, void* ptr_im, int subset_num, int num_subsets, void* ptr_ad) {
 	return cSTIR_acquisitionModelFwdReplace (ptr_am, ptr_im, subset_num, num_subsets, ptr_ad);
 }
+EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelFwdSubsetViews(void* ptr_am, void* ptr_im, int subset_num, int num_subsets) {
+	return cSTIR_acquisitionModelFwdSubsetViews(ptr_am, ptr_im, subset_num, num_subsets);
+}
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelBwd(void* ptr_am, void* ptr_ad, int subset_num, int num_subsets) {
 	return cSTIR_acquisitionModelBwd(ptr_am, ptr_ad, subset_num, num_subsets);
 }
+EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelFwdBatch(void* ptr_am, const void* ptr_images, int subset_num, int num_subsets) {
+	return cSTIR_acquisitionModelFwdBatch(ptr_am, ptr_images, subset_num, num_subsets);
+}
+EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelBwdBatch(void* ptr_am, const void* ptr_ads, int subset_num, int num_subsets) {
+	return cSTIR_acquisitionModelBwdBatch(ptr_am, ptr_ads, subset_num, num_subsets);
+}
+EXPORTED_FUNCTION 	void* mSTIR_acquisitionDataBatchItem(const void* ptr_b, int k) {
+	return cSTIR_acquisitionDataBatchItem(ptr_b, k);
+}
+EXPORTED_FUNCTION 	void* mSTIR_imageDataBatchItem(const void* ptr_b, int k) {
+	return cSTIR_imageDataBatchItem(ptr_b, k);
+}
 EXPORTED_FUNCTION 	void* mSTIR_getAcquisitionsStorageScheme() {
 	return cSTIR_getAcquisitionsStorageScheme();
 }
 EXPORTED_FUNCTION 	void* mSTIR_setAcquisitionsStorageScheme(const char* scheme) {
 	return cSTIR_setAcquisitionsStorageScheme(scheme);
 }
+EXPORTED_FUNCTION 	void* mSTIR_setAcquisitionsScratchDirectory(const char* dir) {
+	return cSTIR_setAcquisitionsScratchDirectory(dir);
+}
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionsDataFromTemplate(void* ptr_t) {
 	return cSTIR_acquisitionsDataFromTemplate(ptr_t);
 }
@@ -144,6 +168,12 @@ EXPORTED_FUNCTION 	void* mSTIR_runReconstruction(void* ptr_r, void* ptr_i) {
 EXPORTED_FUNCTION 	void* mSTIR_updateReconstruction(void* ptr_r, void* ptr_i) {
 	return cSTIR_updateReconstruction(ptr_r, ptr_i);
 }
+EXPORTED_FUNCTION 	void* mSTIR_writeReconstructionCheckpoint (void* ptr_r, void* ptr_i, const char* dir, int with_matrix) {
+	return cSTIR_writeReconstructionCheckpoint (ptr_r, ptr_i, dir, with_matrix);
+}
+EXPORTED_FUNCTION 	void* mSTIR_resumeReconstruction(void* ptr_r, void* ptr_i, const char* dir) {
+	return cSTIR_resumeReconstruction(ptr_r, ptr_i, dir);
+}
 EXPORTED_FUNCTION 	void* mSTIR_setupObjectiveFunction(void* ptr_r, void* ptr_i) {
 	return cSTIR_setupObjectiveFunction(ptr_r, ptr_i);
 }
@@ -40,9 +40,11 @@ EXPORTED_FUNCTION 	void* mSTIR_objectFromFile(const char* name, const char* file
 EXPORTED_FUNCTION 	void* mSTIR_setParameter (void* ptr, const char* obj, const char* name, const void* value);
 EXPORTED_FUNCTION 	void* mSTIR_parameter(const void* ptr, const char* obj, const char* name);
 EXPORTED_FUNCTION 	void* mSTIR_setListmodeToSinogramsInterval (void* ptr_acq, PTR_FLOAT ptr_data);
+EXPORTED_FUNCTION 	void* mSTIR_setListmodeToSinogramsFrames (void* ptr_lm2s, int num_frames, PTR_DOUBLE ptr_data);
 EXPORTED_FUNCTION 	void* mSTIR_setListmodeToSinogramsFlag (void* ptr_lm2s, const char* flag, int v);
 EXPORTED_FUNCTION 	void* mSTIR_setupListmodeToSinogramsConverter(void* ptr);
 EXPORTED_FUNCTION 	void* mSTIR_convertListmodeToSinograms(void* ptr);
+EXPORTED_FUNCTION 	void* mSTIR_listmodeToSinogramsFrame(void* ptr, int frame_num, int delayeds);
 EXPORTED_FUNCTION 	void* mSTIR_computeRandoms(void* ptr);
 EXPORTED_FUNCTION 	void* mSTIR_applyImageDataProcessor(const void* ptr_p, void* ptr_d);
 EXPORTED_FUNCTION 	void* mSTIR_createPETAcquisitionSensitivityModel (const void* ptr_src, const char* src);
@@ -53,9 +55,15 @@ EXPORTED_FUNCTION 	void* mSTIR_applyAcquisitionSensitivityModel (void* ptr_sm, v
 EXPORTED_FUNCTION 	void* mSTIR_setupAcquisitionModel(void* ptr_am, void* ptr_dt, void* ptr_im);
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelFwd(void* ptr_am, void* ptr_im,  int subset_num, int num_subsets);
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelFwdReplace (void* ptr_am, void* ptr_im, int subset_num, int num_subsets, void* ptr_ad);
+EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelFwdSubsetViews(void* ptr_am, void* ptr_im, int subset_num, int num_subsets);
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelBwd(void* ptr_am, void* ptr_ad, int subset_num, int num_subsets);
+EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelFwdBatch(void* ptr_am, const void* ptr_images, int subset_num, int num_subsets);
+EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelBwdBatch(void* ptr_am, const void* ptr_ads, int subset_num, int num_subsets);
+EXPORTED_FUNCTION 	void* mSTIR_acquisitionDataBatchItem(const void* ptr_b, int k);
+EXPORTED_FUNCTION 	void* mSTIR_imageDataBatchItem(const void* ptr_b, int k);
 EXPORTED_FUNCTION 	void* mSTIR_getAcquisitionsStorageScheme();
 EXPORTED_FUNCTION 	void* mSTIR_setAcquisitionsStorageScheme(const char* scheme);
+EXPORTED_FUNCTION 	void* mSTIR_setAcquisitionsScratchDirectory(const char* dir);
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionsDataFromTemplate(void* ptr_t);
 EXPORTED_FUNCTION 	void* mSTIR_cloneAcquisitionData(void* ptr_ad);
 EXPORTED_FUNCTION 	void* mSTIR_rebinnedAcquisitionData(void* ptr_t, const int num_segments_to_combine, const int num_views_to_combine, const int num_tang_poss_to_trim, const bool do_normalisation, const int max_in_segment_num_to_process );
@@ -71,6 +79,8 @@ EXPORTED_FUNCTION 	void* mSTIR_runFBP2DReconstruction(void* ptr_r);
 EXPORTED_FUNCTION 	void* mSTIR_setupReconstruction(void* ptr_r, void* ptr_i);
 EXPORTED_FUNCTION 	void* mSTIR_runReconstruction(void* ptr_r, void* ptr_i);
 EXPORTED_FUNCTION 	void* mSTIR_updateReconstruction(void* ptr_r, void* ptr_i);
+EXPORTED_FUNCTION 	void* mSTIR_writeReconstructionCheckpoint (void* ptr_r, void* ptr_i, const char* dir, int with_matrix);
+EXPORTED_FUNCTION 	void* mSTIR_resumeReconstruction(void* ptr_r, void* ptr_i, const char* dir);
 EXPORTED_FUNCTION 	void* mSTIR_setupObjectiveFunction(void* ptr_r, void* ptr_i);
 EXPORTED_FUNCTION 	void*	mSTIR_subsetSensitivity(void* ptr_f, int subset);
 EXPORTED_FUNCTION 	void* mSTIR_objectiveFunctionValue(void* ptr_f, void* ptr_i);
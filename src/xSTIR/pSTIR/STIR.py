@@ -21,6 +21,7 @@ Object-Oriented wrap for the cSTIR-to-Python interface pystir.py
 #   limitations under the License.
 
 import abc
+import ctypes
 import inspect
 import numpy
 import os
@@ -238,6 +239,17 @@ class EllipticCylinder(Shape):
         return (rx, ry)
 
 #class ImageData(DataContainer):
+class _ImageDataOwner(object):
+    '''
+    Holds a handle to the voxel values of an image viewed by a Numpy array
+    (see ImageData.as_array).
+    '''
+    def __init__(self, handle):
+        self.handle = handle
+    def __del__(self):
+        if self.handle is not None:
+            pyiutil.deleteDataHandle(self.handle)
+
 class ImageData(SIRF.ImageData):
     '''Class for PET image data objects.
 
@@ -332,12 +344,8 @@ class ImageData(SIRF.ImageData):
         '''
         assert self.handle is not None
         if isinstance(value, numpy.ndarray):
-            if value.dtype is numpy.dtype('float32'):
-                #print('keeping dtype float32')
-                v = value
-            else:
-                #print('changing dtype to float32')
-                v = value.astype(numpy.float32)
+            # copies only if value is not C-contiguous float32 array
+            v = numpy.ascontiguousarray(value, dtype=numpy.float32)
             try_calling(pystir.cSTIR_setImageData(self.handle, v.ctypes.data))
         elif isinstance(value, float):
             try_calling(pystir.cSTIR_fillImage(self.handle, value))
@@ -390,10 +398,26 @@ class ImageData(SIRF.ImageData):
         try_calling \
             (pystir.cSTIR_getImageTransformMatrix(self.handle, tm.ctypes.data))
         return tm
-    def as_array(self):
-        '''Returns 3D Numpy ndarray with values at the voxels.'''
+    def as_array(self, copy=True):
+        '''Returns 3D Numpy ndarray with values at the voxels.
+
+        If copy is False, the returned array shares the voxel values with
+        this image, so that changes to either are seen in the other, and
+        keeps them alive for as long as it exists. This is only possible if
+        the image is stored in one block of memory; otherwise an error is
+        raised.
+        '''
         assert self.handle is not None
-        array = numpy.ndarray(self.dimensions(), dtype = numpy.float32)
+        dim = self.dimensions()
+        if not copy:
+            address = numpy.ndarray((1,), dtype = numpy.uint64)
+            handle = pystir.cSTIR_imageDataView(self.handle, address.ctypes.data)
+            check_status(handle)
+            n = int(numpy.prod(dim))
+            buffer = (ctypes.c_float * n).from_address(int(address[0]))
+            buffer._owner = _ImageDataOwner(handle)
+            return numpy.frombuffer(buffer, dtype = numpy.float32).reshape(dim)
+        array = numpy.ndarray(dim, dtype = numpy.float32)
         try_calling(pystir.cSTIR_getImageData(self.handle, array.ctypes.data))
         return array
     def show(self, slice = None, title = None):
@@ -605,9 +629,22 @@ class AcquisitionData(DataContainer):
         scheme = 'memory':
             all acquisition data generated from now on will be kept in RAM
             (avoid if data is very large)
+        scheme = 'mmap':
+            all acquisition data generated from now on will be kept in
+            scratch files mapped to memory, paged in and out by the operating
+            system as needed (see set_scratch_directory)
         '''
         try_calling(pystir.cSTIR_setAcquisitionsStorageScheme(scheme))
     @staticmethod
+    def set_scratch_directory(dir):
+        '''Sets the directory for the scratch files of the 'mmap' scheme.
+
+        A directory on a fast device (tmpfs, NVMe) is recommended. By default,
+        the directory specified by the environment variable SIRF_SCRATCH_DIR
+        is used, or else the current directory.
+        '''
+        try_calling(pystir.cSTIR_setAcquisitionsScratchDirectory(dir))
+    @staticmethod
     def get_storage_scheme():
         '''Returns acquisition data storage scheme.
         '''
@@ -802,6 +839,19 @@ class ListmodeToSinograms:
         - `store_prompts`=`true`, `store_delayeds`=`true`: prompts-delayeds stored
         Clearly, enabling the `store_delayeds` option only makes sense if the
         data was acquired accordingly.
+        The conversion flag `parallel_unlisting` (`true` by default) makes
+        process() bin the events on several threads, with the same result
+        (if it is off, STIR's serial conversion is used).
+        All time frames set by set_time_frames() are converted in one pass
+        over the listmode data; with the flag `separate_delayeds` on (and
+        `store_delayeds` on), the delayeds are stored separately rather than
+        subtracted from the prompts (see get_frames()).
+        With the flag `accumulate_fan_sums` on (the default), process() also
+        accumulates the delayeds fan sums used by estimate_randoms(), which
+        then does not need to read the listmode data again.
+        With the flag `sparse_output` on, the sinograms returned by
+        get_output() and get_frames() store only their non-zero bins, which
+        for short time frames takes much less memory.
       - estimate_randoms() can be used to get a relatively noiseless estimate of the 
         random coincidences.
 
@@ -854,6 +904,22 @@ class ListmodeToSinograms:
         interval[1] = stop
         try_calling(pystir.cSTIR_setListmodeToSinogramsInterval\
             (self.handle, interval.ctypes.data))
+    def set_time_frames(self, frames):
+        '''Sets the time intervals of the frames to convert.
+
+        frames: sequence of (start, stop) pairs, or an array of shape (n, 2),
+        sorted by time and not overlapping.
+        '''
+        intervals = numpy.array(frames, dtype = numpy.float64)
+        if intervals.ndim != 2 or intervals.shape[1] != 2:
+            raise error('time frames must be (start, stop) pairs')
+        intervals = numpy.ascontiguousarray(intervals)
+        try_calling(pystir.cSTIR_setListmodeToSinogramsFrames\
+            (self.handle, intervals.shape[0], intervals.ctypes.data))
+    def get_num_frames(self):
+        '''Returns the number of time frames to convert.
+        '''
+        return _int_par(self.handle, self.name, 'num_frames')
     def flag_on(self, flag):
         '''Switches on (sets to 'true') a conversion flag (see conversion flags
            description above).
@@ -883,6 +949,23 @@ class ListmodeToSinograms:
         if self.output is None:
             raise error('Conversion to sinograms not done')
         return self.output
+    def get_frames(self, delayeds = False):
+        '''Returns the sinograms of all time frames as a list of
+           AcquisitionData objects, stored as per the current storage scheme.
+
+        delayeds: if True, returns the delayeds sinograms (requires the flags
+                  `store_delayeds` and `separate_delayeds` on).
+        '''
+        if self.output is None:
+            raise error('Conversion to sinograms not done')
+        frames = []
+        for f in range(self.get_num_frames()):
+            ad = AcquisitionData()
+            ad.handle = pystir.cSTIR_listmodeToSinogramsFrame\
+                (self.handle, f + 1, int(delayeds))
+            check_status(ad.handle)
+            frames.append(ad)
+        return frames
     def estimate_randoms(self):
         '''Returns an estimate of the randoms as an AcquisitionData object.
         '''
@@ -1050,6 +1133,23 @@ class AcquisitionModel:
         assert_validity(asm, AcquisitionSensitivityModel)
         _setParameter\
             (self.handle, 'AcquisitionModel', 'asm', asm.handle)
+    def set_terms_storage(self, storage):
+        '''
+        Sets the storage format of the additive and background terms and
+        of the normalisation (which stay constant during reconstruction):
+        'float' (default), 'half' (16-bit floating point, about 3
+        significant digits) or 'uint16' (16-bit integers scaled per row of
+        tangential positions, exact for integer-valued terms); in the
+        latter two cases normalisation created from bin efficiencies is
+        stored as 'half'. Only these 16-bit copies are kept, which halves
+        the memory the terms take.
+        '''
+        _set_char_par(self.handle, 'AcquisitionModel', 'terms_storage', storage)
+    def get_terms_storage(self):
+        '''
+        Returns the storage format of the additive and background terms.
+        '''
+        return _char_par(self.handle, 'AcquisitionModel', 'terms_storage')
     def forward(self, image, subset_num = 0, num_subsets = 1, ad = None):
         ''' 
         Returns the forward projection of image;
@@ -1065,6 +1165,19 @@ class AcquisitionModel:
         assert_validity(ad, AcquisitionData)
         try_calling(pystir.cSTIR_acquisitionModelFwdReplace \
             (self.handle, image.handle, subset_num, num_subsets, ad.handle))
+    def forward_subset_views(self, image, subset_num, num_subsets):
+        '''
+        Returns the forward projection of image for the views of a subset,
+        stored for these views only (which takes memory proportional to
+        the subset size); the other views read as zeros;
+        image   :  an ImageData object.
+        '''
+        assert_validity(image, ImageData)
+        ad = AcquisitionData()
+        ad.handle = pystir.cSTIR_acquisitionModelFwdSubsetViews \
+                    (self.handle, image.handle, subset_num, num_subsets)
+        check_status(ad.handle)
+        return ad
     def backward(self, ad, subset_num = 0, num_subsets = 1):
         ''' 
         Returns the backward projection of ad;
@@ -1076,6 +1189,49 @@ class AcquisitionModel:
             (self.handle, ad.handle, subset_num, num_subsets)
         check_status(image.handle)
         return image
+    def forward_batch(self, images, subset_num = 0, num_subsets = 1):
+        '''
+        Returns the list of forward projections of images, which must have
+        the same geometry; the result is that of forward applied to each
+        image, but the geometry of each bin is computed once for all images;
+        images:  a list of ImageData objects.
+        '''
+        handles = SIRF.DataHandleVector()
+        for image in images:
+            assert_validity(image, ImageData)
+            handles.push_back(image.handle)
+        batch = pystir.cSTIR_acquisitionModelFwdBatch \
+            (self.handle, handles.handle, subset_num, num_subsets)
+        check_status(batch)
+        ads = []
+        for k in range(len(images)):
+            ad = AcquisitionData()
+            ad.handle = pystir.cSTIR_acquisitionDataBatchItem(batch, k)
+            check_status(ad.handle)
+            ads.append(ad)
+        pyiutil.deleteDataHandle(batch)
+        return ads
+    def backward_batch(self, ads, subset_num = 0, num_subsets = 1):
+        '''
+        Returns the list of backprojections of ads, which must have the same
+        geometry (see forward_batch);
+        ads:  a list of AcquisitionData objects.
+        '''
+        handles = SIRF.DataHandleVector()
+        for ad in ads:
+            assert_validity(ad, AcquisitionData)
+            handles.push_back(ad.handle)
+        batch = pystir.cSTIR_acquisitionModelBwdBatch \
+            (self.handle, handles.handle, subset_num, num_subsets)
+        check_status(batch)
+        images = []
+        for k in range(len(ads)):
+            image = ImageData()
+            image.handle = pystir.cSTIR_imageDataBatchItem(batch, k)
+            check_status(image.handle)
+            images.append(image)
+        pyiutil.deleteDataHandle(batch)
+        return images
 
 class AcquisitionModelUsingMatrix(AcquisitionModel):
     ''' 
@@ -1107,6 +1263,20 @@ class AcquisitionModelUsingMatrix(AcquisitionModel):
         # TODO will need to allow for different matrices here
         assert_validity(matrix, RayTracingMatrix)
         _setParameter(self.handle, self.name, 'matrix', matrix.handle)
+    def set_matrix_cache_directory(self, dir):
+        '''
+        Sets the directory with ray tracing matrices saved by the utility
+        sirf_build_matrix_cache; if it has the matrix for the geometry at
+        hand, set_up() loads it instead of computing its elements.
+        The default is the value of the environment variable
+        SIRF_MATRIX_CACHE_DIR; empty dir disables the cache.
+        '''
+        _set_char_par(self.handle, self.name, 'matrix_cache_directory', dir)
+    def get_matrix_cache_directory(self):
+        '''
+        Returns the directory with saved ray tracing matrices.
+        '''
+        return _char_par(self.handle, self.name, 'matrix_cache_directory')
 ##    def get_matrix(self):
 ##        ''' 
 ##        Returns the ray tracing matrix used for projecting;
@@ -1467,6 +1637,47 @@ class PoissonLogLikelihoodWithLinearModelForMeanAndProjData\
         assert_validity(ad, AcquisitionData)
         _setParameter\
             (self.handle, self.name, 'acquisition_data', ad.handle)
+    def set_sensitivity_cache_directory(self, dir):
+        '''
+        Sets the directory where sensitivity images computed by set_up() are
+        kept and reused by set-ups with the same projectors, acquisition
+        data geometry, normalisation, image geometry and subsets.
+        An empty string disables the cache (the default, unless the
+        environment variable SIRF_SENSITIVITY_CACHE_DIR is set).
+        '''
+        _set_char_par\
+            (self.handle, self.name, 'sensitivity_cache_directory', dir)
+    def get_sensitivity_cache_directory(self):
+        '''
+        Returns the sensitivity cache directory.
+        '''
+        return _char_par\
+            (self.handle, self.name, 'sensitivity_cache_directory')
+    def set_sensitivity_cache_size(self, size):
+        '''
+        Sets the sensitivity cache size in MB; least recently used sensitivity
+        images are removed when it is exceeded.
+        '''
+        _set_int_par\
+            (self.handle, self.name, 'sensitivity_cache_size', size)
+    def get_sensitivity_cache_size(self):
+        '''
+        Returns the sensitivity cache size in MB.
+        '''
+        return _int_par(self.handle, self.name, 'sensitivity_cache_size')
+    def set_num_processes(self, num):
+        '''
+        Sets the number of worker processes computing subset gradients
+        (POSIX systems only); the current estimate and gradients are
+        exchanged with them via shared memory. If STIR uses OpenMP,
+        OMP_NUM_THREADS=1 is advisable with more than one process.
+        '''
+        _set_int_par(self.handle, self.name, 'num_processes', num)
+    def get_num_processes(self):
+        '''
+        Returns the number of processes computing subset gradients.
+        '''
+        return _int_par(self.handle, self.name, 'num_processes')
 
 class Reconstructor:
     '''
@@ -1701,6 +1912,29 @@ class IterativeReconstructor(Reconstructor):
         self.set_current_estimate(image)
         self.update_current_estimate()
         return self.get_current_estimate()
+    def write_checkpoint(self, dir, with_matrix=False):
+        '''
+        Saves the current estimate, subiteration number and sensitivity
+        images (and, if with_matrix is True, the ray tracing matrix of the
+        acquisition model) in directory dir, so that the reconstruction can
+        be resumed from there by resume(). The previous checkpoint in dir
+        remains valid until the new one is complete.
+        '''
+        if self.image is None:
+            raise error('current estimate not set')
+        try_calling(pystir.cSTIR_writeReconstructionCheckpoint\
+                    (self.handle, self.image.handle, dir, int(with_matrix)))
+    def resume(self, dir, image):
+        '''
+        Sets up the reconstructor (instead of set_up) to continue from the
+        checkpoint in directory dir without recomputing sensitivities:
+        image, which must have the geometry of the saved estimate, is
+        filled with the estimate and becomes the current estimate.
+        '''
+        assert_validity(image, ImageData)
+        try_calling(pystir.cSTIR_resumeReconstruction\
+                    (self.handle, image.handle, dir))
+        self.set_current_estimate(image)
 
 class OSMAPOSLReconstructor(IterativeReconstructor):
     '''